@@ -0,0 +1,123 @@
+/**
+ * @file llagentupdateencoder.cpp
+ * @brief Decides when an AgentUpdate is worth sending.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llagentupdateencoder.h"
+
+static const F32 ROTATION_QDOT_THRESHOLD = 0.9997f;
+static const F32 AXIS_DOT_THRESHOLD = 0.9988f;		// same angle as the rotations
+static const F32 CAMERA_MOVE_THRESHOLD_SQUARED = 0.05f * 0.05f;
+static const F32 FAR_THRESHOLD = 1.f;
+
+static const F64 MIN_INTERVAL = 0.1;				// AGENT_UPDATES_PER_SECOND
+static const F64 FLAG_INTERVAL = 1.0 / 30.0;
+static const F64 IDLE_INTERVAL = 1.0;
+static const S32 REPEATS = 2;
+
+static bool rotation_changed(const LLQuaternion& a, const LLQuaternion& b)
+{
+	// q and -q are the same rotation.
+	return fabsf(dot(a, b)) < ROTATION_QDOT_THRESHOLD;
+}
+
+static bool axis_changed(const LLVector3& a, const LLVector3& b)
+{
+	return a * b < AXIS_DOT_THRESHOLD;
+}
+
+LLAgentUpdateEncoder::LLAgentUpdateEncoder()
+:	mLastTime(0.0),
+	mRepeatsLeft(0),
+	mHaveSent(false),
+	mChanged(false),
+	mSentCount(0),
+	mSuppressedCount(0)
+{ }
+
+bool LLAgentUpdateEncoder::hasChanged(const LLAgentUpdateState& state) const
+{
+	return state.mControlFlags != mLast.mControlFlags
+		|| state.mState != mLast.mState
+		|| state.mFlags != mLast.mFlags
+		|| fabsf(state.mFar - mLast.mFar) > FAR_THRESHOLD
+		|| dist_vec_squared(state.mCameraCenter, mLast.mCameraCenter) > CAMERA_MOVE_THRESHOLD_SQUARED
+		|| axis_changed(state.mCameraAtAxis, mLast.mCameraAtAxis)
+		|| axis_changed(state.mCameraLeftAxis, mLast.mCameraLeftAxis)
+		|| axis_changed(state.mCameraUpAxis, mLast.mCameraUpAxis)
+		|| rotation_changed(state.mBodyRotation, mLast.mBodyRotation)
+		|| rotation_changed(state.mHeadRotation, mLast.mHeadRotation);
+}
+
+bool LLAgentUpdateEncoder::shouldSend(const LLAgentUpdateState& state, bool flags_dirty, F64 now)
+{
+	if (!mHaveSent)
+	{
+		mChanged = true;
+		return true;
+	}
+
+	mChanged = hasChanged(state);
+	F64 since = now - mLastTime;
+	bool flags_changed = (state.mControlFlags != mLast.mControlFlags);
+	bool send;
+	if (flags_changed && (flags_dirty || since >= FLAG_INTERVAL))
+	{
+		send = true;
+	}
+	else if (since < MIN_INTERVAL)
+	{
+		send = false;
+	}
+	else
+	{
+		send = mChanged || mRepeatsLeft > 0 || since >= IDLE_INTERVAL;
+	}
+
+	if (!send && since >= MIN_INTERVAL)
+	{
+		// Would have gone before.
+		mSuppressedCount++;
+	}
+	return send;
+}
+
+void LLAgentUpdateEncoder::sent(const LLAgentUpdateState& state, F64 now)
+{
+	if (mChanged)
+	{
+		mRepeatsLeft = REPEATS;
+	}
+	else if (mRepeatsLeft > 0)
+	{
+		mRepeatsLeft--;
+	}
+	mLast = state;
+	mLastTime = now;
+	mHaveSent = true;
+	mChanged = false;
+	mSentCount++;
+}
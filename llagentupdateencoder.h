@@ -0,0 +1,85 @@
+/**
+ * @file llagentupdateencoder.h
+ * @brief Decides when an AgentUpdate is worth sending.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLAGENTUPDATEENCODER_H
+#define LL_LLAGENTUPDATEENCODER_H
+
+#include "llquaternion.h"
+#include "v3math.h"
+
+// What an AgentUpdate carries, read from where send_agent_update() reads it.
+struct LLAgentUpdateState
+{
+	LLQuaternion	mBodyRotation;
+	LLQuaternion	mHeadRotation;
+	U8				mState;			// render state
+	U8				mFlags;			// AU_FLAGS_*
+	LLVector3		mCameraCenter;
+	LLVector3		mCameraAtAxis;
+	LLVector3		mCameraLeftAxis;
+	LLVector3		mCameraUpAxis;
+	F32				mFar;
+	U32				mControlFlags;
+};
+
+// Compares the agent's state with the last AgentUpdate sent and only asks
+// for another when something the simulator would notice has changed.
+// Rotations and camera axes count as changed past about 2.8 degrees (the
+// head rotation threshold send_agent_update() already uses), the camera
+// past 5 cm, the draw distance past a metre, and flags and state on any
+// change.
+//
+// Newly set control flags go at once, as they may be one frame presses
+// that LLAgent::resetControlFlags() clears, and released ones within
+// FLAG_INTERVAL. Anything else, including flags an input device asserts
+// again every frame, goes at most every MIN_INTERVAL. AgentUpdate is
+// unreliable, so a changed state is sent REPEATS more times before going
+// quiet, and an idle agent still sends one every IDLE_INTERVAL.
+class LLAgentUpdateEncoder
+{
+public:
+	LLAgentUpdateEncoder();
+
+	// 'flags_dirty' is LLAgent::controlFlagsDirty().
+	bool shouldSend(const LLAgentUpdateState& state, bool flags_dirty, F64 now);
+	void sent(const LLAgentUpdateState& state, F64 now);
+
+	U32 getSentCount() const		{ return mSentCount; }
+	U32 getSuppressedCount() const	{ return mSuppressedCount; }
+
+private:
+	bool hasChanged(const LLAgentUpdateState& state) const;
+
+	LLAgentUpdateState	mLast;
+	F64					mLastTime;
+	S32					mRepeatsLeft;
+	bool				mHaveSent;
+	bool				mChanged;		// the state being sent differs from the last
+	U32					mSentCount;
+	U32					mSuppressedCount;
+};
+
+#endif
@@ -40,6 +40,7 @@
 #include "llgroupmgr.h"
 #include "llagent.h"
 #include "llagentcamera.h"
+#include "llagentupdateencoder.h"
 #include "llagentlanguage.h"
 #include "llagentwearables.h"
 #include "llwindow.h"
@@ -56,6 +57,23 @@
 #include "llfocusmgr.h"
 #include "llviewerjoystick.h"
 #include "llviewernui.h"
+#include "llinputqueue.h"
+#include "llframetaskgraph.h"
+#include "llframetick.h"
+#include "llcompletionqueue.h"
+#include "lldecodethrottle.h"
+#include "llframebudget.h"
+#include "llframepacer.h"
+#include "llheartbeat.h"
+#include "llmainloopbenchmark.h"
+#include "llmessagecostmodel.h"
+#include "llmessageprofiler.h"
+#include "llmessagetemplate.h"
+#include "llobjectupdatedecoder.h"
+#include "llpacketreceiver.h"
+#include "llstallcapture.h"
+#include "lltimerwheel.h"
+#include "lljobsystem.h"
 #include "llallocator.h"
 #include "llares.h" 
 #include "llcurl.h"
@@ -263,6 +281,125 @@ extern BOOL gDebugGL;
 ////////////////////////////////////////////////////////////
 // All from the last globals push...
 
+// Main loop watchdog stages, interned once so a ping is a single store.
+static LLHeartbeat sMainloopHeartbeat;
+static LLHeartbeatMonitor* sMainloopHeartbeatMonitor = NULL;
+// Registered by register_mainloop_stages() in init().
+static U32 STAGE_MISC_NATIVE_WINDOW_EVENTS = LLHeartbeat::NO_STAGE;
+static U32 STAGE_GATHER_INPUT = LLHeartbeat::NO_STAGE;
+static U32 STAGE_JOYSTICK_KEYBOARD = LLHeartbeat::NO_STAGE;
+static U32 STAGE_SERVICE_PUMP = LLHeartbeat::NO_STAGE;
+static U32 STAGE_DISPLAY = LLHeartbeat::NO_STAGE;
+static U32 STAGE_SNAPSHOT = LLHeartbeat::NO_STAGE;
+static U32 STAGE_SLEEP = LLHeartbeat::NO_STAGE;
+static U32 STAGE_END = LLHeartbeat::NO_STAGE;
+static U32 STAGE_IDLE = LLHeartbeat::NO_STAGE;
+static U32 STAGE_IDLE_NETWORK = LLHeartbeat::NO_STAGE;
+
+static void register_mainloop_stages()
+{
+	LLHeartbeat::initClass();
+	STAGE_MISC_NATIVE_WINDOW_EVENTS = LLHeartbeat::registerStage("Main:MiscNativeWindowEvents");
+	STAGE_GATHER_INPUT = LLHeartbeat::registerStage("Main:GatherInput");
+	STAGE_JOYSTICK_KEYBOARD = LLHeartbeat::registerStage("Main:JoystickKeyboard");
+	STAGE_SERVICE_PUMP = LLHeartbeat::registerStage("Main:ServicePump");
+	STAGE_DISPLAY = LLHeartbeat::registerStage("Main:Display");
+	STAGE_SNAPSHOT = LLHeartbeat::registerStage("Main:Snapshot");
+	STAGE_SLEEP = LLHeartbeat::registerStage("Main:Sleep");
+	STAGE_END = LLHeartbeat::registerStage("Main:End");
+	STAGE_IDLE = LLHeartbeat::registerStage("Main:Idle");
+	STAGE_IDLE_NETWORK = LLHeartbeat::registerStage("idleNetwork");
+}
+
+// Headless benchmark run and packet trace, see mainLoop() and idleNetwork().
+static LLMainloopBenchmark* sBenchmark = NULL;
+static LLMessageTrace* sMessageTrace = NULL;
+
+// For idle_startup(): when a trace is being replayed, the session logs in
+// from the login response it recorded rather than from the login server.
+bool get_replay_login_response(LLSD& response)
+{
+	if (!sMessageTrace || sMessageTrace->isRecording())
+	{
+		return false;
+	}
+	response = sMessageTrace->getLoginResponse();
+	return true;
+}
+
+// Reads the UDP socket off the main thread, see idleNetwork().
+static LLPacketReceiver* sPacketReceiver = NULL;
+
+// Before the message system closes the socket.
+static void stop_packet_receiver()
+{
+	if (sPacketReceiver)
+	{
+		const LLPacketBufferPool& pool = sPacketReceiver->getPool();
+		llinfos << "Packet receiver ran out of buffers " << pool.getExhaustedCount() << " times, dropped "
+				<< sPacketReceiver->getDroppedCount() << " packets it could not expand" << llendl;
+		gMessageSystem->mPacketRing.setPacketViewSource(LLPacketRing::packet_view_source_t());
+		delete sPacketReceiver;
+		sPacketReceiver = NULL;
+	}
+}
+
+// Heap allocations made on the way from the socket to the handlers, which
+// stop once the buffers and the decoder's queue have grown to the load.
+static U32 get_packet_allocations()
+{
+	U32 allocations = sPacketReceiver ? sPacketReceiver->getPool().getAllocationCount() : 0;
+	LLObjectUpdateDecoder* decoder = LLObjectUpdateDecoder::getInstance();
+	return allocations + (decoder ? decoder->getAllocationCount() : 0);
+}
+
+// The packet source with object updates decoded on the job system: the
+// queued ones are applied before anything else is handed to the message
+// system, so it sees the objects as it would have without the decoder.
+static S32 next_packet_after_object_updates(const char*& data, LLHost& sender, LLHost& receiving_interface)
+{
+	LLObjectUpdateDecoder* decoder = LLObjectUpdateDecoder::getInstance();
+	if (decoder && decoder->hasPending() && sPacketReceiver->peekMessageNumber() != decoder->getMessageNumber())
+	{
+		decoder->flush();
+	}
+	return sPacketReceiver->nextPacketView(data, sender, receiving_interface);
+}
+
+// Once a frame from idle(), before idle_startup(), which reads the network
+// itself until the world is up. Trace frames count from UseCircuitCode, the
+// first message to the region, which STATE_WORLD_WAIT sends.
+static void update_message_trace()
+{
+	if (!sMessageTrace || !gMessageSystem)
+	{
+		return;
+	}
+	static bool trace_hooks_set = false;
+	if (!trace_hooks_set)
+	{
+		LLPacketRing& packet_ring = gMessageSystem->mPacketRing;
+		if (sMessageTrace->isRecording())
+		{
+			packet_ring.setPacketTap(boost::bind(&LLMessageTrace::record, sMessageTrace, _1, _2, _3));
+		}
+		else
+		{
+			// Stands in for the socket: nothing is read from the network.
+			packet_ring.setPacketSource(boost::bind(&LLMessageTrace::replay, sMessageTrace, _1, _2, _3));
+		}
+		trace_hooks_set = true;
+	}
+	if (LLStartUp::getStartupState() >= STATE_WORLD_WAIT)
+	{
+		if (sMessageTrace->isRecording() && !sMessageTrace->isSessionStarted())
+		{
+			sMessageTrace->startSession(LLLoginInstance::getInstance()->getResponse());
+		}
+		sMessageTrace->nextFrame();
+	}
+}
+
 F32 gSimLastTime; // Used in LLAppViewer::init and send_stats()
 F32 gSimFrames;
 
@@ -284,6 +421,7 @@ F32 gFPSClamped = 10.f;						// Pretend we start at target rate.
 F32 gFrameDTClamped = 0.f;					// Time between adjacent checks to network for packets
 U64	gStartTime = 0; // gStartTime is "private", used only to calculate gFrameTimeSeconds
 U32 gFrameStalls = 0;
+U32 gFrameDeadlineMisses = 0; // frames that overran the frame pacer's deadline
 const F64 FRAME_STALL_THRESHOLD = 1.0;
 
 LLTimer gRenderStartTime;
@@ -623,6 +761,8 @@ LLAppViewer* LLAppViewer::sInstance = NULL;
 LLTextureCache* LLAppViewer::sTextureCache = NULL; 
 LLImageDecodeThread* LLAppViewer::sImageDecodeThread = NULL; 
 LLTextureFetch* LLAppViewer::sTextureFetch = NULL; 
+// Services sImageDecodeThread from the job system, when that is enabled.
+static LLQueuedThreadPump* sImageDecodePump = NULL;
 
 LLAppViewer::LLAppViewer() : 
 	mMarkerFile(),
@@ -696,6 +836,9 @@ bool LLAppViewer::init()
 	//
 	// OK to write stuff to logs now, we've now crash reported if necessary
 	//
+
+	// Before the watchdog and heartbeat monitor start.
+	register_mainloop_stages();
 	
 	init_default_trans_args();
 	
@@ -1174,6 +1317,7 @@ static LLFastTimer::DeclareTimer FTM_TEXTURE_CACHE("Texture Cache");
 static LLFastTimer::DeclareTimer FTM_DECODE("Image Decode");
 static LLFastTimer::DeclareTimer FTM_VFS("VFS Thread");
 static LLFastTimer::DeclareTimer FTM_LFS("LFS Thread");
+static LLFastTimer::DeclareTimer FTM_COMPLETIONS("Completions");
 static LLFastTimer::DeclareTimer FTM_PAUSE_THREADS("Pause Threads");
 static LLFastTimer::DeclareTimer FTM_IDLE("Idle");
 static LLFastTimer::DeclareTimer FTM_PUMP("Pump");
@@ -1183,6 +1327,35 @@ static LLFastTimer::DeclareTimer FTM_SERVICE_CALLBACK("Callback");
 static LLFastTimer::DeclareTimer FTM_AGENT_AUTOPILOT("Autopilot");
 static LLFastTimer::DeclareTimer FTM_AGENT_UPDATE("Update");
 
+// Wakes the texture threads and hands decode work to the job system,
+// returning the number of requests they have pending.
+static S32 wake_texture_workers()
+{
+	S32 work_pending = 0;
+	F32 max_time = llmin(gFrameIntervalSeconds*10.f, 1.f);
+
+	{
+		LLFastTimer ftm(FTM_TEXTURE_CACHE);
+		work_pending += LLAppViewer::getTextureCache()->update(max_time); // unpauses the texture cache thread
+	}
+	{
+		LLFastTimer ftm(FTM_DECODE);
+		if (sImageDecodePump)
+		{
+			work_pending += sImageDecodePump->pump(); // hands decode work to the job system
+		}
+		else
+		{
+			work_pending += LLAppViewer::getImageDecodeThread()->update(max_time); // unpauses the image thread
+		}
+	}
+	{
+		LLFastTimer ftm(FTM_DECODE);
+		work_pending += LLAppViewer::getTextureFetch()->update(max_time); // unpauses the texture fetch thread
+	}
+	return work_pending;
+}
+
 bool LLAppViewer::mainLoop()
 {
 	LLMemType mt1(LLMemType::MTYPE_MAIN);
@@ -1203,6 +1376,41 @@ bool LLAppViewer::mainLoop()
 	LLVoiceClient::getInstance()->init(gServicePump);
 	LLVoiceChannel::setCurrentVoiceChannelChangedCallback(boost::bind(&LLCallFloater::sOnCurrentChannelChanged, _1), true);
 	LLTimer frameTimer,idleTimer;
+	// Fast timer history of recent frames, saved when one stalls.
+	LLStallCapture stall_capture;
+	LLTimer stall_capture_timer;
+	const S32 stall_capture_files = gSavedSettings.getS32("StallCaptureMaxFiles");
+	stall_capture.setMaxFiles(stall_capture_files);
+	stall_capture.setFilePrefix(gDirUtilp->getExpandedFilename(LL_PATH_LOGS, "stall_"));
+	// Headless benchmark: a fixed clock, no sensors and no pacing, then a
+	// report of what each stage cost.
+	const U32 benchmark_frames = gSavedSettings.getU32("BenchmarkFrames");
+	if (benchmark_frames)
+	{
+		sBenchmark = new LLMainloopBenchmark(gSavedSettings.getU32("BenchmarkWarmupFrames"), benchmark_frames,
+											 1.f / llmax(gSavedSettings.getF32("BenchmarkFrameRate"), 1.f));
+		llinfos << "Benchmarking " << benchmark_frames << " frames" << llendl;
+	}
+	const std::string replay_trace = gSavedSettings.getString("MessageTraceReplay");
+	const std::string record_trace = gSavedSettings.getString("MessageTraceRecord");
+	if (!replay_trace.empty() || !record_trace.empty())
+	{
+		sMessageTrace = new LLMessageTrace();
+		bool ok = replay_trace.empty() ? sMessageTrace->openForRecording(record_trace) : sMessageTrace->load(replay_trace);
+		if (!ok)
+		{
+			delete sMessageTrace;
+			sMessageTrace = NULL;
+		}
+	}
+	const std::string message_profile = gSavedSettings.getString("MessageProfileCSV");
+	if (!message_profile.empty())
+	{
+		LLMessageProfiler::getInstance()->setCSVFile(gDirUtilp->getExpandedFilename(LL_PATH_LOGS, message_profile));
+	}
+	LLTimer benchmark_timer;
+	U32 benchmark_packets = gPacketsIn;
+	U32 benchmark_packet_allocations = get_packet_allocations();
 	LLTimer debugTime;
 	LLViewerJoystick* joystick(LLViewerJoystick::getInstance());
 	LLViewerNui* nui(LLViewerNui::getInstance());
@@ -1227,6 +1435,40 @@ bool LLAppViewer::mainLoop()
 	while (!LLApp::isExiting())
 	{
 		LLFastTimer::nextFrame(); // Should be outside of any timer instances
+		if (stall_capture_files > 0)
+		{
+			stall_capture.recordFrame(gFrameCount, stall_capture_timer.getElapsedTimeAndResetF32());
+		}
+		if (sBenchmark && sMessageTrace && !sMessageTrace->isRecording()
+			&& LLStartUp::getStartupState() < STATE_STARTED)
+		{
+			// Logging in from the trace, which is not what is measured.
+			sBenchmark->skipFrame();
+			benchmark_timer.reset();
+			benchmark_packets = gPacketsIn;
+			benchmark_packet_allocations = get_packet_allocations();
+			if (sMessageTrace->isFinished())
+			{
+				llwarns << "Packet trace ran out before the session started, no benchmark" << llendl;
+				delete sBenchmark;
+				sBenchmark = NULL;
+				forceQuit();
+			}
+		}
+		else if (sBenchmark)
+		{
+			U32 packets = gPacketsIn - benchmark_packets;
+			benchmark_packets = gPacketsIn;
+			U32 packet_allocations = get_packet_allocations() - benchmark_packet_allocations;
+			benchmark_packet_allocations += packet_allocations;
+			if (!sBenchmark->recordFrame(benchmark_timer.getElapsedTimeAndResetF32(), packets, packet_allocations))
+			{
+				sBenchmark->writeReport(gDirUtilp->getExpandedFilename(LL_PATH_LOGS, gSavedSettings.getString("BenchmarkReport")));
+				delete sBenchmark;
+				sBenchmark = NULL;
+				forceQuit();
+			}
+		}
 
 		//clear call stack records
 		llclearcallstacks;
@@ -1236,7 +1478,10 @@ bool LLAppViewer::mainLoop()
 		
 		try
 		{
-			pingMainloopTimeout("Main:MiscNativeWindowEvents");
+			// Texture work already started this frame in pipelined mode.
+			S32 early_work_pending = -1;
+
+			pingMainloopTimeout(STAGE_MISC_NATIVE_WINDOW_EVENTS);
 
 			if (gViewerWindow)
 			{
@@ -1244,7 +1489,7 @@ bool LLAppViewer::mainLoop()
 				gViewerWindow->getWindow()->processMiscNativeEvents();
 			}
 		
-			pingMainloopTimeout("Main:GatherInput");
+			pingMainloopTimeout(STAGE_GATHER_INPUT);
 			
 			if (gViewerWindow)
 			{
@@ -1273,12 +1518,14 @@ bool LLAppViewer::mainLoop()
 				mem_leak_instance->idle() ;				
 			}							
 
-            // canonical per-frame event
+            // canonical per-frame event: the typed listeners, then the LLSD
+            // pump for everything that has not moved over
+            LLFrameTick::getInstance()->tick();
             mainloop.post(newFrame);
 
 			if (!LLApp::isExiting())
 			{
-				pingMainloopTimeout("Main:JoystickKeyboard");
+				pingMainloopTimeout(STAGE_JOYSTICK_KEYBOARD);
 				
 				// Scan keyboard for movement keys.  Command keys and typing
 				// are handled by windows callbacks.  Don't do this until we're
@@ -1291,9 +1538,14 @@ bool LLAppViewer::mainLoop()
 					&& !gFocusMgr.focusLocked())
 				{
 					LLMemType mjk(LLMemType::MTYPE_JOY_KEY);
-					joystick->scanJoystick();
-					nui->scanNui();
+					if (!sBenchmark)
+					{
+						joystick->scanJoystick();
+						nui->scanNui();
+					}
 					gKeyboard->scanKeyboard();
+					// Move the agent once from everything the devices reported.
+					LLInputQueue::getInstance()->apply();
 				}
 
 //MK
@@ -1366,7 +1618,7 @@ bool LLAppViewer::mainLoop()
 					if (gAres != NULL && gAres->isInitialized())
 					{
 						LLMemType mt_ip(LLMemType::MTYPE_IDLE_PUMP);
-						pingMainloopTimeout("Main:ServicePump");				
+						pingMainloopTimeout(STAGE_SERVICE_PUMP);				
 						LLFastTimer t4(FTM_PUMP);
 						{
 							LLFastTimer t(FTM_PUMP_ARES);
@@ -1386,6 +1638,14 @@ bool LLAppViewer::mainLoop()
 					
 					resumeMainloopTimeout();
 				}
+
+				// In pipelined mode get the next frame's background work
+				// going now, so the workers have it while display() runs.
+				static LLCachedControl<bool> pipelining(gSavedSettings, "FramePipelining");
+				if (pipelining)
+				{
+					early_work_pending = wake_texture_workers();
+				}
  
 				if (gDoDisconnect && (LLStartUp::getStartupState() == STATE_STARTED))
 				{
@@ -1399,17 +1659,17 @@ bool LLAppViewer::mainLoop()
 				// *TODO: Should we run display() even during gHeadlessClient?  DK 2011-02-18
 				if (!LLApp::isExiting() && !gHeadlessClient)
 				{
-					pingMainloopTimeout("Main:Display");
+					pingMainloopTimeout(STAGE_DISPLAY);
 					gGLActive = TRUE;
 					display();
-					pingMainloopTimeout("Main:Snapshot");
+					pingMainloopTimeout(STAGE_SNAPSHOT);
 					LLFloaterSnapshot::update(); // take snapshots
 					gGLActive = FALSE;
 				}
 
 			}
 
-			pingMainloopTimeout("Main:Sleep");
+			pingMainloopTimeout(STAGE_SLEEP);
 			
 			pauseMainloopTimeout();
 
@@ -1418,29 +1678,6 @@ bool LLAppViewer::mainLoop()
 				LLMemType mt_sleep(LLMemType::MTYPE_SLEEP);
 				LLFastTimer t2(FTM_SLEEP);
 				
-				// yield some time to the os based on command line option
-				if(mYieldTime >= 0)
-				{
-					ms_sleep(mYieldTime);
-				}
-
-				// yield cooperatively when not running as foreground window
-				if (   (gViewerWindow && !gViewerWindow->getWindow()->getVisible())
-						|| !gFocusMgr.getAppHasFocus())
-				{
-					// Sleep if we're not rendering, or the window is minimized.
-					S32 milliseconds_to_sleep = llclamp(gSavedSettings.getS32("BackgroundYieldTime"), 0, 1000);
-					// don't sleep when BackgroundYieldTime set to 0, since this will still yield to other threads
-					// of equal priority on Windows
-					if (milliseconds_to_sleep > 0)
-					{
-						ms_sleep(milliseconds_to_sleep);
-						// also pause worker threads during this wait period
-						LLAppViewer::getTextureCache()->pause();
-						LLAppViewer::getImageDecodeThread()->pause();
-					}
-				}
-				
 				if (mRandomizeFramerate)
 				{
 					ms_sleep(rand() % 200);
@@ -1453,51 +1690,41 @@ bool LLAppViewer::mainLoop()
 					ms_sleep(500);
 				}
 
-				const F64 max_idle_time = llmin(.005*10.0*gFrameTimeSeconds, 0.005); // 5 ms a second
+				LLFrameBudget* frame_budget = LLFrameBudget::getInstance();
+				const F64 max_idle_time = llmin(.005*10.0*gFrameTimeSeconds, (F64)frame_budget->getBudget(FRAME_BUDGET_BACKGROUND)); // ramps up at 5 ms a second
 				idleTimer.reset();
 				S32 total_work_pending = 0;
 				S32 total_io_pending = 0;	
-				while(1)
 				{
-					S32 work_pending = 0;
-					S32 io_pending = 0;
-					F32 max_time = llmin(gFrameIntervalSeconds*10.f, 1.f);
-
-					{
-						LLFastTimer ftm(FTM_TEXTURE_CACHE);
- 						work_pending += LLAppViewer::getTextureCache()->update(max_time); // unpauses the texture cache thread
-					}
-					{
-						LLFastTimer ftm(FTM_DECODE);
-	 					work_pending += LLAppViewer::getImageDecodeThread()->update(max_time); // unpauses the image thread
-					}
-					{
-						LLFastTimer ftm(FTM_DECODE);
-	 					work_pending += LLAppViewer::getTextureFetch()->update(max_time); // unpauses the texture fetch thread
-					}
-
+					// One pass: the threaded queues only need waking and image
+					// decode runs on the job system, so there is nothing to gain
+					// from calling them again until they are done. What finishes
+					// in the background comes back through the completion queue.
+					// In pipelined mode this was done before display().
+					total_work_pending = (early_work_pending >= 0) ? early_work_pending : wake_texture_workers();
+				}
+				{
+					LLFastTimer ftm(FTM_COMPLETIONS);
+					LLCompletionQueue::getInstance()->drain(max_idle_time);
+				}
+				{
+					// VFS and LFS are not threaded: their I/O happens in these
+					// calls, which get what is left of the idle budget (at least
+					// a millisecond each, as before) rather than the loop going
+					// round until they are idle.
 					{
 						LLFastTimer ftm(FTM_VFS);
-	 					io_pending += LLVFSThread::updateClass(1);
+						F32 io_time = llmax((F32)((max_idle_time - idleTimer.getElapsedTimeF64()) * 1000.0), 1.f);
+	 					total_io_pending += LLVFSThread::updateClass(io_time);
 					}
 					{
 						LLFastTimer ftm(FTM_LFS);
-	 					io_pending += LLLFSThread::updateClass(1);
-					}
-
-					if (io_pending > 1000)
-					{
-						ms_sleep(llmin(io_pending/100,100)); // give the vfs some time to catch up
-					}
-
-					total_work_pending += work_pending ;
-					total_io_pending += io_pending ;
-					
-					if (!work_pending || idleTimer.getElapsedTimeF64() >= max_idle_time)
-					{
-						break;
+						F32 io_time = llmax((F32)((max_idle_time - idleTimer.getElapsedTimeF64()) * 1000.0), 1.f);
+	 					total_io_pending += LLLFSThread::updateClass(io_time);
 					}
 				}
+				frame_budget->report(FRAME_BUDGET_BACKGROUND, idleTimer.getElapsedTimeF32(),
+									 total_io_pending > 0 || LLCompletionQueue::getInstance()->getPendingCount() > 0);
 				gMeshRepo.update() ;
 				
 				if(!LLCurl::getCurlThread()->update(1))
@@ -1528,16 +1755,59 @@ bool LLAppViewer::mainLoop()
 					}
 				}
 
+				// The frame's work is done, share out the next one's time.
+				{
+					static LLCachedControl<F32> budget_fps(gSavedSettings, "FrameBudgetTargetFPS");
+					// Benchmarks let every stage use its maximum, so the work
+					// done does not depend on how fast the machine is.
+					frame_budget->endFrame((budget_fps > 0.f && !sBenchmark) ? 1.f / budget_fps : F32_MAX);
+				}
+
+				// Spend what is left of the frame's deadline, replacing the
+				// fixed YieldTime and BackgroundYieldTime sleeps.
+				{
+					static LLCachedControl<F32> foreground_fps(gSavedSettings, "FramePacerForegroundFPS");
+					static LLCachedControl<F32> background_fps(gSavedSettings, "FramePacerBackgroundFPS");
+
+					// Benchmarks run flat out.
+					LLFramePacePolicy foreground;
+					foreground.mTargetFPS = sBenchmark ? 0.f : (F32)foreground_fps;
+					foreground.mRunJobs = true;
+					foreground.mMinYieldMS = sBenchmark ? 0 : mYieldTime;
+					// Not rendering for anyone: leave the cores to the app that
+					// has focus rather than helping the workers.
+					LLFramePacePolicy background;
+					background.mTargetFPS = background_fps;
+					background.mMinYieldMS = mYieldTime;
+
+					LLFramePacer* pacer = LLFramePacer::getInstance();
+					pacer->setPolicies(foreground, background);
+					bool in_foreground = sBenchmark
+										 || ((!gViewerWindow || gViewerWindow->getWindow()->getVisible())
+											 && gFocusMgr.getAppHasFocus());
+					if (!in_foreground)
+					{
+						// also pause worker threads during the wait period
+						// that follows; the next frame wakes them again
+						LLAppViewer::getTextureCache()->pause();
+						LLAppViewer::getImageDecodeThread()->pause();
+					}
+					pacer->endFrame(in_foreground);
+					gFrameDeadlineMisses = pacer->getMissedDeadlines();
+				}
+				frame_budget->startFrame();
+
 				if ((LLStartUp::getStartupState() >= STATE_CLEANUP) &&
 					(frameTimer.getElapsedTimeF64() > FRAME_STALL_THRESHOLD))
 				{
 					gFrameStalls++;
+					stall_capture.markStall();
 				}
 				frameTimer.reset();
 
 				resumeMainloopTimeout();
 	
-				pingMainloopTimeout("Main:End");
+				pingMainloopTimeout(STAGE_END);
 			}	
 		}
 		catch(std::bad_alloc)
@@ -1585,6 +1855,10 @@ bool LLAppViewer::mainLoop()
 	
 	delete gServicePump;
 
+	// Quit before its last frame, so no report.
+	delete sBenchmark;
+	sBenchmark = NULL;
+
 	destroyMainloopTimeout();
 
 	llinfos << "Exiting main_loop" << llendflush;
@@ -1973,6 +2247,15 @@ bool LLAppViewer::cleanup()
 	// shotdown all worker threads before deleting them in case of co-dependencies
 	sTextureFetch->shutdown();
 	sTextureCache->shutdown();	
+	if (sImageDecodePump)
+	{
+		sImageDecodePump->flush();
+		delete sImageDecodePump;
+		sImageDecodePump = NULL;
+	}
+	LLObjectUpdateDecoder::cleanupClass();
+	LLJobSystem::cleanupClass();
+	LLCompletionQueue::cleanupClass();
 	sImageDecodeThread->shutdown();
 	
 	sTextureFetch->shutDownTextureCacheThread() ;
@@ -1988,6 +2271,8 @@ bool LLAppViewer::cleanup()
     sImageDecodeThread = NULL;
 	delete mFastTimerLogThread;
 	mFastTimerLogThread = NULL;
+	delete sWorldUpdateGraph;
+	sWorldUpdateGraph = NULL;
 	
 	if (LLFastTimerView::sAnalyzePerformance)
 	{
@@ -2044,12 +2329,26 @@ bool LLAppViewer::cleanup()
 	gSavedSettings.cleanup();
 	LLUIColorTable::instance().clear();
 
+	if (sMainloopHeartbeatMonitor)
+	{
+		sMainloopHeartbeatMonitor->logHistograms();
+		delete sMainloopHeartbeatMonitor;
+		sMainloopHeartbeatMonitor = NULL;
+	}
 	LLWatchdog::getInstance()->cleanup();
+	// Nothing reads stage names any more.
+	LLHeartbeat::cleanupClass();
 
 	LLViewerAssetStatsFF::cleanup();
 	
+	stop_packet_receiver();
+	LLMessageCostModel::getInstance()->logReport();
+	LLMessageProfiler::getInstance()->writeCSV();
 	llinfos << "Shutting down message system" << llendflush;
 	end_messaging_system();
+	// After the packet ring that refers to it is gone.
+	delete sMessageTrace;
+	sMessageTrace = NULL;
 
 	// *NOTE:Mani - The following call is not thread safe. 
 	LLCurl::cleanupClass();
@@ -2120,8 +2419,22 @@ bool LLAppViewer::initThreads()
 	LLVFSThread::initClass(enable_threads && false);
 	LLLFSThread::initClass(enable_threads && false);
 
-	// Image decoding
-	LLAppViewer::sImageDecodeThread = new LLImageDecodeThread(enable_threads && true);
+	LLCompletionQueue::initClass(1024);
+
+	// Image decoding. With the job system the decoder owns no thread and
+	// its requests are worked on by as many job workers as are free.
+	S32 job_workers = gSavedSettings.getS32("JobSystemWorkers");
+	bool decode_jobs = enable_threads && job_workers != 0;
+	if (decode_jobs)
+	{
+		LLJobSystem::initClass(job_workers);
+	}
+	LLAppViewer::sImageDecodeThread = new LLImageDecodeThread(enable_threads && !decode_jobs);
+	if (decode_jobs)
+	{
+		sImageDecodePump = new LLQueuedThreadPump(sImageDecodeThread, JOB_PRIORITY_DECODE,
+												  LLJobSystem::getInstance()->getWorkerCount(), 5.f);
+	}
 	LLAppViewer::sTextureCache = new LLTextureCache(enable_threads && true);
 	LLAppViewer::sTextureFetch = new LLTextureFetch(LLAppViewer::getTextureCache(),
 													sImageDecodeThread,
@@ -3028,7 +3341,8 @@ bool LLAppViewer::initWindow()
 	LL_INFOS("AppInit") << "Initializing window..." << LL_ENDL;
 
 	// store setting in a global for easy access and modification
-	gHeadlessClient = gSavedSettings.getBOOL("HeadlessClient");
+	// Benchmark runs are always headless.
+	gHeadlessClient = gSavedSettings.getBOOL("HeadlessClient") || gSavedSettings.getU32("BenchmarkFrames") > 0;
 
 	// always start windowed
 	BOOL ignorePixelDepth = gSavedSettings.getBOOL("IgnorePixelDepth");
@@ -3067,6 +3381,12 @@ bool LLAppViewer::initWindow()
 	{
 		LLWatchdog::getInstance()->init(watchdog_killer_callback);
 	}
+	U32 heartbeat_period = gSavedSettings.getU32("MainloopHeartbeatPeriod");
+	if (heartbeat_period)
+	{
+		sMainloopHeartbeatMonitor = new LLHeartbeatMonitor(sMainloopHeartbeat, heartbeat_period);
+		sMainloopHeartbeatMonitor->start();
+	}
 	LL_INFOS("AppInit") << "watchdog setting is done." << LL_ENDL;
 
 	LLNotificationsUI::LLNotificationManager::getInstance();
@@ -3356,7 +3676,7 @@ void LLAppViewer::handleViewerCrash()
 
 	if(LLAppViewer::instance()->mMainloopTimeout)
 	{
-		gDebugInfo["MainloopTimeoutState"] = LLAppViewer::instance()->mMainloopTimeout->getState();
+		gDebugInfo["MainloopTimeoutState"] = LLAppViewer::instance()->getMainloopTimeoutState();
 	}
 	
 	// The crash is being handled here so set this value to false.
@@ -3567,6 +3887,7 @@ void LLAppViewer::fastQuit(S32 error_code)
 	// let sim know we're logging out
 	sendLogoutRequest();
 	// flush network buffers by shutting down messaging system
+	stop_packet_receiver();
 	end_messaging_system();
 	// figure out the error code
 	S32 final_error_code = error_code ? error_code : (S32)isError();
@@ -4235,6 +4556,165 @@ static LLFastTimer::DeclareTimer FTM_WORLD_UPDATE("Update World");
 static LLFastTimer::DeclareTimer FTM_NETWORK("Network");
 static LLFastTimer::DeclareTimer FTM_AGENT_NETWORK("Agent Network");
 static LLFastTimer::DeclareTimer FTM_VLMANAGER("VL Manager");
+static LLFastTimer::DeclareTimer FTM_SKY_UPDATE("Update Sky");
+static LLFastTimer::DeclareTimer FTM_WIND_UPDATE("Update Wind");
+static LLFastTimer::DeclareTimer FTM_MOVE_UPDATE("Update Move");
+static LLFastTimer::DeclareTimer FTM_PARTICLE_UPDATE("Update Particles");
+static LLFastTimer::DeclareTimer FTM_CAMERA_UPDATE("Update Camera");
+static LLFastTimer::DeclareTimer FTM_MEDIA_FOCUS_UPDATE("Update Media Focus");
+
+// What the world update stages touch. A stage depends on an earlier one
+// if either writes something the other uses.
+enum
+{
+	WORLD_RES_AGENT		= 1 << 0,
+	WORLD_RES_CAMERA	= 1 << 1,
+	WORLD_RES_REGIONS	= 1 << 2,
+	WORLD_RES_SKY		= 1 << 3,
+	WORLD_RES_WIND		= 1 << 4,
+	WORLD_RES_OBJECTS	= 1 << 5,
+	WORLD_RES_PIPELINE	= 1 << 6,
+	WORLD_RES_PARTICLES	= 1 << 7,
+	WORLD_RES_UI		= 1 << 8,
+	WORLD_RES_AUDIO		= 1 << 9
+};
+
+static LLFrameTaskGraph* sWorldUpdateGraph = NULL;
+
+// Update surfaces, and surface textures as well.
+static void world_update_regions()
+{
+	LLWorld::getInstance()->updateVisibilities();
+	LLFrameBudget* budget = LLFrameBudget::getInstance();
+	const F32 max_region_update_time = budget->getBudget(FRAME_BUDGET_REGIONS);
+	LLTimer update_timer;
+	LLWorld::getInstance()->updateRegions(max_region_update_time);
+	F32 update_time = update_timer.getElapsedTimeF32();
+	budget->report(FRAME_BUDGET_REGIONS, update_time, update_time >= max_region_update_time);
+}
+
+// Moves sun, moon, and planets. Main thread: gSky updates LLVOSky, a
+// viewer object.
+static void world_update_sky()
+{
+	gSky.propagateHeavenlyBodies(gFrameDTClamped);
+}
+
+// Update wind vector 
+static void world_update_wind()
+{
+	LLVector3 wind_position_region;
+	static LLVector3 average_wind;
+
+	LLViewerRegion *regionp;
+	regionp = LLWorld::getInstance()->resolveRegionGlobal(wind_position_region, gAgent.getPositionGlobal());	// puts agent's local coords into wind_position	
+	if (regionp)
+	{
+		gWindVec = regionp->mWind.getVelocity(wind_position_region);
+
+		// Compute average wind and use to drive motion of water
+		
+		average_wind = regionp->mWind.getAverage();
+		gSky.setWind(average_wind);
+		//LLVOWater::setWind(average_wind);
+	}
+	else
+	{
+		gWindVec.setVec(0.0f, 0.0f, 0.0f);
+	}
+}
+
+// Sort and cull in the new renderer are moved to pipeline.cpp
+// Here, particles are updated and drawables are moved.
+static void world_update_move()
+{
+	gPipeline.updateMove();
+}
+
+static void world_update_particles()
+{
+	LLWorld::getInstance()->updateParticles();
+}
+
+static void world_update_camera()
+{
+	if (gAgentPilot.isPlaying() && gAgentPilot.getOverrideCamera())
+	{
+		gAgentPilot.moveCamera();
+	}
+	else if (LLViewerJoystick::getInstance()->getOverrideCamera())
+	{ 
+		LLViewerJoystick::getInstance()->moveFlycam();
+	}
+	else
+	{
+		if (LLToolMgr::getInstance()->inBuildMode())
+		{
+			LLViewerJoystick::getInstance()->moveObjects();
+		}
+
+		gAgentCamera.updateCamera();
+	}
+}
+
+static void world_update_media_focus()
+{
+	// update media focus
+	LLViewerMediaFocus::getInstance()->update();
+	
+	// Update marketplace
+	LLMarketplaceInventoryImporter::update();
+	LLMarketplaceInventoryNotifications::update();
+}
+
+// objects and camera should be in sync, do LOD calculations now
+static void world_update_lod()
+{
+	gObjectList.updateApparentAngles(gAgent);
+}
+
+static void world_update_audio()
+{
+	if (gAudiop)
+	{
+	    audio_update_volume(false);
+		audio_update_listener();
+		audio_update_wind(false);
+
+		// this line actually commits the changes we've made to source positions, etc.
+		LLFrameBudget* budget = LLFrameBudget::getInstance();
+		const F32 max_audio_decode_time = budget->getBudget(FRAME_BUDGET_AUDIO);
+		LLTimer decode_timer;
+		gAudiop->idle(max_audio_decode_time);
+		F32 decode_time = decode_timer.getElapsedTimeF32();
+		budget->report(FRAME_BUDGET_AUDIO, decode_time, decode_time >= max_audio_decode_time);
+	}
+}
+
+// Stages in the order idle() used to run them, which is still the order
+// they run in: everything here is main thread only. The declared resources
+// only give the critical path, see LLFrameTaskGraph.
+static void build_world_update_graph(LLFrameTaskGraph& graph)
+{
+	graph.addTask(FTM_REGION_UPDATE, boost::bind(&world_update_regions),
+				  WORLD_RES_CAMERA, WORLD_RES_REGIONS);
+	graph.addTask(FTM_SKY_UPDATE, boost::bind(&world_update_sky),
+				  0, WORLD_RES_SKY);
+	graph.addTask(FTM_WIND_UPDATE, boost::bind(&world_update_wind),
+				  WORLD_RES_REGIONS | WORLD_RES_AGENT, WORLD_RES_SKY | WORLD_RES_WIND);
+	graph.addTask(FTM_MOVE_UPDATE, boost::bind(&world_update_move),
+				  WORLD_RES_SKY | WORLD_RES_CAMERA, WORLD_RES_OBJECTS | WORLD_RES_PIPELINE);
+	graph.addTask(FTM_PARTICLE_UPDATE, boost::bind(&world_update_particles),
+				  WORLD_RES_REGIONS | WORLD_RES_CAMERA | WORLD_RES_WIND, WORLD_RES_PARTICLES | WORLD_RES_PIPELINE);
+	graph.addTask(FTM_CAMERA_UPDATE, boost::bind(&world_update_camera),
+				  0, WORLD_RES_CAMERA | WORLD_RES_AGENT | WORLD_RES_OBJECTS);
+	graph.addTask(FTM_MEDIA_FOCUS_UPDATE, boost::bind(&world_update_media_focus),
+				  WORLD_RES_CAMERA | WORLD_RES_OBJECTS, WORLD_RES_UI);
+	graph.addTask(FTM_LOD_UPDATE, boost::bind(&world_update_lod),
+				  WORLD_RES_CAMERA | WORLD_RES_AGENT, WORLD_RES_OBJECTS | WORLD_RES_PIPELINE);
+	graph.addTask(FTM_AUDIO_UPDATE, boost::bind(&world_update_audio),
+				  WORLD_RES_CAMERA | WORLD_RES_AGENT | WORLD_RES_WIND, WORLD_RES_AUDIO);
+}
 
 ///////////////////////////////////////////////////////
 // idle()
@@ -4245,7 +4725,7 @@ static LLFastTimer::DeclareTimer FTM_VLMANAGER("VL Manager");
 void LLAppViewer::idle()
 {
 	LLMemType mt_idle(LLMemType::MTYPE_IDLE);
-	pingMainloopTimeout("Main:Idle");
+	pingMainloopTimeout(STAGE_IDLE);
 	
 	// Update frame timers
 	static LLTimer idle_timer;
@@ -4259,6 +4739,14 @@ void LLAppViewer::idle()
 	LLFilePickerThread::clearDead();  //calls LLFilePickerThread::notify()
 
 	F32 dt_raw = idle_timer.getElapsedTimeAndResetF32();
+	if (sBenchmark)
+	{
+		// Simulated clock, so each run does the same work. LLFrameTimer
+		// still follows the wall clock.
+		dt_raw = sBenchmark->getFrameSeconds();
+		gFrameIntervalSeconds = dt_raw;
+		gFrameTimeSeconds = sBenchmark->getElapsedSeconds();
+	}
 
 	// Cap out-of-control frame times
 	// Too low because in menus, swapping, debugger, etc.
@@ -4288,6 +4776,8 @@ void LLAppViewer::idle()
 	// here.
 	request_initial_instant_messages();
 
+	update_message_trace();
+
 	///////////////////////////////////
 	//
 	// Special case idle if still starting up
@@ -4334,20 +4824,39 @@ void LLAppViewer::idle()
     
 	    static LLFrameTimer agent_update_timer;
 	    static U32 				last_control_flags;
+		static LLAgentUpdateEncoder agent_update_encoder;
+		static LLCachedControl<bool> agent_update_suppression(gSavedSettings, "AgentUpdateSuppression");
     
-	    //	When appropriate, update agent location to the simulator.
-	    F32 agent_update_time = agent_update_timer.getElapsedTimeF32();
-	    BOOL flags_changed = gAgent.controlFlagsDirty() || (last_control_flags != gAgent.getControlFlags());
+		if (agent_update_suppression)
+		{
+			// Only when the simulator would see a difference.
+			LLAgentUpdateState state;
+			fill_agent_update_state(state);
+			F64 now = LLFrameTimer::getElapsedSeconds();
+			if (agent_update_encoder.shouldSend(state, gAgent.controlFlagsDirty(), now))
+			{
+				LLFastTimer t(FTM_AGENT_UPDATE);
+				if(!gAgent.getPhantom())
+					send_agent_update(TRUE);
+				agent_update_encoder.sent(state, now);
+			}
+		}
+		else
+		{
+		    //	When appropriate, update agent location to the simulator.
+		    F32 agent_update_time = agent_update_timer.getElapsedTimeF32();
+		    BOOL flags_changed = gAgent.controlFlagsDirty() || (last_control_flags != gAgent.getControlFlags());
 		    
-	    if (flags_changed || (agent_update_time > (1.0f / (F32) AGENT_UPDATES_PER_SECOND)))
-	    {
-		    LLFastTimer t(FTM_AGENT_UPDATE);
-		    // Send avatar and camera info
-		    last_control_flags = gAgent.getControlFlags();
-			if(!gAgent.getPhantom())
-				send_agent_update(TRUE);
-		    agent_update_timer.reset();
-	    }
+		    if (flags_changed || (agent_update_time > (1.0f / (F32) AGENT_UPDATES_PER_SECOND)))
+		    {
+			    LLFastTimer t(FTM_AGENT_UPDATE);
+			    // Send avatar and camera info
+			    last_control_flags = gAgent.getControlFlags();
+				if(!gAgent.getPhantom())
+					send_agent_update(TRUE);
+			    agent_update_timer.reset();
+		    }
+		}
 	}
 
 	//////////////////////////////////////
@@ -4540,98 +5049,24 @@ void LLAppViewer::idle()
 	
 	/////////////////////////
 	//
-	// Update surfaces, and surface textures as well.
-	//
-
-	LLWorld::getInstance()->updateVisibilities();
-	{
-		const F32 max_region_update_time = .001f; // 1ms
-		LLFastTimer t(FTM_REGION_UPDATE);
-		LLWorld::getInstance()->updateRegions(max_region_update_time);
-	}
-	
-	/////////////////////////
-	//
-	// Update weather effects
+	// Update surfaces, weather, particles, camera, LOD and audio, in order,
+	// see build_world_update_graph().
 	//
-	gSky.propagateHeavenlyBodies(gFrameDTClamped);				// moves sun, moon, and planets
-
-	// Update wind vector 
-	LLVector3 wind_position_region;
-	static LLVector3 average_wind;
 
-	LLViewerRegion *regionp;
-	regionp = LLWorld::getInstance()->resolveRegionGlobal(wind_position_region, gAgent.getPositionGlobal());	// puts agent's local coords into wind_position	
-	if (regionp)
-	{
-		gWindVec = regionp->mWind.getVelocity(wind_position_region);
-
-		// Compute average wind and use to drive motion of water
-		
-		average_wind = regionp->mWind.getAverage();
-		gSky.setWind(average_wind);
-		//LLVOWater::setWind(average_wind);
-	}
-	else
-	{
-		gWindVec.setVec(0.0f, 0.0f, 0.0f);
-	}
-	
-	//////////////////////////////////////
-	//
-	// Sort and cull in the new renderer are moved to pipeline.cpp
-	// Here, particles are updated and drawables are moved.
-	//
-	
-	LLFastTimer t(FTM_WORLD_UPDATE);
-	gPipeline.updateMove();
-
-	LLWorld::getInstance()->updateParticles();
-
-	if (gAgentPilot.isPlaying() && gAgentPilot.getOverrideCamera())
 	{
-		gAgentPilot.moveCamera();
-	}
-	else if (LLViewerJoystick::getInstance()->getOverrideCamera())
-	{ 
-		LLViewerJoystick::getInstance()->moveFlycam();
-	}
-	else
-	{
-		if (LLToolMgr::getInstance()->inBuildMode())
+		LLFastTimer t(FTM_WORLD_UPDATE);
+		if (!sWorldUpdateGraph)
 		{
-			LLViewerJoystick::getInstance()->moveObjects();
+			sWorldUpdateGraph = new LLFrameTaskGraph("World Update");
+			build_world_update_graph(*sWorldUpdateGraph);
 		}
+		sWorldUpdateGraph->run();
 
-		gAgentCamera.updateCamera();
-	}
-
-	// update media focus
-	LLViewerMediaFocus::getInstance()->update();
-	
-	// Update marketplace
-	LLMarketplaceInventoryImporter::update();
-	LLMarketplaceInventoryNotifications::update();
-
-	// objects and camera should be in sync, do LOD calculations now
-	{
-		LLFastTimer t(FTM_LOD_UPDATE);
-		gObjectList.updateApparentAngles(gAgent);
-	}
-
-	{
-		LLFastTimer t(FTM_AUDIO_UPDATE);
-		
-		if (gAudiop)
-		{
-		    audio_update_volume(false);
-			audio_update_listener();
-			audio_update_wind(false);
-
-			// this line actually commits the changes we've made to source positions, etc.
-			const F32 max_audio_decode_time = 0.002f; // 2 ms decode time
-			gAudiop->idle(max_audio_decode_time);
-		}
+		// The stages' own times are in their fast timers under this one.
+		// The critical path is a lower bound, not a time the frame took.
+		LLViewerStats* stats = LLViewerStats::getInstance();
+		stats->mWorldUpdateStat.addValue((F32)sWorldUpdateGraph->getLastRunSeconds() * 1000.f);
+		stats->mWorldCriticalPathStat.addValue((F32)sWorldUpdateGraph->getCriticalPathSeconds() * 1000.f);
 	}
 
 	// Execute deferred tasks.
@@ -4828,11 +5263,6 @@ void LLAppViewer::idleNameCache()
 
 #define TIME_THROTTLE_MESSAGES
 
-#ifdef TIME_THROTTLE_MESSAGES
-#define CHECK_MESSAGES_DEFAULT_MAX_TIME .020f // 50 ms = 50 fps (just for messages!)
-static F32 CheckMessagesMaxTime = CHECK_MESSAGES_DEFAULT_MAX_TIME;
-#endif
-
 static LLFastTimer::DeclareTimer FTM_IDLE_NETWORK("Idle Network");
 static LLFastTimer::DeclareTimer FTM_MESSAGE_ACKS("Message Acks");
 static LLFastTimer::DeclareTimer FTM_RETRANSMIT("Retransmit");
@@ -4843,7 +5273,7 @@ static LLFastTimer::DeclareTimer FTM_CHECK_REGION_CIRCUIT("Check Region Circuit"
 void LLAppViewer::idleNetwork()
 {
 	LLMemType mt_in(LLMemType::MTYPE_IDLE_NETWORK);
-	pingMainloopTimeout("idleNetwork");
+	pingMainloopTimeout(STAGE_IDLE_NETWORK);
 	
 	gObjectList.mNumNewObjects = 0;
 	S32 total_decoded = 0;
@@ -4856,10 +5286,105 @@ void LLAppViewer::idleNetwork()
 		LLTimer check_message_timer;
 		//  Read all available packets from network 
 		const S64 frame_count = gFrameCount;  // U32->S64
+		static bool packet_hooks_set = false;
+		if (!packet_hooks_set)
+		{
+			// The message system is up by now.
+			// A replayed trace is the packet source, see update_message_trace().
+			LLPacketRing& packet_ring = gMessageSystem->mPacketRing;
+			bool replaying = sMessageTrace && !sMessageTrace->isRecording();
+			if (!replaying && gSavedSettings.getBOOL("NetworkReceiveThread") && !LLProxy::isSOCKSProxyEnabled())
+			{
+				// Not with a SOCKS proxy: its UDP header is taken off in the
+				// packet ring, which the thread bypasses.
+				sPacketReceiver = new LLPacketReceiver(gMessageSystem->getSocket(), gSavedSettings.getS32("NetworkReceiveBatchSize"));
+				for (message_template_number_map_t::const_iterator it = gMessageSystem->mMessageNumbers.begin();
+					 it != gMessageSystem->mMessageNumbers.end(); ++it)
+				{
+					sPacketReceiver->setLane(it->first, LLPacketReceiver::getLaneForMessage(it->second->mName));
+				}
+				sPacketReceiver->start();
+				message_template_name_map_t::const_iterator object_update = gMessageSystem->mMessageTemplates.find(_PREHASH_ObjectUpdateCompressed);
+				if (gSavedSettings.getBOOL("ObjectUpdateParallelDecode") && object_update != gMessageSystem->mMessageTemplates.end())
+				{
+					// Needs the receive thread, to know when the next packet
+					// is not an object update.
+					LLObjectUpdateDecoder::initClass(object_update->second,
+													 boost::bind(&LLViewerObjectList::processCompressedUpdateBatch, &gObjectList, _1),
+													 &sPacketReceiver->getCurrentPacket());
+					gMessageSystem->setRawHandlerFuncFast(_PREHASH_ObjectUpdateCompressed, LLObjectUpdateDecoder::processRawMessage);
+					packet_ring.setPacketViewSource(next_packet_after_object_updates);
+				}
+				else
+				{
+					// The message system reads the receive buffers in place.
+					packet_ring.setPacketViewSource(boost::bind(&LLPacketReceiver::nextPacketView, sPacketReceiver, _1, _2, _3));
+				}
+			}
+			packet_hooks_set = true;
+		}
+		if (sPacketReceiver)
+		{
+			// Object updates from the region the camera is in go first.
+			static LLHost near_host;
+			LLViewerRegion* near_region = LLWorld::getInstance()->getRegionFromPosAgent(LLViewerCamera::getInstance()->getOrigin());
+			if (!near_region)
+			{
+				near_region = gAgent.getRegion();
+			}
+			if (near_region && near_region->getHost() != near_host)
+			{
+				near_host = near_region->getHost();
+				sPacketReceiver->setNearHost(near_host);
+			}
+		}
 		F32 total_time = 0.0f;
+		LLMessageProfiler* profiler = LLMessageProfiler::getInstance();
+		LLObjectUpdateDecoder* object_decoder = LLObjectUpdateDecoder::getInstance();
+#ifdef TIME_THROTTLE_MESSAGES
+		const F32 max_message_time = LLFrameBudget::getInstance()->getBudget(FRAME_BUDGET_MESSAGES);
+		LLMessageCostModel* cost_model = LLMessageCostModel::getInstance();
+		bool messages_deferred = false;
+#endif
 
-		while (gMessageSystem->checkAllMessages(frame_count, gServicePump)) 
+		while (true)
 		{
+#ifdef TIME_THROTTLE_MESSAGES
+			// Admit the next message only if what it usually costs still fits,
+			// rather than finding out after it has overrun. The first one is
+			// always admitted, and so are acks, pings and critical messages.
+			U32 message_number = sPacketReceiver ? sPacketReceiver->peekMessageNumber() : 0;
+			const char* message_name = cost_model->getName(message_number);
+			bool message_waiting = !sPacketReceiver || sPacketReceiver->getQueuedCount() > 0;
+			bool message_critical = sPacketReceiver && sPacketReceiver->peekLane() <= LLPacketReceiver::LANE_CRITICAL;
+			if (message_waiting && !message_critical && total_decoded > 0
+				&& total_time + cost_model->predict(message_name) > max_message_time)
+			{
+				cost_model->deferred(message_name);
+				messages_deferred = true;
+				break;
+			}
+#endif
+			U64 message_start = totalTime();
+			if (!gMessageSystem->checkAllMessages(frame_count, gServicePump))
+			{
+				break;
+			}
+			U64 message_time = totalTime() - message_start;
+			if (object_decoder)
+			{
+				// Applying queued object updates is down to them, not to the
+				// message that was read after them.
+				U64 apply_time = llmin(object_decoder->takeFlushTime(), message_time);
+				message_time -= apply_time;
+				profiler->addTime(_PREHASH_ObjectUpdateCompressed, apply_time);
+			}
+			profiler->record(gMessageSystem->getMessageName(), gMessageSystem->getReceiveSize(), message_time);
+#ifdef TIME_THROTTLE_MESSAGES
+			cost_model->admitted(message_number, gMessageSystem->getMessageName(), (F32)message_time / (F32)SEC_TO_MICROSEC);
+			total_time = check_message_timer.getElapsedTimeF32();
+#endif
+
 			if (gDoDisconnect)
 			{
 				// We're disconnecting, don't process any more messages from the server
@@ -4875,32 +5400,50 @@ void LLAppViewer::idleNetwork()
 			{
 				break;
 			}
+		}
 
-#ifdef TIME_THROTTLE_MESSAGES
-			// Prevent slow packets from completely destroying the frame rate.
-			// This usually happens due to clumps of avatars taking huge amount
-			// of network processing time (which needs to be fixed, but this is
-			// a good limit anyway).
-			total_time = check_message_timer.getElapsedTimeF32();
-			if (total_time >= CheckMessagesMaxTime)
-				break;
-#endif
+		if (object_decoder)
+		{
+			object_decoder->flush();
+			profiler->addTime(_PREHASH_ObjectUpdateCompressed, object_decoder->takeFlushTime());
 		}
 
 		// Handle per-frame message system processing.
 		gMessageSystem->processAcks();
+		if (sPacketReceiver)
+		{
+			// The receive thread expanded these, so the message system did
+			// not count them.
+			U32 packets, coded_bytes, expanded_bytes;
+			sPacketReceiver->takeExpandedCounts(packets, coded_bytes, expanded_bytes);
+			gMessageSystem->addExpandedPackets(packets, coded_bytes, expanded_bytes);
+		}
 
 #ifdef TIME_THROTTLE_MESSAGES
-		if (total_time >= CheckMessagesMaxTime)
+		// Running out of time gets messages a bigger share of the next
+		// frames, so that we will eventually catch up
+		LLFrameBudget* frame_budget = LLFrameBudget::getInstance();
+		frame_budget->report(FRAME_BUDGET_MESSAGES, total_time, messages_deferred);
+
+		// And if it keeps running out, ask the simulator for less: what
+		// cannot be decoded in time only arrives late.
+		static LLCachedControl<bool> decode_throttle(gSavedSettings, "DecodeThrottle");
+		LLDecodeThrottle* throttle = LLDecodeThrottle::getInstance();
+		if (decode_throttle)
 		{
-			// Increase CheckMessagesMaxTime so that we will eventually catch up
-			CheckMessagesMaxTime *= 1.035f; // 3.5% ~= x2 in 20 frames, ~8x in 60 frames
+			throttle->update(total_time, frame_budget->getCapacity(FRAME_BUDGET_MESSAGES),
+							 sPacketReceiver ? sPacketReceiver->getQueuedCount() : 0, gFrameIntervalSeconds);
 		}
 		else
 		{
-			// Reset CheckMessagesMaxTime to default value
-			CheckMessagesMaxTime = CHECK_MESSAGES_DEFAULT_MAX_TIME;
+			throttle->reset();
 		}
+		if (throttle->takeChanged())
+		{
+			gViewerThrottle.setDecodeScale(throttle->getScale());
+		}
+		LLViewerStats::getInstance()->mDecodeThrottleScaleStat.addValue(throttle->getScale());
+		LLViewerStats::getInstance()->mDecodePressureStat.addValue(throttle->getPressure());
 #endif
 		
 
@@ -4924,9 +5467,10 @@ void LLAppViewer::idleNetwork()
 	}
 	LLViewerStats::getInstance()->mNumNewObjectsStat.addValue(gObjectList.mNumNewObjects);
 
-	// Retransmit unacknowledged packets.
-	gXferManager->retransmitUnackedPackets();
-	gAssetStorage->checkForTimeouts();
+	// Retransmit unacknowledged packets and time out xfer and asset
+	// requests, each on its own timer.
+	LLTimerWheel::getInstance()->advance();
+	gXferManager->processQueues();
 	gViewerThrottle.updateDynamicThrottle();
 
 	// Check that the circuit between the viewer and the agent's current
@@ -4941,6 +5485,10 @@ void LLAppViewer::idleNetwork()
 		{
 			forceDisconnect(LLTrans::getString("AgentLostConnection"));
 		}
+		if (mAgentRegionLastID != this_region_id)
+		{
+			LLMessageProfiler::getInstance()->setRegion(agent_region->getName());
+		}
 		mAgentRegionLastID = this_region_id;
 		mAgentRegionLastAlive = this_region_alive;
 	}
@@ -5082,6 +5630,10 @@ void LLAppViewer::resumeMainloopTimeout(const std::string& state, F32 secs)
 		
 		mMainloopTimeout->setTimeout(secs);
 		mMainloopTimeout->start(state);
+		if (!state.empty())
+		{
+			sMainloopHeartbeat.ping(LLHeartbeat::registerStage(state));
+		}
 	}
 }
 
@@ -5090,26 +5642,46 @@ void LLAppViewer::pauseMainloopTimeout()
 	if(mMainloopTimeout)
 	{
 		mMainloopTimeout->stop();
+		// Time spent paused is not any stage's.
+		sMainloopHeartbeat.ping(LLHeartbeat::NO_STAGE);
 	}
 }
 
 void LLAppViewer::pingMainloopTimeout(const std::string& state, F32 secs)
+{
+	pingMainloopTimeout(LLHeartbeat::registerStage(state), secs);
+}
+
+void LLAppViewer::pingMainloopTimeout(U32 stage, F32 secs)
 {
 //	if(!restoreErrorTrap())
 //	{
 //		llwarns << "!!!!!!!!!!!!! Its an error trap!!!!" << state << llendl;
 //	}
 	
+	sMainloopHeartbeat.ping(stage);
 	if(mMainloopTimeout)
 	{
 		if(secs < 0.0f)
 		{
-			secs = gSavedSettings.getF32("MainloopTimeoutDefault");
+			static LLCachedControl<F32> default_timeout(gSavedSettings, "MainloopTimeoutDefault");
+			secs = default_timeout;
 		}
 
 		mMainloopTimeout->setTimeout(secs);
-		mMainloopTimeout->ping(state);
+		// No state: the heartbeat has the stage, see getMainloopTimeoutState().
+		mMainloopTimeout->ping(LLStringUtil::null);
+	}
+}
+
+std::string LLAppViewer::getMainloopTimeoutState() const
+{
+	U32 stage = sMainloopHeartbeat.getStage();
+	if (stage != LLHeartbeat::NO_STAGE)
+	{
+		return LLHeartbeat::getStageName(stage);
 	}
+	return mMainloopTimeout ? mMainloopTimeout->getState() : LLStringUtil::null;
 }
 
 void LLAppViewer::handleLoginComplete()
@@ -5148,7 +5720,7 @@ void LLAppViewer::handleLoginComplete()
 
 	if(LLAppViewer::instance()->mMainloopTimeout)
 	{
-		gDebugInfo["MainloopTimeoutState"] = LLAppViewer::instance()->mMainloopTimeout->getState();
+		gDebugInfo["MainloopTimeoutState"] = LLAppViewer::instance()->getMainloopTimeoutState();
 	}
 
 	mOnLoginCompleted();
@@ -0,0 +1,108 @@
+/**
+ * @file llcompletionqueue.cpp
+ * @brief Lock-free queue of completions posted by workers to the main thread.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llcompletionqueue.h"
+
+#include "lltimer.h"
+
+LLCompletionQueue* LLCompletionQueue::sInstance = NULL;
+
+//static
+void LLCompletionQueue::initClass(U32 capacity)
+{
+	llassert(!sInstance);
+	sInstance = new LLCompletionQueue(capacity);
+}
+
+//static
+void LLCompletionQueue::cleanupClass()
+{
+	// Whatever is still queued is dropped unrun.
+	delete sInstance;
+	sInstance = NULL;
+}
+
+LLCompletionQueue::LLCompletionQueue(U32 capacity)
+:	mCapacity(capacity),
+	mHead(0)
+{
+	llassert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+	mSlots = new Slot[mCapacity];
+	for (U32 i = 0; i < mCapacity; ++i)
+	{
+		mSlots[i].mSequence = i;
+	}
+	mTail = 0;
+}
+
+LLCompletionQueue::~LLCompletionQueue()
+{
+	delete[] mSlots;
+}
+
+void LLCompletionQueue::post(const completion_func_t& func)
+{
+	U32 index = mTail++;
+	Slot& slot = mSlots[index & (mCapacity - 1)];
+	while (slot.mSequence.CurrentValue() != index)
+	{
+		// Still holds the completion from a lap ago.
+		ms_sleep(1);
+	}
+	slot.mFunc = func;
+	// An atomic increment is a full barrier, so the function is in place
+	// before the main thread can see the slot as published.
+	slot.mSequence++;
+}
+
+S32 LLCompletionQueue::drain(F64 max_seconds)
+{
+	LLTimer timer;
+	S32 count = 0;
+	while (true)
+	{
+		Slot& slot = mSlots[mHead & (mCapacity - 1)];
+		if (slot.mSequence.CurrentValue() != mHead + 1)
+		{
+			// Empty, or the poster of the next one has not published it yet.
+			break;
+		}
+		completion_func_t func;
+		func.swap(slot.mFunc);
+		slot.mSequence += mCapacity - 1;
+		++mHead;
+
+		func();
+		++count;
+		if (max_seconds > 0.0 && timer.getElapsedTimeF64() >= max_seconds)
+		{
+			break;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file llcompletionqueue.h
+ * @brief Lock-free queue of completions posted by workers to the main thread.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLCOMPLETIONQUEUE_H
+#define LL_LLCOMPLETIONQUEUE_H
+
+#include "llatomic.h"
+
+#include <boost/function.hpp>
+
+// Background work that has finished posts a completion here, and the main
+// thread runs the completions once per loop, so it learns what is done
+// without polling every worker for it.
+//
+// Any number of threads may post. A poster reserves a slot with an atomic
+// increment and publishes it by bumping the slot's sequence number; the
+// main thread runs slots in reservation order and hands each one back for
+// the poster one lap later. Nothing locks, and a poster only waits if the
+// main thread has fallen a full queue behind.
+class LLCompletionQueue
+{
+public:
+	typedef boost::function<void()> completion_func_t;
+
+	// 'capacity' must be a power of two, at least 2.
+	static void initClass(U32 capacity);
+	static void cleanupClass();
+	static LLCompletionQueue* getInstance()	{ return sInstance; }
+
+	// Any thread. The main thread empties the queue, so it must not post
+	// more than a full queue's worth between drains itself.
+	void post(const completion_func_t& func);
+
+	// Main thread. Runs completions in the order they were posted until
+	// none are left or 'max_seconds' (0 for no limit) has been spent, and
+	// returns the number run.
+	S32 drain(F64 max_seconds);
+
+	S32 getPendingCount() const		{ return (S32)(mTail.CurrentValue() - mHead); }
+
+private:
+	LLCompletionQueue(U32 capacity);
+	~LLCompletionQueue();
+
+	struct Slot
+	{
+		// index while free for the poster of 'index', index + 1 once that
+		// poster has published it.
+		LLAtomicU32			mSequence;
+		completion_func_t	mFunc;
+	};
+
+	Slot*		mSlots;
+	U32			mCapacity;
+	LLAtomicU32	mTail;	// next slot to reserve
+	U32			mHead;	// next slot to run, main thread only
+
+	static LLCompletionQueue* sInstance;
+};
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * @file lldecodethrottle.cpp
+ * @brief Scales the object and texture bandwidth asked of the simulator to
+ * what the main thread can decode.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "lldecodethrottle.h"
+
+// Leaves some of the capacity for bursts.
+static const F32 TARGET_PRESSURE = 0.8f;
+// Queued packets that count as much as the full capacity.
+static const F32 QUEUED_PACKETS_PER_CAPACITY = 64.f;
+// Pressure past this is a burst, not a trend.
+static const F32 MAX_PRESSURE = 3.f;
+// Per second, so the filter does not depend on the frame rate.
+static const F32 PRESSURE_SMOOTHING = 4.f;
+static const F32 GAIN_P = 0.3f;
+static const F32 GAIN_I = 0.15f;		// per second
+static const F32 MIN_SCALE = 0.25f;
+static const F32 SEND_STEP = 0.05f;
+static const F32 SEND_INTERVAL = 1.f;
+
+LLDecodeThrottle::LLDecodeThrottle()
+:	mSentScale(1.f),
+	mChanged(false)
+{
+	reset();
+}
+
+void LLDecodeThrottle::reset()
+{
+	mPressure = 0.f;
+	mError = 0.f;
+	mIntegral = 1.f;
+	mScale = 1.f;
+	mChanged = (mSentScale != 1.f);
+	mSentScale = 1.f;
+}
+
+void LLDecodeThrottle::update(F32 used_seconds, F32 capacity_seconds, U32 queued_packets, F32 frame_seconds)
+{
+	if (frame_seconds <= 0.f || capacity_seconds <= 0.f)
+	{
+		return;
+	}
+
+	F32 pressure = used_seconds / capacity_seconds + (F32)queued_packets / QUEUED_PACKETS_PER_CAPACITY;
+	pressure = llmin(pressure, MAX_PRESSURE);
+	mPressure = lerp(mPressure, pressure, llmin(frame_seconds * PRESSURE_SMOOTHING, 1.f));
+	mError = TARGET_PRESSURE - mPressure;
+
+	// The integral holds the scale that matches the load; it stops at the
+	// limits so it does not wind up while pinned there.
+	mIntegral = llclamp(mIntegral + GAIN_I * mError * frame_seconds, MIN_SCALE, 1.f);
+	mScale = llclamp(mIntegral + GAIN_P * mError, MIN_SCALE, 1.f);
+
+	bool at_limit = (mScale == 1.f || mScale == MIN_SCALE) && mScale != mSentScale;
+	if ((fabsf(mScale - mSentScale) >= SEND_STEP || at_limit)
+		&& mSentTimer.getElapsedTimeF32() >= SEND_INTERVAL)
+	{
+		mSentScale = mScale;
+		mSentTimer.reset();
+		mChanged = true;
+	}
+}
+
+bool LLDecodeThrottle::takeChanged()
+{
+	bool changed = mChanged;
+	mChanged = false;
+	return changed;
+}
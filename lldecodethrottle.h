@@ -0,0 +1,81 @@
+/**
+ * @file lldecodethrottle.h
+ * @brief Scales the object and texture bandwidth asked of the simulator to
+ * what the main thread can decode.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLDECODETHROTTLE_H
+#define LL_LLDECODETHROTTLE_H
+
+#include "llsingleton.h"
+#include "lltimer.h"
+
+// LLViewerThrottle::updateDynamicThrottle() backs off on packet loss, but
+// packets the viewer receives and cannot handle in time are not lost, they
+// wait in the queue and arrive late. This closes the loop on the main
+// thread instead: a PI controller on decode pressure, the message time
+// idleNetwork() used against its capacity plus the packets it left
+// queued, smoothed over a few frames. The capacity is what LLFrameBudget
+// would give the message stage if it ran out every frame, which follows
+// the frame target, rather than its budget for the frame, which follows
+// what was used. It holds pressure at TARGET_PRESSURE by scaling the
+// object and texture throttles between MIN_SCALE and 1, coming down while
+// decoding is over capacity and going back up as slack returns.
+//
+// The scale only goes to the simulator when it has moved by SEND_STEP,
+// and at most every SEND_INTERVAL seconds, as each change is an
+// AgentThrottle message.
+//
+// Main thread only.
+class LLDecodeThrottle : public LLSingleton<LLDecodeThrottle>
+{
+public:
+	LLDecodeThrottle();
+
+	// Once a frame, after idleNetwork() has handled messages.
+	// 'capacity_seconds' is LLFrameBudget::getCapacity(FRAME_BUDGET_MESSAGES).
+	void update(F32 used_seconds, F32 capacity_seconds, U32 queued_packets, F32 frame_seconds);
+	// Back to full bandwidth, e.g. when turned off.
+	void reset();
+
+	F32 getScale() const			{ return mScale; }
+	// Whether the scale should be sent; clears it.
+	bool takeChanged();
+
+	// Control signals, for the stats.
+	F32 getPressure() const			{ return mPressure; }
+	F32 getError() const			{ return mError; }
+	F32 getIntegral() const			{ return mIntegral; }
+
+private:
+	F32		mPressure;		// smoothed
+	F32		mError;			// target less pressure, > 0 is slack
+	F32		mIntegral;
+	F32		mScale;
+	F32		mSentScale;
+	LLTimer	mSentTimer;
+	bool	mChanged;
+};
+
+#endif
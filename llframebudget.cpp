@@ -0,0 +1,156 @@
+/**
+ * @file llframebudget.cpp
+ * @brief Shares a target frame time among the time-sliced frame stages.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llframebudget.h"
+
+// A stage that did not run out asks for this much more than it used.
+static const F32 HEADROOM = 1.5f;
+// Priority doubles after this many frames of running out, and stops
+// growing at three times.
+static const S32 BACKLOG_DOUBLING_FRAMES = 20;
+static const S32 BACKLOG_MAX_FRAMES = 40;
+// A stage that ran out gets at least this much more than last frame, even
+// when the frame is over target. It is the old per frame message growth.
+static const F32 BACKLOG_GROWTH = 1.035f;
+// Smoothing of the unbudgeted frame cost, per frame.
+static const F32 OTHER_SMOOTHING = 0.25f;
+
+LLFrameBudget::LLFrameBudget()
+:	mOtherSeconds(0.f),
+	mTargetSeconds(0.f)
+{
+	// The initial budgets and minimums are the old fixed ones. The message
+	// maximum is where the old 3.5% per frame growth got to after a couple
+	// of seconds.
+	setStage(FRAME_BUDGET_MESSAGES,		.020f,	.020f,	.160f,	4.f);
+	setStage(FRAME_BUDGET_REGIONS,		.001f,	.0005f,	.004f,	2.f);
+	setStage(FRAME_BUDGET_AUDIO,		.002f,	.001f,	.004f,	1.f);
+	setStage(FRAME_BUDGET_BACKGROUND,	.005f,	.001f,	.010f,	1.f);
+}
+
+void LLFrameBudget::setStage(EFrameBudgetStage stage, F32 initial, F32 min_seconds, F32 max_seconds, F32 priority)
+{
+	Stage& s = mStages[stage];
+	s.mMin = min_seconds;
+	s.mMax = max_seconds;
+	s.mPriority = priority;
+	s.mBudget = initial;
+	s.mUsed = 0.f;
+	s.mBacklog = false;
+	s.mBacklogFrames = 0;
+}
+
+void LLFrameBudget::startFrame()
+{
+	mFrameTimer.reset();
+	for (S32 i = 0; i < FRAME_BUDGET_STAGE_COUNT; ++i)
+	{
+		mStages[i].mUsed = 0.f;
+		mStages[i].mBacklog = false;
+	}
+}
+
+void LLFrameBudget::report(EFrameBudgetStage stage, F32 used_seconds, bool backlog)
+{
+	Stage& s = mStages[stage];
+	s.mUsed += used_seconds;
+	s.mBacklog = s.mBacklog || backlog;
+}
+
+F32 LLFrameBudget::getCapacity(EFrameBudgetStage stage) const
+{
+	F32 available = mTargetSeconds - mOtherSeconds;
+	for (S32 i = 0; i < FRAME_BUDGET_STAGE_COUNT; ++i)
+	{
+		if (i != stage)
+		{
+			available -= mStages[i].mMin;
+		}
+	}
+	const Stage& s = mStages[stage];
+	return llclamp(available, s.mMin, s.mMax);
+}
+
+void LLFrameBudget::endFrame(F32 target_frame_seconds)
+{
+	mTargetSeconds = target_frame_seconds;
+	F32 frame_seconds = mFrameTimer.getElapsedTimeF32();
+	F32 used = 0.f;
+	F32 demand[FRAME_BUDGET_STAGE_COUNT];
+	F32 weight[FRAME_BUDGET_STAGE_COUNT];
+	for (S32 i = 0; i < FRAME_BUDGET_STAGE_COUNT; ++i)
+	{
+		Stage& s = mStages[i];
+		used += s.mUsed;
+		s.mBacklogFrames = s.mBacklog ? llmin(s.mBacklogFrames + 1, BACKLOG_MAX_FRAMES) : 0;
+		demand[i] = s.mBacklog ? s.mMax : llclamp(s.mUsed * HEADROOM, s.mMin, s.mMax);
+		weight[i] = s.mPriority * (1.f + (F32)s.mBacklogFrames / (F32)BACKLOG_DOUBLING_FRAMES);
+		// What it is guaranteed: its minimum, or if it ran out, a little
+		// more than it had.
+		s.mBudget = s.mBacklog ? llclamp(s.mBudget * BACKLOG_GROWTH, s.mMin, s.mMax) : s.mMin;
+	}
+
+	F32 other = llmax(frame_seconds - used, 0.f);
+	mOtherSeconds = lerp(mOtherSeconds, other, OTHER_SMOOTHING);
+
+	F32 available = target_frame_seconds - mOtherSeconds;
+	for (S32 i = 0; i < FRAME_BUDGET_STAGE_COUNT; ++i)
+	{
+		available -= mStages[i].mBudget;
+	}
+
+	// Hand out the rest by priority. A stage that reaches its demand drops
+	// out and its unused share goes round again.
+	for (S32 pass = 0; pass < FRAME_BUDGET_STAGE_COUNT && available > 0.f; ++pass)
+	{
+		F32 total_weight = 0.f;
+		for (S32 i = 0; i < FRAME_BUDGET_STAGE_COUNT; ++i)
+		{
+			if (mStages[i].mBudget < demand[i])
+			{
+				total_weight += weight[i];
+			}
+		}
+		if (total_weight <= 0.f)
+		{
+			break;
+		}
+
+		F32 share = available / total_weight;
+		for (S32 i = 0; i < FRAME_BUDGET_STAGE_COUNT; ++i)
+		{
+			Stage& s = mStages[i];
+			if (s.mBudget < demand[i])
+			{
+				F32 grant = llmin(share * weight[i], demand[i] - s.mBudget);
+				s.mBudget += grant;
+				available -= grant;
+			}
+		}
+	}
+}
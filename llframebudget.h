@@ -0,0 +1,97 @@
+/**
+ * @file llframebudget.h
+ * @brief Shares a target frame time among the time-sliced frame stages.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLFRAMEBUDGET_H
+#define LL_LLFRAMEBUDGET_H
+
+#include "llsingleton.h"
+#include "lltimer.h"
+
+// Stages that can stop early and pick up where they left off next frame.
+typedef enum e_frame_budget_stage
+{
+	FRAME_BUDGET_MESSAGES = 0,	// idleNetwork() message decoding
+	FRAME_BUDGET_REGIONS,		// surface patch updates
+	FRAME_BUDGET_AUDIO,			// audio decoding
+	FRAME_BUDGET_BACKGROUND,	// the background thread pass in mainLoop()
+	FRAME_BUDGET_STAGE_COUNT
+} EFrameBudgetStage;
+
+// Each frame measures what the frame cost outside the budgeted stages, and
+// what is left of the target frame time is shared among the stages for the
+// next frame. Every stage is guaranteed its minimum. Beyond that a stage
+// asks for what it used plus some headroom, or for its maximum if it ran
+// out of time with work left, and the remainder is split by priority. A
+// stage that keeps running out gains priority the longer it does, which is
+// how messages catch up after a burst. When the frame is already over
+// target everything gets its minimum, instead of each stage spending its
+// own worst case on top, except that a stage that ran out still grows by
+// the old 3.5% a frame so it cannot be starved.
+class LLFrameBudget : public LLSingleton<LLFrameBudget>
+{
+public:
+	LLFrameBudget();
+
+	// Main thread. Marks the start of the frame's work, after any pacing
+	// sleep.
+	void startFrame();
+	// Main thread, once the frame's work is done. Works out the budgets
+	// for the next frame.
+	void endFrame(F32 target_frame_seconds);
+
+	F32 getBudget(EFrameBudgetStage stage) const	{ return mStages[stage].mBudget; }
+	// Main thread, after the stage has run. 'backlog' is whether it stopped
+	// with work left.
+	void report(EFrameBudgetStage stage, F32 used_seconds, bool backlog);
+
+	F32 getUsed(EFrameBudgetStage stage) const		{ return mStages[stage].mUsed; }
+	// What the stage would be given if it ran out every frame: the target
+	// frame time less the unbudgeted cost and the other stages' minimums,
+	// within its own limits.
+	F32 getCapacity(EFrameBudgetStage stage) const;
+	F32 getOtherSeconds() const						{ return mOtherSeconds; }
+
+private:
+	struct Stage
+	{
+		F32		mMin;
+		F32		mMax;
+		F32		mPriority;
+		F32		mBudget;		// for this frame
+		F32		mUsed;			// this frame so far
+		bool	mBacklog;
+		S32		mBacklogFrames;	// consecutive frames it ran out
+	};
+
+	void setStage(EFrameBudgetStage stage, F32 initial, F32 min_seconds, F32 max_seconds, F32 priority);
+
+	Stage	mStages[FRAME_BUDGET_STAGE_COUNT];
+	LLTimer	mFrameTimer;
+	F32		mOtherSeconds;		// smoothed cost of everything unbudgeted
+	F32		mTargetSeconds;		// the last endFrame()'s target
+};
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ * @file llframepacer.cpp
+ * @brief Paces the main loop to a frame deadline.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llframepacer.h"
+
+#include "llcompletionqueue.h"
+#include "llfasttimer.h"
+#include "lljobsystem.h"
+
+static LLFastTimer::DeclareTimer FTM_PACER_JOBS("Pacer Jobs");
+
+// Sleeps stop this far short of the deadline and the rest is yielded, it
+// covers the coarsest scheduler tick we see in practice.
+static const F64 SLEEP_MARGIN_SECONDS = 0.002;
+// Pumped jobs run in slices of a few milliseconds; don't start one with
+// less than this left.
+static const F64 MIN_JOB_SLACK_SECONDS = 0.005;
+
+LLFramePacer::LLFramePacer()
+:	mMissedDeadlines(0),
+	mPacedFrames(0),
+	mLastSlack(0.0)
+{ }
+
+void LLFramePacer::setPolicies(const LLFramePacePolicy& foreground, const LLFramePacePolicy& background)
+{
+	mForeground = foreground;
+	mBackground = background;
+}
+
+F64 LLFramePacer::endFrame(bool foreground)
+{
+	const LLFramePacePolicy& policy = foreground ? mForeground : mBackground;
+	LLTimer sleep_timer;
+	F64 slept = 0.0;
+
+	if (policy.mTargetFPS > 0.f)
+	{
+		F64 deadline = 1.0 / (F64)policy.mTargetFPS;
+		mPacedFrames++;
+		mLastSlack = deadline - mFrameTimer.getElapsedTimeF64();
+		if (mLastSlack <= 0.0)
+		{
+			mMissedDeadlines++;
+		}
+		else
+		{
+			if (policy.mRunJobs)
+			{
+				LLFastTimer t(FTM_PACER_JOBS);
+				LLCompletionQueue* completions = LLCompletionQueue::getInstance();
+				LLJobSystem* jobs = LLJobSystem::getInstance();
+				F64 remaining = deadline - mFrameTimer.getElapsedTimeF64();
+				while (remaining > MIN_JOB_SLACK_SECONDS)
+				{
+					// Completions first, they may queue the next round of jobs.
+					bool worked = completions && completions->drain(remaining - MIN_JOB_SLACK_SECONDS) > 0;
+					worked = (jobs && jobs->runJob()) || worked;
+					if (!worked)
+					{
+						break;
+					}
+					remaining = deadline - mFrameTimer.getElapsedTimeF64();
+				}
+			}
+
+			sleep_timer.reset();
+			sleepUntil(deadline);
+			slept = sleep_timer.getElapsedTimeF64();
+		}
+	}
+
+	// The YieldTime command line option still guarantees the OS its share.
+	if (policy.mMinYieldMS >= 0 && slept * 1000.0 < (F64)policy.mMinYieldMS)
+	{
+		sleep_timer.reset();
+		ms_sleep(policy.mMinYieldMS - (S32)(slept * 1000.0));
+		slept += sleep_timer.getElapsedTimeF64();
+	}
+
+	mFrameTimer.reset();
+	return slept;
+}
+
+void LLFramePacer::sleepUntil(F64 deadline)
+{
+	F64 remaining = deadline - mFrameTimer.getElapsedTimeF64();
+	if (remaining > SLEEP_MARGIN_SECONDS)
+	{
+		ms_sleep((U32)((remaining - SLEEP_MARGIN_SECONDS) * 1000.0));
+	}
+	while (mFrameTimer.getElapsedTimeF64() < deadline)
+	{
+		// Gives up the rest of the time slice without a minimum sleep.
+		ms_sleep(0);
+	}
+}
@@ -0,0 +1,84 @@
+/**
+ * @file llframepacer.h
+ * @brief Paces the main loop to a frame deadline.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLFRAMEPACER_H
+#define LL_LLFRAMEPACER_H
+
+#include "llsingleton.h"
+#include "lltimer.h"
+
+// How to spend the end of a frame.
+struct LLFramePacePolicy
+{
+	LLFramePacePolicy()
+	:	mTargetFPS(0.f),
+		mRunJobs(false),
+		mMinYieldMS(0)
+	{ }
+
+	F32		mTargetFPS;		// 0 for no deadline
+	bool	mRunJobs;		// help the job system before sleeping
+	S32		mMinYieldMS;	// always give the OS this much, < 0 for none
+};
+
+// Each frame has a deadline one target period after the previous frame
+// ended. Whatever the frame's own work leaves of it is first used to run
+// completions and queued jobs on the main thread, if the policy allows,
+// and only the rest is slept. The sleep is short of the deadline by the
+// OS timer granularity and then yields until the deadline, so the frame
+// ends on time rather than up to a scheduler tick late.
+//
+// The foreground policy applies while the window is visible and focused,
+// the background one otherwise.
+class LLFramePacer : public LLSingleton<LLFramePacer>
+{
+public:
+	LLFramePacer();
+
+	void setPolicies(const LLFramePacePolicy& foreground, const LLFramePacePolicy& background);
+
+	// Main thread, once the frame's work is done. Returns the seconds slept.
+	F64 endFrame(bool foreground);
+
+	// Frames whose own work overran the deadline, so there was nothing to
+	// pace. Only frames that had a deadline count.
+	U32 getMissedDeadlines() const		{ return mMissedDeadlines; }
+	U32 getPacedFrames() const			{ return mPacedFrames; }
+	// Slack of the last frame, negative if it was missed.
+	F64 getLastSlackSeconds() const		{ return mLastSlack; }
+
+private:
+	void sleepUntil(F64 deadline);
+
+	LLFramePacePolicy	mForeground;
+	LLFramePacePolicy	mBackground;
+	LLTimer				mFrameTimer;	// since the previous frame ended
+	U32					mMissedDeadlines;
+	U32					mPacedFrames;
+	F64					mLastSlack;
+};
+
+#endif
@@ -0,0 +1,133 @@
+/**
+ * @file llframetaskgraph.cpp
+ * @brief Runs a frame's update stages and finds their critical path.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llframetaskgraph.h"
+
+#include "lltimer.h"
+
+LLFrameTaskGraph::LLFrameTaskGraph(const std::string& name)
+:	mName(name),
+	mCriticalPathSeconds(0.0),
+	mLastRunSeconds(0.0)
+{ }
+
+S32 LLFrameTaskGraph::addTask(LLFastTimer::DeclareTimer& timer, task_func_t func, U32 reads, U32 writes)
+{
+	S32 index = (S32)mTasks.size();
+	mTasks.push_back(Task());
+	Task& task = mTasks.back();
+	task.mTimer = &timer;
+	task.mFunc = func;
+	task.mReads = reads;
+	task.mWrites = writes;
+	task.mStart = task.mEnd = 0;
+
+	for (S32 i = 0; i < index; ++i)
+	{
+		const Task& earlier = mTasks[i];
+		bool conflict = (earlier.mWrites & (reads | writes)) || (writes & earlier.mReads);
+		if (conflict)
+		{
+			task.mDependencies.push_back(i);
+		}
+	}
+	return index;
+}
+
+void LLFrameTaskGraph::run()
+{
+	if (mTasks.empty())
+	{
+		return;
+	}
+
+	U64 start = totalTime();
+	for (std::vector<Task>::iterator it = mTasks.begin(); it != mTasks.end(); ++it)
+	{
+		it->mStart = totalTime();
+		{
+			LLFastTimer t(*it->mTimer);
+			it->mFunc();
+		}
+		it->mEnd = totalTime();
+	}
+
+	computeCriticalPath(start);
+}
+
+void LLFrameTaskGraph::computeCriticalPath(U64 start)
+{
+	// Tasks were added in program order and only depend on earlier ones,
+	// so index order is a topological order.
+	S32 count = (S32)mTasks.size();
+	std::vector<U64> finish(count, 0);
+	std::vector<S32> via(count, -1);
+	S32 last = -1;
+	for (S32 i = 0; i < count; ++i)
+	{
+		const Task& task = mTasks[i];
+		U64 earliest = 0;
+		for (std::vector<S32>::const_iterator it = task.mDependencies.begin(); it != task.mDependencies.end(); ++it)
+		{
+			if (finish[*it] > earliest)
+			{
+				earliest = finish[*it];
+				via[i] = *it;
+			}
+		}
+		finish[i] = earliest + (task.mEnd - task.mStart);
+		if (last < 0 || finish[i] > finish[last])
+		{
+			last = i;
+		}
+	}
+
+	mCriticalPath.clear();
+	for (S32 i = last; i >= 0; i = via[i])
+	{
+		mCriticalPath.insert(mCriticalPath.begin(), i);
+	}
+	mCriticalPathSeconds = (F64)finish[last] / (F64)SEC_TO_MICROSEC;
+	mLastRunSeconds = (F64)(totalTime() - start) / (F64)SEC_TO_MICROSEC;
+}
+
+std::string LLFrameTaskGraph::getCriticalPathString() const
+{
+	std::string path;
+	for (std::vector<S32>::const_iterator it = mCriticalPath.begin(); it != mCriticalPath.end(); ++it)
+	{
+		const Task& task = mTasks[*it];
+		if (!path.empty())
+		{
+			path += " > ";
+		}
+		path += llformat("%s (%.2fms)", task.mTimer->getNamedTimer().getName().c_str(),
+						 (F64)(task.mEnd - task.mStart) / 1000.0);
+	}
+	return path;
+}
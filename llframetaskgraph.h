@@ -0,0 +1,88 @@
+/**
+ * @file llframetaskgraph.h
+ * @brief Runs a frame's update stages and finds their critical path.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLFRAMETASKGRAPH_H
+#define LL_LLFRAMETASKGRAPH_H
+
+#include "llfasttimer.h"
+
+#include <boost/function.hpp>
+#include <vector>
+
+// A fixed set of per-frame stages, each declaring the data it reads and
+// writes as bits of a caller defined resource mask.
+//
+// Stages are added in the order the frame used to run them. A stage
+// depends on every earlier stage it conflicts with (either one writes a
+// resource the other uses). The stages touch main thread only subsystems,
+// so run() still runs them one after another on the main thread, in the
+// order they were added, each under its own LLFastTimer. The dependencies
+// give the critical path: the longest chain of stages that would have to
+// run in sequence even if every independent stage overlapped. It is a
+// lower bound on what running the stages in parallel could get the world
+// update down to, not a time any frame actually took.
+class LLFrameTaskGraph
+{
+public:
+	typedef boost::function<void()> task_func_t;
+
+	LLFrameTaskGraph(const std::string& name);
+
+	// Returns the stage index.
+	S32 addTask(LLFastTimer::DeclareTimer& timer, task_func_t func, U32 reads, U32 writes);
+
+	// Main thread. Runs every stage in order.
+	void run();
+
+	// The chain of dependent stages that bounds the last run() from below.
+	const std::vector<S32>& getCriticalPath() const	{ return mCriticalPath; }
+	F64 getCriticalPathSeconds() const				{ return mCriticalPathSeconds; }
+	F64 getLastRunSeconds() const					{ return mLastRunSeconds; }
+	std::string getCriticalPathString() const;
+
+private:
+	struct Task
+	{
+		LLFastTimer::DeclareTimer*	mTimer;
+		task_func_t					mFunc;
+		U32							mReads;
+		U32							mWrites;
+		std::vector<S32>			mDependencies;
+		U64							mStart;
+		U64							mEnd;
+	};
+
+	void computeCriticalPath(U64 start);
+
+	std::string						mName;
+	std::vector<Task>				mTasks;
+
+	std::vector<S32>				mCriticalPath;
+	F64								mCriticalPathSeconds;
+	F64								mLastRunSeconds;
+};
+
+#endif
@@ -0,0 +1,96 @@
+/**
+ * @file llframetick.cpp
+ * @brief Typed, allocation free per-frame tick for main loop listeners.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llframetick.h"
+
+LLFrameTick::LLFrameTick()
+:	mRemovedCount(0)
+{ }
+
+void LLFrameTick::add(callback_t callback, void* data)
+{
+	Listener listener;
+	listener.mCallback = callback;
+	listener.mData = data;
+	mAdded.push_back(listener);
+}
+
+void LLFrameTick::remove(callback_t callback, void* data)
+{
+	for (std::vector<Listener>::iterator it = mAdded.begin(); it != mAdded.end(); ++it)
+	{
+		if (it->mCallback == callback && it->mData == data)
+		{
+			mAdded.erase(it);
+			return;
+		}
+	}
+	// Only cleared here, the vector may be being walked by tick().
+	for (std::vector<Listener>::iterator it = mListeners.begin(); it != mListeners.end(); ++it)
+	{
+		if (it->mCallback == callback && it->mData == data)
+		{
+			it->mCallback = NULL;
+			mRemovedCount++;
+			return;
+		}
+	}
+}
+
+void LLFrameTick::tick()
+{
+	// The frame boundary: apply the changes made since the last tick.
+	if (mRemovedCount)
+	{
+		std::vector<Listener>::iterator out = mListeners.begin();
+		for (std::vector<Listener>::iterator it = mListeners.begin(); it != mListeners.end(); ++it)
+		{
+			if (it->mCallback)
+			{
+				*out++ = *it;
+			}
+		}
+		mListeners.erase(out, mListeners.end());
+		mRemovedCount = 0;
+	}
+	if (!mAdded.empty())
+	{
+		mListeners.insert(mListeners.end(), mAdded.begin(), mAdded.end());
+		mAdded.clear();
+	}
+
+	// By index and size at the start: nothing is appended while walking.
+	for (size_t i = 0, count = mListeners.size(); i < count; ++i)
+	{
+		const Listener& listener = mListeners[i];
+		if (listener.mCallback)
+		{
+			listener.mCallback(listener.mData);
+		}
+	}
+}
@@ -0,0 +1,79 @@
+/**
+ * @file llframetick.h
+ * @brief Typed, allocation free per-frame tick for main loop listeners.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLFRAMETICK_H
+#define LL_LLFRAMETICK_H
+
+#include "llsingleton.h"
+
+#include <vector>
+
+// The per-frame tick for listeners that run every frame. The "mainloop"
+// LLEventPump carries the same tick as an empty LLSD through a boost
+// signal; this calls plain function pointers from a flat vector, with no
+// LLSD, no signal and, once the vector has grown, no allocation.
+//
+// Main thread only. Adding or removing a listener takes effect at the next
+// frame boundary, so listeners may add or remove others, or themselves,
+// while being called. A removed listener is never called again, even later
+// in the frame that removed it.
+class LL_COMMON_API LLFrameTick : public LLSingleton<LLFrameTick>
+{
+public:
+	typedef void (*callback_t)(void* data);
+
+	LLFrameTick();
+
+	void add(callback_t callback, void* data);
+	void remove(callback_t callback, void* data);
+
+	// For void T::method(), e.g. addMethod<LLLeapImpl, &LLLeapImpl::tick>(this).
+	template <class T, void (T::*METHOD)()>
+	void addMethod(T* object)		{ add(&callMethod<T, METHOD>, object); }
+	template <class T, void (T::*METHOD)()>
+	void removeMethod(T* object)	{ remove(&callMethod<T, METHOD>, object); }
+
+	// Once per frame, just before the "mainloop" pump is posted.
+	void tick();
+
+	S32 getListenerCount() const	{ return (S32)(mListeners.size() + mAdded.size()) - mRemovedCount; }
+
+private:
+	struct Listener
+	{
+		callback_t	mCallback;	// NULL once removed
+		void*		mData;
+	};
+
+	template <class T, void (T::*METHOD)()>
+	static void callMethod(void* object)	{ (static_cast<T*>(object)->*METHOD)(); }
+
+	std::vector<Listener>	mListeners;
+	std::vector<Listener>	mAdded;			// to be appended at the next tick
+	S32						mRemovedCount;	// NULL entries in mListeners
+};
+
+#endif
@@ -0,0 +1,170 @@
+/**
+ * @file llheartbeat.cpp
+ * @brief Lock-free stage heartbeat and a watchdog side stage timer.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llheartbeat.h"
+
+#include <map>
+#include <vector>
+
+// Created in initClass(), after APR is up, so not by a static initialiser.
+static LLMutex* sStageMutex = NULL;
+static std::vector<std::string> sStageNames(1, std::string("(none)"));
+static std::map<std::string, U32> sStageIds;
+
+LLHeartbeat::LLHeartbeat()
+{
+	mBeat = 0;
+}
+
+//static
+void LLHeartbeat::initClass()
+{
+	llassert(!sStageMutex);
+	sStageMutex = new LLMutex(NULL);
+}
+
+//static
+void LLHeartbeat::cleanupClass()
+{
+	delete sStageMutex;
+	sStageMutex = NULL;
+}
+
+//static
+U32 LLHeartbeat::registerStage(const std::string& name)
+{
+	if (!sStageMutex)
+	{
+		return NO_STAGE;
+	}
+	LLMutexLock lock(sStageMutex);
+	std::map<std::string, U32>::iterator found = sStageIds.find(name);
+	if (found != sStageIds.end())
+	{
+		return found->second;
+	}
+	if (sStageNames.size() > MAX_STAGES)
+	{
+		LL_WARNS_ONCE("Heartbeat") << "Out of heartbeat stages, not timing " << name << LL_ENDL;
+		return NO_STAGE;
+	}
+	U32 stage = (U32)sStageNames.size();
+	sStageNames.push_back(name);
+	sStageIds[name] = stage;
+	return stage;
+}
+
+//static
+std::string LLHeartbeat::getStageName(U32 stage)
+{
+	if (!sStageMutex)
+	{
+		return std::string();
+	}
+	LLMutexLock lock(sStageMutex);
+	return stage < sStageNames.size() ? sStageNames[stage] : std::string();
+}
+
+//----------------------------------------------------------------------------
+
+LLHeartbeatMonitor::LLHeartbeatMonitor(const LLHeartbeat& heartbeat, U32 period_ms)
+:	LLThread("Heartbeat monitor"),
+	mHeartbeat(heartbeat),
+	mPeriodMS(llmax(period_ms, (U32)1)),
+	mLastBeat(heartbeat.getBeat()),
+	mHistogramMutex(NULL)
+{
+	memset(mHistograms, 0, sizeof(mHistograms));
+}
+
+LLHeartbeatMonitor::~LLHeartbeatMonitor()
+{
+	shutdown();
+}
+
+void LLHeartbeatMonitor::run()
+{
+	while (!isQuitting())
+	{
+		sample();
+		ms_sleep(mPeriodMS);
+	}
+}
+
+void LLHeartbeatMonitor::sample()
+{
+	U32 beat = mHeartbeat.getBeat();
+	if (beat == mLastBeat)
+	{
+		return;
+	}
+
+	U32 stage = mLastBeat >> LLHeartbeat::TICK_BITS;
+	U32 ticks = (beat - mLastBeat) & LLHeartbeat::TICK_MASK;
+	mLastBeat = beat;
+	if (stage == LLHeartbeat::NO_STAGE)
+	{
+		return;
+	}
+
+	S32 bucket = 0;
+	for (U32 bound = 2; bucket < BUCKET_COUNT - 1 && ticks >= bound; bound <<= 1)
+	{
+		++bucket;
+	}
+
+	LLMutexLock lock(&mHistogramMutex);
+	Histogram& histogram = mHistograms[stage];
+	histogram.mBuckets[bucket]++;
+	histogram.mCount++;
+	histogram.mTotalTicks += ticks;
+	histogram.mMaxTicks = llmax(histogram.mMaxTicks, ticks);
+}
+
+void LLHeartbeatMonitor::logHistograms() const
+{
+	const F64 TICK_MS = (F64)LLHeartbeat::TICK_MICROSECONDS / 1000.0;
+
+	LLMutexLock lock(&mHistogramMutex);
+	for (U32 stage = 1; stage <= LLHeartbeat::MAX_STAGES; ++stage)
+	{
+		const Histogram& histogram = mHistograms[stage];
+		if (!histogram.mCount)
+		{
+			continue;
+		}
+		std::string buckets;
+		for (S32 i = 0; i < BUCKET_COUNT; ++i)
+		{
+			buckets += llformat(" %u", histogram.mBuckets[i]);
+		}
+		LL_INFOS("Heartbeat") << LLHeartbeat::getStageName(stage) << ": " << histogram.mCount << " beats, mean "
+			<< llformat("%.2f", histogram.mTotalTicks * TICK_MS / histogram.mCount) << " ms, max "
+			<< llformat("%.1f", histogram.mMaxTicks * TICK_MS) << " ms, log2 buckets from 0.2 ms:" << buckets << LL_ENDL;
+	}
+}
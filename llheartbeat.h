@@ -0,0 +1,117 @@
+/**
+ * @file llheartbeat.h
+ * @brief Lock-free stage heartbeat and a watchdog side stage timer.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLHEARTBEAT_H
+#define LL_LLHEARTBEAT_H
+
+#include "llatomic.h"
+#include "llthread.h"
+#include "lltimer.h"
+
+#include <string>
+
+// A thread reports which stage it is in with ping(). Stage names are
+// interned once into small ids, and a ping stores the id together with
+// the time in one 32 bit word: the id in the top 8 bits, and the time in
+// units of HEARTBEAT_TICK_MICROSECONDS in the rest, which wraps after about
+// 28 minutes. That is a single atomic store, with no string copy or lock.
+class LLHeartbeat
+{
+public:
+	enum
+	{
+		NO_STAGE = 0,
+		MAX_STAGES = 255,
+		TICK_BITS = 24
+	};
+	static const U32 TICK_MASK = (1 << TICK_BITS) - 1;
+	static const U32 TICK_MICROSECONDS = 100;
+
+	LLHeartbeat();
+
+	// Main thread, after APR is initialised and before any monitor starts,
+	// and after the last monitor and watchdog are gone.
+	static void initClass();
+	static void cleanupClass();
+
+	// Any thread. Returns the existing id if the name is known already, and
+	// NO_STAGE once MAX_STAGES are in use or outside initClass() and
+	// cleanupClass().
+	static U32 registerStage(const std::string& name);
+	static std::string getStageName(U32 stage);
+
+	// Any thread.
+	void ping(U32 stage)
+	{
+		mBeat = (stage << TICK_BITS) | ((U32)(totalTime() / TICK_MICROSECONDS) & TICK_MASK);
+	}
+
+	U32 getBeat() const			{ return mBeat.CurrentValue(); }
+	U32 getStage() const		{ return getBeat() >> TICK_BITS; }
+
+private:
+	LLAtomicU32	mBeat;
+};
+
+// Samples a heartbeat every period and, each time it has moved on, adds
+// the time since the previous beat to the previous stage's histogram.
+// Stages shorter than the period are merged into the one before them, so
+// the short end of the histograms is approximate while the long tail,
+// which is what the watchdog is for, is exact to a period.
+class LLHeartbeatMonitor : public LLThread
+{
+public:
+	// Bucket 0 is under 0.2 ms, bucket n up to 0.1 * 2^(n + 1) ms, and the
+	// last one everything longer.
+	enum { BUCKET_COUNT = 16 };
+
+	LLHeartbeatMonitor(const LLHeartbeat& heartbeat, U32 period_ms);
+	~LLHeartbeatMonitor();
+
+	/*virtual*/ void run();
+
+	// Any thread.
+	void logHistograms() const;
+
+private:
+	struct Histogram
+	{
+		U32		mBuckets[BUCKET_COUNT];
+		U32		mCount;
+		U64		mTotalTicks;
+		U32		mMaxTicks;
+	};
+
+	void sample();
+
+	const LLHeartbeat&	mHeartbeat;
+	U32					mPeriodMS;
+	U32					mLastBeat;
+	Histogram			mHistograms[LLHeartbeat::MAX_STAGES + 1];	// guarded by mHistogramMutex
+	mutable LLMutex		mHistogramMutex;
+};
+
+#endif
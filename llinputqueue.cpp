@@ -0,0 +1,263 @@
+/**
+ * @file llinputqueue.cpp
+ * @brief Timestamped movement input from all devices, applied once per frame.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llinputqueue.h"
+
+#include "llagent.h"
+#include "llagentcamera.h"
+#include "llviewercontrol.h"
+
+#include <algorithm>
+
+static LLFastTimer::DeclareTimer FTM_INPUT_APPLY("Apply Input");
+
+// Time order, ties broken by device then action so the result never
+// depends on which thread posted first.
+static bool input_event_less(const LLInputEvent& a, const LLInputEvent& b)
+{
+	if (a.mTime != b.mTime)
+	{
+		return a.mTime < b.mTime;
+	}
+	if (a.mDevice != b.mDevice)
+	{
+		return a.mDevice < b.mDevice;
+	}
+	return a.mAction < b.mAction;
+}
+
+LLInputQueue::LLInputQueue()
+:	mMutex(NULL),
+	mLastApply(0.0)
+{
+	for (S32 device = 0; device < INPUT_DEVICE_COUNT; ++device)
+	{
+		for (S32 action = 0; action < INPUT_ACTION_COUNT; ++action)
+		{
+			mLevel[device][action] = 0.f;
+			mActive[device][action] = false;
+		}
+	}
+	for (S32 action = 0; action < INPUT_ACTION_COUNT; ++action)
+	{
+		mApplied[action] = 0.f;
+	}
+}
+
+void LLInputQueue::post(EInputDevice device, EInputAction action, F32 value, F64 time)
+{
+	LLInputEvent event;
+	event.mTime = time;
+	event.mDevice = device;
+	event.mAction = action;
+	event.mValue = value;
+
+	LLMutexLock lock(&mMutex);
+	mPending.push_back(event);
+}
+
+void LLInputQueue::release(EInputDevice device, F64 time)
+{
+	for (S32 action = 0; action < INPUT_ACTION_COUNT; ++action)
+	{
+		post(device, (EInputAction)action, 0.f, time);
+	}
+}
+
+void LLInputQueue::apply()
+{
+	LLFastTimer t(FTM_INPUT_APPLY);
+
+	mEvents.clear();
+	{
+		LLMutexLock lock(&mMutex);
+		mEvents.swap(mPending);
+	}
+	std::stable_sort(mEvents.begin(), mEvents.end(), input_event_less);
+
+	F64 now = LLTimer::getTotalSeconds();
+	F64 start = (mLastApply > 0.0) ? mLastApply : now;
+	F64 span = now - start;
+	mLastApply = now;
+
+	// Time weighted average of each level over the frame, for the levels
+	// posted more than once. Events stamped before the last frame count
+	// from its start; events from the future (clock skew between threads)
+	// count from now.
+	F32 average[INPUT_DEVICE_COUNT][INPUT_ACTION_COUNT];
+	F64 cursor[INPUT_DEVICE_COUNT][INPUT_ACTION_COUNT];
+	F64 sum[INPUT_DEVICE_COUNT][INPUT_ACTION_COUNT];
+	S32 posted[INPUT_DEVICE_COUNT][INPUT_ACTION_COUNT];
+	for (S32 device = 0; device < INPUT_DEVICE_COUNT; ++device)
+	{
+		for (S32 action = 0; action < INPUT_ACTION_COUNT; ++action)
+		{
+			cursor[device][action] = start;
+			sum[device][action] = 0.0;
+			posted[device][action] = 0;
+		}
+	}
+	for (std::vector<LLInputEvent>::const_iterator it = mEvents.begin(); it != mEvents.end(); ++it)
+	{
+		S32 device = it->mDevice;
+		S32 action = it->mAction;
+		F64 time = llclamp(it->mTime, start, now);
+		sum[device][action] += mLevel[device][action] * (time - cursor[device][action]);
+		cursor[device][action] = time;
+		mLevel[device][action] = it->mValue;
+		mActive[device][action] = true;
+		posted[device][action]++;
+	}
+	for (S32 device = 0; device < INPUT_DEVICE_COUNT; ++device)
+	{
+		for (S32 action = 0; action < INPUT_ACTION_COUNT; ++action)
+		{
+			F32 level = mLevel[device][action];
+			if (posted[device][action] > 1 && span > 0.0)
+			{
+				sum[device][action] += level * (now - cursor[device][action]);
+				average[device][action] = (F32)(sum[device][action] / span);
+			}
+			else
+			{
+				average[device][action] = level;
+			}
+		}
+	}
+
+	// One device per action: the highest priority one that is driving it,
+	// or failing that the highest priority one that has ever reported it.
+	// A zero is only applied on the frame a control is released, so idle
+	// devices leave alone anything still driving the agent directly.
+	for (S32 action = 0; action < INPUT_ACTION_COUNT; ++action)
+	{
+		S32 winner = -1;
+		for (S32 device = INPUT_DEVICE_COUNT - 1; device >= 0; --device)
+		{
+			if (!mActive[device][action])
+			{
+				continue;
+			}
+			if (winner < 0)
+			{
+				winner = device;
+			}
+			if (average[device][action] != 0.f)
+			{
+				winner = device;
+				break;
+			}
+		}
+		if (winner < 0)
+		{
+			continue;
+		}
+
+		F32 value = average[winner][action];
+		if (value != 0.f || mApplied[action] != 0.f)
+		{
+			applyAction((EInputAction)action, (EInputDevice)winner, value);
+		}
+		mApplied[action] = value;
+	}
+}
+
+void LLInputQueue::applyAction(EInputAction action, EInputDevice device, F32 value)
+{
+	switch (action)
+	{
+	case INPUT_MOVE_AT:
+		// Only the keyboard resets the camera, as it did driving gAgent itself.
+		gAgent.moveAt(value > 0.f ? 1 : (value < 0.f ? -1 : 0), device == INPUT_DEVICE_KEYBOARD);
+		break;
+
+	case INPUT_MOVE_LEFT:
+		gAgent.moveLeft(value > 0.f ? 1 : (value < 0.f ? -1 : 0));
+		break;
+
+	case INPUT_MOVE_UP:
+		gAgent.moveUp(value > 0.f ? 1 : (value < 0.f ? -1 : 0));
+		break;
+
+	case INPUT_FLY:
+		if (value > 0.f
+			&& !gAgent.getFlying()
+			&& gAgent.canFly()
+			&& !gAgent.upGrabbed()
+			&& gSavedSettings.getBOOL("AutomaticFly"))
+		{
+			gAgent.setFlying(true);
+		}
+		break;
+
+	case INPUT_YAW:
+		if (device == INPUT_DEVICE_KEYBOARD)
+		{
+			gAgent.moveYaw(-value);
+		}
+		// Cannot steer some vehicles in mouselook if the script grabs the controls
+		else if (gAgentCamera.cameraMouselook()
+			&& !gSavedSettings.getBOOL(device == INPUT_DEVICE_NUI ? "NuiMouselookYaw" : "JoystickMouselookYaw"))
+		{
+			gAgent.rotate(-value, gAgent.getReferenceUpVector());
+		}
+		else
+		{
+			if (value < 0.f)
+			{
+				gAgent.setControlFlags(AGENT_CONTROL_YAW_POS);
+			}
+			else if (value > 0.f)
+			{
+				gAgent.setControlFlags(AGENT_CONTROL_YAW_NEG);
+			}
+			gAgent.yaw(-value);
+		}
+		break;
+
+	case INPUT_PITCH:
+		if (device == INPUT_DEVICE_KEYBOARD)
+		{
+			gAgent.movePitch(-value);
+			break;
+		}
+		if (value < 0.f)
+		{
+			gAgent.setControlFlags(AGENT_CONTROL_PITCH_POS);
+		}
+		else if (value > 0.f)
+		{
+			gAgent.setControlFlags(AGENT_CONTROL_PITCH_NEG);
+		}
+		gAgent.pitch(-value);
+		break;
+
+	default:
+		break;
+	}
+}
@@ -0,0 +1,105 @@
+/**
+ * @file llinputqueue.h
+ * @brief Timestamped movement input from all devices, applied once per frame.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLINPUTQUEUE_H
+#define LL_LLINPUTQUEUE_H
+
+#include "llmutex.h"
+#include "llsingleton.h"
+#include "lltimer.h"
+
+#include <vector>
+
+// Devices in increasing priority: when two devices drive the same action
+// in a frame, the later one in this list wins.
+typedef enum e_input_device
+{
+	INPUT_DEVICE_NUI = 0,
+	INPUT_DEVICE_JOYSTICK,
+	INPUT_DEVICE_KEYBOARD,
+	INPUT_DEVICE_COUNT
+} EInputDevice;
+
+// Each action is a level that holds until the device posts a new one.
+typedef enum e_input_action
+{
+	INPUT_MOVE_AT = 0,	// -1 back .. 1 forward
+	INPUT_MOVE_LEFT,	// -1 right .. 1 left
+	INPUT_MOVE_UP,		// -1 down .. 1 up
+	INPUT_YAW,			// positive turns right: a per frame increment, or
+						// from the keyboard the rate passed to moveYaw()
+	INPUT_PITCH,		// positive looks up, as for INPUT_YAW
+	INPUT_FLY,			// 1 to start flying if allowed
+	INPUT_ACTION_COUNT
+} EInputAction;
+
+struct LLInputEvent
+{
+	F64				mTime;	// LLTimer::getTotalSeconds()
+	EInputDevice	mDevice;
+	EInputAction	mAction;
+	F32				mValue;
+};
+
+// Devices post events from any thread, as often as they sample. Once per
+// frame apply() takes everything posted so far, picks one device per action
+// by priority and only then touches gAgent, so the result does not depend
+// on the order the devices were scanned in. A device that posted an action
+// once since the last frame, as the scanned devices do, counts with that
+// level straight away. One that posted it several times sampled faster than
+// the frame rate, and counts with the average of its levels over the time
+// since the last frame, so every sample contributes rather than just its
+// last.
+class LLInputQueue : public LLSingleton<LLInputQueue>
+{
+public:
+	LLInputQueue();
+
+	void post(EInputDevice device, EInputAction action, F32 value, F64 time = LLTimer::getTotalSeconds());
+	// Sets every action of 'device' back to zero.
+	void release(EInputDevice device, F64 time = LLTimer::getTotalSeconds());
+
+	// Main thread, once per frame after the devices are scanned.
+	void apply();
+
+	// The merged value of an action in the last apply(), for debugging.
+	F32 getApplied(EInputAction action) const	{ return mApplied[action]; }
+
+private:
+	void applyAction(EInputAction action, EInputDevice device, F32 value);
+
+	LLMutex						mMutex;
+	std::vector<LLInputEvent>	mPending;	// guarded by mMutex
+
+	// Main thread only.
+	std::vector<LLInputEvent>	mEvents;
+	F32							mLevel[INPUT_DEVICE_COUNT][INPUT_ACTION_COUNT];
+	bool						mActive[INPUT_DEVICE_COUNT][INPUT_ACTION_COUNT];
+	F32							mApplied[INPUT_ACTION_COUNT];
+	F64							mLastApply;
+};
+
+#endif
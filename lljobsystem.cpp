@@ -0,0 +1,339 @@
+/**
+ * @file lljobsystem.cpp
+ * @brief Shared work-stealing worker pool for background viewer work.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "lljobsystem.h"
+
+#include "llcompletionqueue.h"
+#include "llqueuedthread.h"
+#include "llthread.h"
+#include "lltimer.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+LLJobSystem* LLJobSystem::sInstance = NULL;
+
+class LLJobWorker : public LLThread
+{
+public:
+	LLJobWorker(LLJobSystem* system, S32 index)
+	:	LLThread(llformat("Job worker %d", index)),
+		mSystem(system),
+		mIndex(index)
+	{ }
+
+	/*virtual*/ void run()
+	{
+		LLJobSystem::job_func_t job;
+		while (mSystem->takeJob(mIndex, job))
+		{
+			job();
+			job.clear();
+		}
+	}
+
+private:
+	LLJobSystem*	mSystem;
+	S32				mIndex;
+};
+
+//static
+void LLJobSystem::initClass(S32 workers)
+{
+	llassert(!sInstance);
+	if (workers < 0)
+	{
+		workers = llmax((S32)boost::thread::hardware_concurrency() - 1, 1);
+	}
+	sInstance = new LLJobSystem(workers);
+	llinfos << "Job system started with " << workers << " workers" << llendl;
+}
+
+//static
+void LLJobSystem::cleanupClass()
+{
+	delete sInstance;
+	sInstance = NULL;
+}
+
+LLJobSystem::LLJobSystem(S32 workers)
+:	mIdleCondition(new LLCondition(NULL)),
+	mQuitting(false)
+{
+	mQueued = 0;
+	mNextQueue = 0;
+
+	workers = llmax(workers, 1);
+	mQueues.resize(workers);
+	for (S32 i = 0; i < workers; ++i)
+	{
+		mQueues[i].mMutex = new LLMutex(NULL);
+	}
+	for (S32 i = 0; i < workers; ++i)
+	{
+		LLJobWorker* worker = new LLJobWorker(this, i);
+		mWorkers.push_back(worker);
+		worker->start();
+	}
+}
+
+LLJobSystem::~LLJobSystem()
+{
+	// Jobs still queued are dropped; owners flush what they depend on first.
+	mIdleCondition->lock();
+	mQuitting = true;
+	mIdleCondition->broadcast();
+	mIdleCondition->unlock();
+
+	for (std::vector<LLJobWorker*>::iterator it = mWorkers.begin(); it != mWorkers.end(); ++it)
+	{
+		(*it)->shutdown();
+		delete *it;
+	}
+	mWorkers.clear();
+
+	for (std::vector<Queue>::iterator it = mQueues.begin(); it != mQueues.end(); ++it)
+	{
+		delete it->mMutex;
+	}
+	mQueues.clear();
+	delete mIdleCondition;
+}
+
+void LLJobSystem::JobRing::pushBack(const job_func_t& job)
+{
+	U32 size = (U32)mJobs.size();
+	if (mCount == size)
+	{
+		std::vector<job_func_t> jobs(llmax(size * 2, (U32)16));
+		for (U32 i = 0; i < mCount; ++i)
+		{
+			jobs[i].swap(mJobs[(mFirst + i) & (size - 1)]);
+		}
+		mJobs.swap(jobs);
+		mFirst = 0;
+		size = (U32)mJobs.size();
+	}
+	mJobs[(mFirst + mCount) & (size - 1)] = job;
+	mCount++;
+}
+
+void LLJobSystem::JobRing::takeBack(job_func_t& job)
+{
+	job_func_t& back = mJobs[(mFirst + mCount - 1) & (mJobs.size() - 1)];
+	job.swap(back);
+	back.clear();
+	mCount--;
+}
+
+void LLJobSystem::JobRing::takeFront(job_func_t& job)
+{
+	job.swap(mJobs[mFirst]);
+	mJobs[mFirst].clear();
+	mFirst = (mFirst + 1) & (mJobs.size() - 1);
+	mCount--;
+}
+
+void LLJobSystem::submit(EJobPriority priority, const job_func_t& job)
+{
+	Queue& queue = mQueues[mNextQueue++ % mQueues.size()];
+	{
+		LLMutexLock lock(queue.mMutex);
+		queue.mJobs[priority].pushBack(job);
+	}
+	mQueued++;
+
+	// Under the lock, so a worker that just found nothing cannot miss it.
+	mIdleCondition->lock();
+	mIdleCondition->signal();
+	mIdleCondition->unlock();
+}
+
+bool LLJobSystem::popOwn(S32 worker, EJobPriority priority, job_func_t& job)
+{
+	Queue& queue = mQueues[worker];
+	LLMutexLock lock(queue.mMutex);
+	JobRing& jobs = queue.mJobs[priority];
+	if (jobs.empty())
+	{
+		return false;
+	}
+	// Newest first: its data is most likely still in this core's cache.
+	jobs.takeBack(job);
+	return true;
+}
+
+bool LLJobSystem::steal(S32 thief, EJobPriority priority, job_func_t& job)
+{
+	S32 count = (S32)mQueues.size();
+	for (S32 i = 1; i <= count; ++i)
+	{
+		S32 victim = (thief + i) % count;
+		if (victim == thief)
+		{
+			continue;
+		}
+		Queue& queue = mQueues[victim];
+		LLMutexLock lock(queue.mMutex);
+		JobRing& jobs = queue.mJobs[priority];
+		if (!jobs.empty())
+		{
+			// Oldest first, the opposite end from the owner.
+			jobs.takeFront(job);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool LLJobSystem::runJob()
+{
+	job_func_t job;
+	for (S32 priority = 0; priority < JOB_PRIORITY_COUNT; ++priority)
+	{
+		// Not a worker, so every queue is someone else's.
+		if (steal(-1, (EJobPriority)priority, job))
+		{
+			mQueued--;
+			job();
+			return true;
+		}
+	}
+	return false;
+}
+
+bool LLJobSystem::takeJob(S32 worker, job_func_t& job)
+{
+	while (true)
+	{
+		for (S32 priority = 0; priority < JOB_PRIORITY_COUNT; ++priority)
+		{
+			if (popOwn(worker, (EJobPriority)priority, job)
+				|| steal(worker, (EJobPriority)priority, job))
+			{
+				mQueued--;
+				return true;
+			}
+		}
+
+		mIdleCondition->lock();
+		if (mQuitting)
+		{
+			mIdleCondition->unlock();
+			return false;
+		}
+		if (mQueued.CurrentValue() <= 0)
+		{
+			mIdleCondition->wait();
+		}
+		mIdleCondition->unlock();
+	}
+}
+
+//----------------------------------------------------------------------------
+
+LLQueuedThreadPump::LLQueuedThreadPump(LLQueuedThread* thread, EJobPriority priority, S32 max_parallel, F32 slice_ms)
+:	mThread(thread),
+	mPriority(priority),
+	mMaxParallel(llmax(max_parallel, 1)),
+	mSliceMS(slice_ms),
+	mRunning(false),
+	mStopping(false)
+{
+	mOutstanding = 0;
+}
+
+S32 LLQueuedThreadPump::pump()
+{
+	S32 pending = mThread->getPending();
+	if (!mRunning && !mStopping && pending > 0)
+	{
+		startRound(pending);
+	}
+	return pending;
+}
+
+void LLQueuedThreadPump::flush()
+{
+	mStopping = true;
+	while (mRunning)
+	{
+		// Runs the round's completion, which is what clears mRunning.
+		LLCompletionQueue::getInstance()->drain(0.0);
+		if (mRunning)
+		{
+			ms_sleep(1);
+		}
+	}
+}
+
+void LLQueuedThreadPump::startRound(S32 pending)
+{
+	LLJobSystem* jobs = LLJobSystem::getInstance();
+
+	// Always one update job: it is what moves new requests into the queue.
+	S32 drains = llclamp(pending - 1, 0, mMaxParallel - 1);
+	mOutstanding = 1 + drains;
+	mRunning = true;
+	jobs->submit(mPriority, boost::bind(&LLQueuedThreadPump::updateJob, this));
+	for (S32 i = 0; i < drains; ++i)
+	{
+		jobs->submit(mPriority, boost::bind(&LLQueuedThreadPump::drainJob, this));
+	}
+}
+
+void LLQueuedThreadPump::updateJob()
+{
+	mThread->update(mSliceMS);
+	finishJob();
+}
+
+void LLQueuedThreadPump::drainJob()
+{
+	mThread->updateQueue(mSliceMS);
+	finishJob();
+}
+
+void LLQueuedThreadPump::finishJob()
+{
+	// Prefix, which gives the new value whether LLAtomic follows APR's
+	// convention for the postfix decrement or not.
+	if (--mOutstanding == 0)
+	{
+		LLCompletionQueue::getInstance()->post(boost::bind(&LLQueuedThreadPump::roundDone, this, mThread->getPending()));
+	}
+}
+
+void LLQueuedThreadPump::roundDone(S32 pending)
+{
+	mRunning = false;
+	if (!mStopping && pending > 0)
+	{
+		startRound(pending);
+	}
+}
@@ -0,0 +1,163 @@
+/**
+ * @file lljobsystem.h
+ * @brief Shared work-stealing worker pool for background viewer work.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLJOBSYSTEM_H
+#define LL_LLJOBSYSTEM_H
+
+#include "llatomic.h"
+
+#include <boost/function.hpp>
+#include <vector>
+
+class LLCondition;
+class LLJobWorker;
+class LLMutex;
+class LLQueuedThread;
+
+// Priority classes, highest first. A worker always takes the highest
+// class it can find, its own or stolen, before looking at a lower one.
+typedef enum e_job_priority
+{
+	JOB_PRIORITY_FRAME = 0,		// needed by the current frame
+	JOB_PRIORITY_DECODE,		// texture decode
+	JOB_PRIORITY_BACKGROUND,	// anything that can wait
+	JOB_PRIORITY_COUNT
+} EJobPriority;
+
+// One pool of worker threads, sized to the machine, shared by every
+// subsystem instead of each owning a thread that idles while another has
+// a backlog.
+//
+// Each worker has its own queue per priority class. New jobs are spread
+// over the workers; a worker takes the newest job from its own queue and,
+// when that is empty, steals the oldest job from another worker's.
+class LLJobSystem
+{
+public:
+	typedef boost::function<void()> job_func_t;
+
+	// 'workers' < 0 means one per core less one for the main thread.
+	static void initClass(S32 workers);
+	static void cleanupClass();
+	static LLJobSystem* getInstance()	{ return sInstance; }
+
+	// Any thread.
+	void submit(EJobPriority priority, const job_func_t& job);
+	// Any thread but a worker. Runs the oldest of the highest priority jobs
+	// queued on the caller, returns false if there was none.
+	bool runJob();
+
+	S32 getWorkerCount() const			{ return (S32)mWorkers.size(); }
+	S32 getQueuedCount() const			{ return mQueued.CurrentValue(); }
+
+private:
+	friend class LLJobWorker;
+
+	LLJobSystem(S32 workers);
+	~LLJobSystem();
+
+	// Jobs in order, taken from either end. Unlike a std::deque it keeps
+	// its storage as jobs pass through, so once it has grown to the load,
+	// queueing a job that fits in a job_func_t allocates nothing.
+	class JobRing
+	{
+	public:
+		JobRing()
+		:	mFirst(0),
+			mCount(0)
+		{ }
+
+		bool empty() const		{ return !mCount; }
+		void pushBack(const job_func_t& job);
+		void takeBack(job_func_t& job);
+		void takeFront(job_func_t& job);
+
+	private:
+		std::vector<job_func_t>	mJobs;		// size is 0 or a power of two
+		U32						mFirst;
+		U32						mCount;
+	};
+
+	struct Queue
+	{
+		LLMutex*				mMutex;
+		JobRing					mJobs[JOB_PRIORITY_COUNT];
+	};
+
+	// Worker threads. Returns false when shutting down.
+	bool takeJob(S32 worker, job_func_t& job);
+	bool popOwn(S32 worker, EJobPriority priority, job_func_t& job);
+	bool steal(S32 thief, EJobPriority priority, job_func_t& job);
+
+	std::vector<LLJobWorker*>	mWorkers;
+	std::vector<Queue>			mQueues;
+	LLCondition*				mIdleCondition;	// idle workers sleep here
+	LLAtomicS32					mQueued;
+	LLAtomicU32					mNextQueue;
+	bool						mQuitting;		// guarded by mIdleCondition
+
+	static LLJobSystem*			sInstance;
+};
+
+// Services a non-threaded LLQueuedThread from the job system. One job
+// calls update(), which also takes in newly created requests, while up to
+// max_parallel - 1 more drain the request queue alongside it with
+// updateQueue(), so a backlog is worked on by several cores at once.
+//
+// The last job of a round posts its result to the completion queue, and
+// running that completion starts the next round while requests remain, so
+// the main thread never has to poll the pump to keep it busy.
+class LLQueuedThreadPump
+{
+public:
+	LLQueuedThreadPump(LLQueuedThread* thread, EJobPriority priority, S32 max_parallel, F32 slice_ms);
+
+	// Main thread, once per loop. Starts a round if none is running, which
+	// picks up requests made since the queue last ran dry, and returns the
+	// number of pending requests.
+	S32 pump();
+	// Main thread. Stops starting rounds and waits for the running one,
+	// call before deleting the thread.
+	void flush();
+
+private:
+	void startRound(S32 pending);
+	void updateJob();
+	void drainJob();
+	void finishJob();
+	// Main thread, from the completion queue.
+	void roundDone(S32 pending);
+
+	LLQueuedThread*	mThread;
+	EJobPriority	mPriority;
+	S32				mMaxParallel;
+	F32				mSliceMS;
+	LLAtomicS32		mOutstanding;	// jobs left in this round
+	bool			mRunning;		// main thread only
+	bool			mStopping;		// main thread only
+};
+
+#endif
@@ -0,0 +1,393 @@
+/**
+ * @file llmainloopbenchmark.cpp
+ * @brief Headless fixed clock benchmark of the main loop, and packet traces.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llmainloopbenchmark.h"
+
+#include "llatomic.h"
+#include "llsdserialize.h"
+#include "net.h"
+
+#include <algorithm>
+#include <new>
+#include <sstream>
+
+static const U32 TRACE_MAGIC_HEADER = 0x4352544D;	// "MTRC"
+static const U32 TRACE_VERSION = 2;
+static const U32 MAX_LOGIN_RESPONSE = 16 * 1024 * 1024;
+// Login response fields that are secrets, and no use without the servers.
+static const char* TRACE_LOGIN_OMITTED[] = { "secure_session_id", "seed_capability", NULL };
+
+#if LL_BENCHMARK_ALLOCATIONS
+// Zero before any constructor runs, so allocations made during static
+// initialisation are counted too.
+static LLAtomicU32 sAllocations;
+
+void* operator new(size_t size) throw(std::bad_alloc)
+{
+	sAllocations++;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	free(p);
+}
+#endif
+
+template <class T>
+static bool write_value(LLFILE* file, const T& value)
+{
+	return fwrite(&value, sizeof(T), 1, file) == 1;
+}
+
+template <class T>
+static bool read_value(LLFILE* file, T& value)
+{
+	return fread(&value, sizeof(T), 1, file) == 1;
+}
+
+LLMessageTrace::LLMessageTrace()
+:	mRecordFile(NULL),
+	mSessionStarted(false),
+	mNextPacket(0),
+	mFrame(0)
+{ }
+
+LLMessageTrace::~LLMessageTrace()
+{
+	if (mRecordFile)
+	{
+		fclose(mRecordFile);
+	}
+}
+
+bool LLMessageTrace::openForRecording(const std::string& filename)
+{
+	mRecordFile = LLFile::fopen(filename, "wb");
+	if (!mRecordFile)
+	{
+		LL_WARNS("Benchmark") << "Can't write packet trace " << filename << LL_ENDL;
+		return false;
+	}
+	mFrame = 0;
+	return true;
+}
+
+bool LLMessageTrace::startSession(const LLSD& login_response)
+{
+	if (!mRecordFile || mSessionStarted)
+	{
+		return false;
+	}
+	mSessionStarted = true;
+	mFrame = 0;
+
+	LLSD response = login_response;
+	for (const char** field = TRACE_LOGIN_OMITTED; *field; ++field)
+	{
+		response.erase(*field);
+	}
+	std::ostringstream str;
+	LLSDSerialize::toXML(response, str);
+	const std::string& xml = str.str();
+	U32 length = (U32)xml.size();
+	if (!write_value(mRecordFile, TRACE_MAGIC_HEADER)
+		|| !write_value(mRecordFile, TRACE_VERSION)
+		|| !write_value(mRecordFile, length)
+		|| fwrite(xml.data(), 1, length, mRecordFile) != length)
+	{
+		LL_WARNS("Benchmark") << "Can't write packet trace header" << LL_ENDL;
+		fclose(mRecordFile);
+		mRecordFile = NULL;
+		return false;
+	}
+	return true;
+}
+
+void LLMessageTrace::record(const char* buffer, S32 size, const LLHost& sender)
+{
+	if (!mRecordFile || !mSessionStarted || size <= 0)
+	{
+		return;
+	}
+	U32 address = sender.getAddress();
+	U32 port = sender.getPort();
+	U16 length = (U16)size;
+	write_value(mRecordFile, mFrame);
+	write_value(mRecordFile, address);
+	write_value(mRecordFile, port);
+	write_value(mRecordFile, length);
+	fwrite(buffer, 1, length, mRecordFile);
+}
+
+bool LLMessageTrace::load(const std::string& filename)
+{
+	mPackets.clear();
+	mNextPacket = 0;
+	mFrame = 0;
+
+	LLFILE* file = LLFile::fopen(filename, "rb");
+	if (!file)
+	{
+		LL_WARNS("Benchmark") << "Can't open packet trace " << filename << LL_ENDL;
+		return false;
+	}
+
+	U32 magic = 0, version = 0, length = 0;
+	bool ok = read_value(file, magic) && magic == TRACE_MAGIC_HEADER
+			  && read_value(file, version) && version == TRACE_VERSION
+			  && read_value(file, length) && length <= MAX_LOGIN_RESPONSE;
+	if (ok)
+	{
+		std::string xml(length, '\0');
+		ok = !length || fread(&xml[0], 1, length, file) == length;
+		std::istringstream str(xml);
+		ok = ok && LLSDSerialize::fromXML(mLoginResponse, str) > 0 && mLoginResponse.isMap();
+	}
+	if (!ok)
+	{
+		LL_WARNS("Benchmark") << filename << " is not a version " << TRACE_VERSION << " packet trace" << LL_ENDL;
+		fclose(file);
+		return false;
+	}
+	while (ok)
+	{
+		Packet packet;
+		U32 address, port;
+		U16 length;
+		if (!read_value(file, packet.mFrame))
+		{
+			// End of the trace.
+			break;
+		}
+		ok = read_value(file, address) && read_value(file, port) && read_value(file, length)
+			 && length <= NET_BUFFER_SIZE;
+		if (ok)
+		{
+			packet.mSender = LLHost(address, port);
+			packet.mData.resize(length);
+			ok = !length || fread(&packet.mData[0], 1, length, file) == length;
+		}
+		if (ok)
+		{
+			mPackets.push_back(packet);
+		}
+	}
+	fclose(file);
+
+	if (!ok)
+	{
+		LL_WARNS("Benchmark") << "Packet trace " << filename << " is damaged, replaying the first "
+			<< mPackets.size() << " packets" << LL_ENDL;
+	}
+	LL_INFOS("Benchmark") << "Loaded " << mPackets.size() << " packets from " << filename << LL_ENDL;
+	return !mPackets.empty();
+}
+
+S32 LLMessageTrace::replay(char* buffer, LLHost& sender, LLHost& receiving_interface)
+{
+	if (mNextPacket >= mPackets.size() || mPackets[mNextPacket].mFrame > mFrame)
+	{
+		return 0;
+	}
+	const Packet& packet = mPackets[mNextPacket++];
+	memcpy(buffer, packet.mData.data(), packet.mData.size());
+	sender = packet.mSender;
+	receiving_interface = LLHost();
+	return (S32)packet.mData.size();
+}
+
+//----------------------------------------------------------------------------
+
+LLMainloopBenchmark::LLMainloopBenchmark(U32 warmup_frames, U32 frames, F32 frame_seconds)
+:	mWarmupFrames(warmup_frames),
+	mFrames(frames),
+	mFrameSeconds(frame_seconds),
+	mFramesRun(0),
+	mClockFrames(0),
+	mRecorded(0),
+	mLastAllocations(getAllocationCount())
+{
+	mFrameTimes.reserve(frames);
+	mAllocations.reserve(frames);
+	mPackets.reserve(frames);
+	mPacketAllocations.reserve(frames);
+}
+
+//static
+U32 LLMainloopBenchmark::getAllocationCount()
+{
+#if LL_BENCHMARK_ALLOCATIONS
+	return sAllocations.CurrentValue();
+#else
+	return 0;
+#endif
+}
+
+//static
+bool LLMainloopBenchmark::countsAllocations()
+{
+#if LL_BENCHMARK_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool LLMainloopBenchmark::recordFrame(F32 frame_seconds, U32 packets, U32 packet_allocations)
+{
+	if (mRecorded >= mFrames)
+	{
+		return false;
+	}
+	mClockFrames++;
+	if (mFramesRun++ < mWarmupFrames)
+	{
+		mLastAllocations = getAllocationCount();
+		return true;
+	}
+
+	U32 allocations = getAllocationCount();
+	mFrameTimes.push_back(frame_seconds);
+	mAllocations.push_back(allocations - mLastAllocations);
+	mPackets.push_back(packets);
+	mPacketAllocations.push_back(packet_allocations);
+	collect(LLFastTimer::NamedTimer::getRootNamedTimer());
+	mRecorded++;
+	// Not counting what recording the frame allocated.
+	mLastAllocations = getAllocationCount();
+
+	// Timers that did not run this frame.
+	for (std::vector<std::vector<U32> >::iterator it = mTimerTicks.begin(); it != mTimerTicks.end(); ++it)
+	{
+		it->resize(mRecorded, 0);
+	}
+	return mRecorded < mFrames;
+}
+
+void LLMainloopBenchmark::collect(LLFastTimer::NamedTimer& timer)
+{
+	U32 ticks = timer.getHistoricalCount(0);
+	if (!ticks)
+	{
+		// Nothing below it ran either.
+		return;
+	}
+	std::vector<U32>& frames = mTimerTicks[getTimerIndex(&timer)];
+	frames.resize(mRecorded, 0);
+	frames.push_back(ticks);
+
+	std::vector<LLFastTimer::NamedTimer*>& children = timer.getChildren();
+	for (std::vector<LLFastTimer::NamedTimer*>::iterator it = children.begin(); it != children.end(); ++it)
+	{
+		collect(**it);
+	}
+}
+
+U32 LLMainloopBenchmark::getTimerIndex(LLFastTimer::NamedTimer* timer)
+{
+	std::map<LLFastTimer::NamedTimer*, U32>::iterator found = mTimerIndex.find(timer);
+	if (found != mTimerIndex.end())
+	{
+		return found->second;
+	}
+	U32 index = (U32)mTimers.size();
+	mTimerIndex[timer] = index;
+	mTimers.push_back(timer);
+	mTimerTicks.push_back(std::vector<U32>());
+	mTimerTicks.back().reserve(mFrames);
+	return index;
+}
+
+template <class T>
+static void write_row(LLFILE* file, const std::string& name, const std::string& parent, const char* unit,
+					  std::vector<T> values, F64 scale)
+{
+	if (values.empty())
+	{
+		return;
+	}
+	std::sort(values.begin(), values.end());
+	F64 total = 0.0;
+	for (typename std::vector<T>::const_iterator it = values.begin(); it != values.end(); ++it)
+	{
+		total += (F64)*it;
+	}
+	size_t count = values.size();
+	fprintf(file, "\"%s\",\"%s\",%s,%.4f,%.4f,%.4f,%.4f\n", name.c_str(), parent.c_str(), unit,
+			total * scale / (F64)count,
+			(F64)values[count / 2] * scale,
+			(F64)values[llmin(count * 95 / 100, count - 1)] * scale,
+			(F64)values.back() * scale);
+}
+
+bool LLMainloopBenchmark::writeReport(const std::string& filename) const
+{
+	LLFILE* file = LLFile::fopen(filename, "w");
+	if (!file)
+	{
+		LL_WARNS("Benchmark") << "Can't write benchmark report " << filename << LL_ENDL;
+		return false;
+	}
+
+	fprintf(file, "stage,parent,unit,mean,median,p95,max\n");
+	write_row(file, "Frame time", "", "ms", mFrameTimes, 1000.0);
+	if (countsAllocations())
+	{
+		write_row(file, "Allocations", "", "count", mAllocations, 1.0);
+	}
+	write_row(file, "Packets", "", "count", mPackets, 1.0);
+	write_row(file, "Packet allocations", "", "count", mPacketAllocations, 1.0);
+
+	const F64 ms_per_tick = 1000.0 / (F64)LLFastTimer::countsPerSecond();
+	for (U32 i = 0; i < mTimers.size(); ++i)
+	{
+		LLFastTimer::NamedTimer* parent = mTimers[i]->getParent();
+		write_row(file, mTimers[i]->getName(), (parent && parent != mTimers[i]) ? parent->getName() : std::string(),
+				  "ms", mTimerTicks[i], ms_per_tick);
+	}
+	fclose(file);
+
+	LL_INFOS("Benchmark") << "Wrote statistics for " << mRecorded << " frames to " << filename << LL_ENDL;
+	return true;
+}
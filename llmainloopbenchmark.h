@@ -0,0 +1,155 @@
+/**
+ * @file llmainloopbenchmark.h
+ * @brief Headless fixed clock benchmark of the main loop, and packet traces.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLMAINLOOPBENCHMARK_H
+#define LL_LLMAINLOOPBENCHMARK_H
+
+#include "llfasttimer.h"
+#include "llfile.h"
+#include "llhost.h"
+#include "llsd.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Received UDP packets with the frame they arrived in, so a session's
+// traffic can be fed back to the message system frame for frame.
+//
+// A trace starts with the login server's response and counts frames from
+// the viewer's first message to the region, so that a replay can log in
+// from the response without the login server and hand the region's
+// packets over only once it has a circuit for them, however long its own
+// login took. The response is stored without the secure session ID and
+// the seed capability, which a replay has no use for.
+//
+// Recording taps LLPacketRing (see LLPacketRing::setPacketTap()), replay
+// stands in for the socket (LLPacketRing::setPacketSource()). Both run on
+// the main thread, from checkAllMessages().
+class LLMessageTrace
+{
+public:
+	LLMessageTrace();
+	~LLMessageTrace();
+
+	bool openForRecording(const std::string& filename);
+	// Recording: writes the header. Packets before it are not recorded.
+	bool startSession(const LLSD& login_response);
+	bool load(const std::string& filename);
+
+	// Main thread, once per frame from the first message to the region on,
+	// before the network is checked.
+	void nextFrame()					{ mFrame++; }
+
+	// Packet tap: appends the packet to the file being recorded.
+	void record(const char* buffer, S32 size, const LLHost& sender);
+	// Packet source: the next packet received by the current frame, or 0
+	// once they have all been handed out. The receiving interface is not
+	// recorded.
+	S32 replay(char* buffer, LLHost& sender, LLHost& receiving_interface);
+
+	bool isRecording() const			{ return mRecordFile != NULL; }
+	bool isSessionStarted() const		{ return mSessionStarted; }
+	// Replay: the recorded login response.
+	const LLSD& getLoginResponse() const	{ return mLoginResponse; }
+	U32 getPacketCount() const			{ return (U32)mPackets.size(); }
+	U32 getReplayedCount() const		{ return mNextPacket; }
+	bool isFinished() const				{ return mNextPacket >= mPackets.size(); }
+
+private:
+	struct Packet
+	{
+		U32			mFrame;
+		LLHost		mSender;
+		std::string	mData;
+	};
+
+	LLFILE*				mRecordFile;
+	bool				mSessionStarted;
+	LLSD				mLoginResponse;
+	std::vector<Packet>	mPackets;
+	U32					mNextPacket;
+	U32					mFrame;
+};
+
+// Runs the main loop headless for a fixed number of frames, on a fixed
+// simulated clock and without sensors, optionally replaying a packet trace
+// instead of reading the network, then writes per-stage timing statistics
+// and leaves. With a trace, the viewer logs in from it and the warmup and
+// recorded frames start once the session has started, so they measure the
+// main loop in world rather than the login screen.
+//
+// Every fast timer is recorded every frame, so the report has the mean,
+// median, 95th percentile and worst frame for each stage. Heap allocations
+// per frame are counted in builds with LL_BENCHMARK_ALLOCATIONS, which
+// replaces the global operator new. The packet path counts its own in
+// every build, and should show none once warmed up.
+class LLMainloopBenchmark
+{
+public:
+	// The first 'warmup_frames' run but are not recorded.
+	LLMainloopBenchmark(U32 warmup_frames, U32 frames, F32 frame_seconds);
+
+	// Main thread, once per frame after LLFastTimer::nextFrame(). Returns
+	// false once the last frame has been recorded. 'packet_allocations' are
+	// those made receiving and queueing the frame's packets.
+	bool recordFrame(F32 frame_seconds, U32 packets, U32 packet_allocations);
+	// Instead of recordFrame() for frames that are not part of the run,
+	// such as a replayed session's login. They only move the clock on.
+	void skipFrame()					{ mClockFrames++; }
+
+	// The simulated clock.
+	F32 getFrameSeconds() const			{ return mFrameSeconds; }
+	F32 getElapsedSeconds() const		{ return mFrameSeconds * (F32)mClockFrames; }
+
+	// CSV: one row per stage, plus frame time, allocations and packets.
+	bool writeReport(const std::string& filename) const;
+
+	// Heap allocations since startup, 0 without LL_BENCHMARK_ALLOCATIONS.
+	static U32 getAllocationCount();
+	static bool countsAllocations();
+
+private:
+	void collect(LLFastTimer::NamedTimer& timer);
+	U32 getTimerIndex(LLFastTimer::NamedTimer* timer);
+
+	U32											mWarmupFrames;
+	U32											mFrames;
+	F32											mFrameSeconds;
+	U32											mFramesRun;
+	U32											mClockFrames;
+	U32											mRecorded;
+	U32											mLastAllocations;
+	std::vector<F32>							mFrameTimes;
+	std::vector<U32>							mAllocations;
+	std::vector<U32>							mPackets;
+	std::vector<U32>							mPacketAllocations;
+	std::map<LLFastTimer::NamedTimer*, U32>		mTimerIndex;
+	std::vector<LLFastTimer::NamedTimer*>		mTimers;
+	std::vector<std::vector<U32> >				mTimerTicks;	// [timer][frame]
+};
+
+#endif
@@ -0,0 +1,141 @@
+/**
+ * @file llmessagecostmodel.cpp
+ * @brief Learned per-message-type handling costs for the message budget.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llmessagecostmodel.h"
+
+#include <algorithm>
+#include <vector>
+
+// Weight of each new sample in the moving averages.
+static const F32 COST_SMOOTHING = 0.1f;
+// Before anything has been measured.
+static const F32 INITIAL_COST = 0.0001f;
+static const S32 REPORT_TYPES = 20;
+
+LLMessageCostModel::LLMessageCostModel()
+:	mAverage(INITIAL_COST),
+	mUnknownDeferred(0)
+{ }
+
+const char* LLMessageCostModel::getName(U32 message_number) const
+{
+	if (!message_number)
+	{
+		return NULL;
+	}
+	std::map<U32, const char*>::const_iterator found = mNames.find(message_number);
+	return found != mNames.end() ? found->second : NULL;
+}
+
+F32 LLMessageCostModel::predict(const char* name) const
+{
+	if (name)
+	{
+		cost_map_t::const_iterator found = mCosts.find(name);
+		if (found != mCosts.end())
+		{
+			return found->second.mAverage;
+		}
+	}
+	return mAverage;
+}
+
+void LLMessageCostModel::admitted(U32 message_number, const char* name, F32 seconds)
+{
+	mAverage = lerp(mAverage, seconds, COST_SMOOTHING);
+	if (!name)
+	{
+		return;
+	}
+	if (message_number)
+	{
+		// A number is looked up before the message is handled, so it is only
+		// right if the message handled was the one expected; the packet ring
+		// can replace a packet it decides to drop or delay.
+		mNames[message_number] = name;
+	}
+
+	cost_map_t::iterator found = mCosts.find(name);
+	if (found == mCosts.end())
+	{
+		Cost cost;
+		cost.mAverage = seconds;
+		cost.mMax = seconds;
+		cost.mAdmitted = 1;
+		cost.mDeferred = 0;
+		mCosts[name] = cost;
+		return;
+	}
+	Cost& cost = found->second;
+	cost.mAverage = lerp(cost.mAverage, seconds, COST_SMOOTHING);
+	cost.mMax = llmax(cost.mMax, seconds);
+	cost.mAdmitted++;
+}
+
+void LLMessageCostModel::deferred(const char* name)
+{
+	cost_map_t::iterator found = name ? mCosts.find(name) : mCosts.end();
+	if (found != mCosts.end())
+	{
+		found->second.mDeferred++;
+	}
+	else
+	{
+		mUnknownDeferred++;
+	}
+}
+
+// Most deferred first, then most time spent on the type.
+template <class COST>
+static bool worse_cost(const std::pair<const char*, const COST*>& a, const std::pair<const char*, const COST*>& b)
+{
+	if (a.second->mDeferred != b.second->mDeferred)
+	{
+		return a.second->mDeferred > b.second->mDeferred;
+	}
+	return a.second->mAverage * a.second->mAdmitted > b.second->mAverage * b.second->mAdmitted;
+}
+
+void LLMessageCostModel::logReport() const
+{
+	std::vector<std::pair<const char*, const Cost*> > order;
+	for (cost_map_t::const_iterator it = mCosts.begin(); it != mCosts.end(); ++it)
+	{
+		order.push_back(std::make_pair(it->first, &it->second));
+	}
+	std::sort(order.begin(), order.end(), worse_cost<Cost>);
+
+	LL_INFOS("MessageCost") << "Messages deferred before their type was known: " << mUnknownDeferred << LL_ENDL;
+	S32 count = llmin((S32)order.size(), REPORT_TYPES);
+	for (S32 i = 0; i < count; ++i)
+	{
+		const Cost& cost = *order[i].second;
+		LL_INFOS("MessageCost") << order[i].first << ": " << cost.mAdmitted << " admitted, " << cost.mDeferred << " deferred, "
+			<< llformat("%.3f", cost.mAverage * 1000.f) << " ms average, " << llformat("%.3f", cost.mMax * 1000.f) << " ms max" << LL_ENDL;
+	}
+}
@@ -0,0 +1,81 @@
+/**
+ * @file llmessagecostmodel.h
+ * @brief Learned per-message-type handling costs for the message budget.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLMESSAGECOSTMODEL_H
+#define LL_LLMESSAGECOSTMODEL_H
+
+#include "llsingleton.h"
+
+#include <map>
+
+// What handling one message of each type costs, learned as a moving
+// average of the time checkAllMessages() took for it, so idleNetwork() can
+// stop before the message that would overrun its budget rather than after
+// it.
+//
+// Types are keyed by the template name checkAllMessages() leaves behind,
+// which is interned and so stable. The next message's type is known before
+// it is handled only when the receive thread has it queued (see
+// LLPacketReceiver::peekMessageNumber()); its message number is mapped to
+// a name the first time a message with that number is handled. Unknown
+// types are predicted at the average of all messages.
+//
+// Main thread only.
+class LLMessageCostModel : public LLSingleton<LLMessageCostModel>
+{
+public:
+	LLMessageCostModel();
+
+	// NULL if no message with this number has been handled yet.
+	const char* getName(U32 message_number) const;
+	// Expected seconds to handle a message of this type; 'name' may be NULL.
+	F32 predict(const char* name) const;
+
+	// A message was handled. 'message_number' is 0 if it was not known.
+	void admitted(U32 message_number, const char* name, F32 seconds);
+	// The next message was left for the next frame.
+	void deferred(const char* name);
+
+	// The types that were deferred or cost the most, worst first.
+	void logReport() const;
+
+private:
+	struct Cost
+	{
+		F32		mAverage;	// seconds
+		F32		mMax;
+		U32		mAdmitted;
+		U32		mDeferred;
+	};
+	typedef std::map<const char*, Cost> cost_map_t;
+
+	cost_map_t					mCosts;
+	std::map<U32, const char*>	mNames;
+	F32							mAverage;	// over every message
+	U32							mUnknownDeferred;
+};
+
+#endif
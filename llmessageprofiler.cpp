@@ -0,0 +1,192 @@
+/**
+ * @file llmessageprofiler.cpp
+ * @brief Per message type counts, bytes and handling time histograms.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llmessageprofiler.h"
+
+#include "llfile.h"
+
+#include <algorithm>
+#include <vector>
+
+template <class COUNTERS>
+static bool more_time(const std::pair<const char*, const COUNTERS*>& a, const std::pair<const char*, const COUNTERS*>& b)
+{
+	return a.second->mMicroseconds > b.second->mMicroseconds;
+}
+
+LLMessageProfiler::LLMessageProfiler()
+:	mCSVStarted(false)
+{ }
+
+LLMessageProfiler::Counters& LLMessageProfiler::getCounters(const char* name)
+{
+	counter_map_t::iterator found = mCounters.find(name);
+	if (found == mCounters.end())
+	{
+		Counters counters;
+		memset(&counters, 0, sizeof(counters));
+		found = mCounters.insert(std::make_pair(name, counters)).first;
+	}
+	return found->second;
+}
+
+void LLMessageProfiler::record(const char* name, S32 bytes, U64 microseconds)
+{
+	if (!name)
+	{
+		return;
+	}
+	Counters& counters = getCounters(name);
+	counters.mCount++;
+	counters.mBytes += bytes;
+	counters.mMicroseconds += microseconds;
+	counters.mMaxMicroseconds = llmax(counters.mMaxMicroseconds, microseconds);
+
+	S32 bucket = 0;
+	for (U64 bound = 2; bucket < BUCKET_COUNT - 1 && microseconds >= bound; bound <<= 1)
+	{
+		++bucket;
+	}
+	counters.mBuckets[bucket]++;
+}
+
+void LLMessageProfiler::addTime(const char* name, U64 microseconds)
+{
+	if (name && microseconds)
+	{
+		getCounters(name).mMicroseconds += microseconds;
+	}
+}
+
+//static
+U64 LLMessageProfiler::getPercentile(const Counters& counters, F32 fraction)
+{
+	U32 target = (U32)(fraction * (F32)counters.mCount);
+	U32 seen = 0;
+	for (S32 i = 0; i < BUCKET_COUNT - 1; ++i)
+	{
+		seen += counters.mBuckets[i];
+		if (seen > target)
+		{
+			return llmin((U64)2 << i, counters.mMaxMicroseconds);
+		}
+	}
+	return counters.mMaxMicroseconds;
+}
+
+void LLMessageProfiler::setCSVFile(const std::string& filename)
+{
+	mCSVFile = filename;
+	mCSVStarted = false;
+}
+
+void LLMessageProfiler::setRegion(const std::string& region)
+{
+	if (region != mRegion)
+	{
+		writeCSV();
+		mRegion = region;
+	}
+}
+
+void LLMessageProfiler::writeCSV()
+{
+	if (mCSVFile.empty() || mCounters.empty())
+	{
+		mCounters.clear();
+		return;
+	}
+
+	LLFILE* file = LLFile::fopen(mCSVFile, mCSVStarted ? "a" : "w");
+	if (!file)
+	{
+		LL_WARNS("MessageProfile") << "Can't write message profile " << mCSVFile << LL_ENDL;
+		mCounters.clear();
+		return;
+	}
+	if (!mCSVStarted)
+	{
+		fprintf(file, "region,message,count,bytes,total_ms,mean_us,median_us,p95_us,max_us");
+		for (S32 i = 0; i < BUCKET_COUNT - 1; ++i)
+		{
+			fprintf(file, ",under_%uus", 2U << i);
+		}
+		fprintf(file, ",over_%uus", 2U << (BUCKET_COUNT - 2));
+		fprintf(file, "\n");
+		mCSVStarted = true;
+	}
+
+	std::vector<std::pair<const char*, const Counters*> > order;
+	for (counter_map_t::const_iterator it = mCounters.begin(); it != mCounters.end(); ++it)
+	{
+		order.push_back(std::make_pair(it->first, &it->second));
+	}
+	std::sort(order.begin(), order.end(), more_time<Counters>);
+
+	for (U32 i = 0; i < order.size(); ++i)
+	{
+		const Counters& counters = *order[i].second;
+		fprintf(file, "\"%s\",%s,%u,%llu,%.3f,%.1f,%llu,%llu,%llu",
+				mRegion.c_str(), order[i].first, counters.mCount, (unsigned long long)counters.mBytes,
+				(F64)counters.mMicroseconds / 1000.0,
+				counters.mCount ? (F64)counters.mMicroseconds / (F64)counters.mCount : 0.0,
+				(unsigned long long)getPercentile(counters, 0.5f), (unsigned long long)getPercentile(counters, 0.95f),
+				(unsigned long long)counters.mMaxMicroseconds);
+		for (S32 b = 0; b < BUCKET_COUNT; ++b)
+		{
+			fprintf(file, ",%u", counters.mBuckets[b]);
+		}
+		fprintf(file, "\n");
+	}
+	fclose(file);
+	mCounters.clear();
+}
+
+LLSD LLMessageProfiler::getStatsLLSD(S32 max_types) const
+{
+	std::vector<std::pair<const char*, const Counters*> > order;
+	for (counter_map_t::const_iterator it = mCounters.begin(); it != mCounters.end(); ++it)
+	{
+		order.push_back(std::make_pair(it->first, &it->second));
+	}
+	std::sort(order.begin(), order.end(), more_time<Counters>);
+
+	LLSD stats = LLSD::emptyMap();
+	S32 count = llmin((S32)order.size(), max_types);
+	for (S32 i = 0; i < count; ++i)
+	{
+		const Counters& counters = *order[i].second;
+		LLSD& type = stats[order[i].first];
+		type["count"] = (S32)counters.mCount;
+		type["bytes"] = (F64)counters.mBytes;
+		type["total_ms"] = (F64)counters.mMicroseconds / 1000.0;
+		type["p95_us"] = (F64)getPercentile(counters, 0.95f);
+		type["max_us"] = (F64)counters.mMaxMicroseconds;
+	}
+	return stats;
+}
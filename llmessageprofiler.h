@@ -0,0 +1,88 @@
+/**
+ * @file llmessageprofiler.h
+ * @brief Per message type counts, bytes and handling time histograms.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLMESSAGEPROFILER_H
+#define LL_LLMESSAGEPROFILER_H
+
+#include "llsd.h"
+#include "llsingleton.h"
+
+#include <map>
+
+// Always on counters for every message type idleNetwork() handles: how
+// many, how many bytes, and a histogram of the time each took. Types are
+// keyed by the interned template name, like LLMessageCostModel.
+//
+// Counters are kept per region the agent is in. With a CSV file set,
+// leaving a region appends its rows to the file, so one session gives the
+// message mix of every region visited; the region being left when the
+// viewer quits is written by writeCSV().
+//
+// Main thread only.
+class LLMessageProfiler : public LLSingleton<LLMessageProfiler>
+{
+public:
+	// Bucket 0 is under 2 us, bucket n up to 2^(n + 1) us, and the last
+	// one everything from 32 ms.
+	enum { BUCKET_COUNT = 16 };
+
+	LLMessageProfiler();
+
+	void record(const char* name, S32 bytes, U64 microseconds);
+	// Time spent on a type outside its own messages, as applying queued
+	// object updates is. Not a message, so not in the histogram.
+	void addTime(const char* name, U64 microseconds);
+
+	void setCSVFile(const std::string& filename);
+	void setRegion(const std::string& region);
+	// Appends the current region's rows and starts it over.
+	void writeCSV();
+
+	// The 'max_types' types that took the most time, for the viewer stats.
+	LLSD getStatsLLSD(S32 max_types) const;
+
+private:
+	struct Counters
+	{
+		U32		mCount;
+		U64		mBytes;
+		U64		mMicroseconds;
+		U64		mMaxMicroseconds;
+		U32		mBuckets[BUCKET_COUNT];
+	};
+	typedef std::map<const char*, Counters> counter_map_t;
+
+	Counters& getCounters(const char* name);
+	// Upper bound in microseconds of the bucket holding the fraction.
+	static U64 getPercentile(const Counters& counters, F32 fraction);
+
+	counter_map_t	mCounters;
+	std::string		mRegion;
+	std::string		mCSVFile;
+	bool			mCSVStarted;	// header written this session
+};
+
+#endif
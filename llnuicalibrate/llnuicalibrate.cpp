@@ -0,0 +1,442 @@
+/**
+ * @file llnuicalibrate.cpp
+ * @brief Fits the nui gesture tracker thresholds to labelled recordings.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+// Usage:
+//   llnuicalibrate [options] <session> [<session> ...]
+//
+// Each session is a recording of skeleton frames labelled with what the
+// user intended to do (see LLNuiSession), either as text or as a viewer
+// .nrec recording. The tool runs the same gesture
+// graph the viewer uses over every frame and searches the tracker slider
+// positions for the set that best reproduces the labels, one tracker at a
+// time, evaluating all positions of that tracker in parallel. The result is
+// written as an LLSD tracker file the viewer loads from NuiTrackerFile.
+
+#include "linden_common.h"
+#include "llapr.h"
+#include "llatomic.h"
+#include "llerrorcontrol.h"
+#include "llthread.h"
+
+#include "llnuioffline.h"
+#include "llnuirecording.h"
+#include "llnuiskeleton.h"
+#include "llnuitrackers.h"
+
+#include <iomanip>
+#include <iostream>
+#include <boost/thread.hpp>
+
+static const char USAGE[] = "\n"
+"usage:\tllnuicalibrate [options] <session> [<session> ...]\n"
+"\n"
+" -o, --output <file>\n"
+"        Tracker file to write (default nui_trackers.xml).\n"
+" -i, --input <file>\n"
+"        Tracker file to start the search from (default: built in defaults).\n"
+" -t, --threads <n>\n"
+"        Worker threads (default: one per core).\n"
+" -s, --sweeps <n>\n"
+"        Maximum passes over all trackers (default 8).\n"
+" -w, --fn-weight <f>\n"
+"        Cost of a missed gesture relative to a spurious one (default 1.0).\n"
+"\n";
+
+// Per-gesture confusion counts over a set of frames.
+struct LLGestureScore
+{
+	LLGestureScore() { reset(); }
+
+	void reset()
+	{
+		memset(mTruePositives, 0, sizeof(mTruePositives));
+		memset(mFalsePositives, 0, sizeof(mFalsePositives));
+		memset(mFalseNegatives, 0, sizeof(mFalseNegatives));
+		memset(mTrueNegatives, 0, sizeof(mTrueNegatives));
+	}
+
+	void add(U32 expected, U32 detected)
+	{
+		for (S32 i = 0; i < NUI_INTENT_COUNT; ++i)
+		{
+			bool want = (expected & (1 << i)) != 0;
+			bool got = (detected & (1 << i)) != 0;
+			if (want)
+			{
+				got ? ++mTruePositives[i] : ++mFalseNegatives[i];
+			}
+			else
+			{
+				got ? ++mFalsePositives[i] : ++mTrueNegatives[i];
+			}
+		}
+	}
+
+	F64 cost(F32 fn_weight) const
+	{
+		F64 cost = 0.0;
+		for (S32 i = 0; i < NUI_INTENT_COUNT; ++i)
+		{
+			cost += mFalsePositives[i] + fn_weight * mFalseNegatives[i];
+		}
+		return cost;
+	}
+
+	F32 falsePositiveRate(S32 i) const
+	{
+		U32 negatives = mFalsePositives[i] + mTrueNegatives[i];
+		return negatives ? (F32)mFalsePositives[i] / negatives : 0.f;
+	}
+
+	F32 falseNegativeRate(S32 i) const
+	{
+		U32 positives = mTruePositives[i] + mFalseNegatives[i];
+		return positives ? (F32)mFalseNegatives[i] / positives : 0.f;
+	}
+
+	U32 mTruePositives[NUI_INTENT_COUNT];
+	U32 mFalsePositives[NUI_INTENT_COUNT];
+	U32 mFalseNegatives[NUI_INTENT_COUNT];
+	U32 mTrueNegatives[NUI_INTENT_COUNT];
+};
+
+typedef std::vector<LLNuiSkeletonFrame> frame_list_t;
+
+static void score_trackers(const frame_list_t& frames, const LLNuiTrackerSet& trackers, LLGestureScore& score)
+{
+	score.reset();
+	for (frame_list_t::const_iterator it = frames.begin(); it != frames.end(); ++it)
+	{
+		score.add(it->mIntents, nui_detect_intents(*it, trackers));
+	}
+}
+
+//----------------------------------------------------------------------------
+// Scores batches of candidate tracker sets on a fixed set of worker threads.
+
+class LLCalibrationPool
+{
+public:
+	LLCalibrationPool(const frame_list_t& frames, S32 threads);
+	~LLCalibrationPool();
+
+	// Blocks until every candidate has been scored.
+	void score(const std::vector<LLNuiTrackerSet>& candidates, std::vector<LLGestureScore>& scores);
+
+private:
+	class Worker : public LLThread
+	{
+	public:
+		Worker(LLCalibrationPool* pool) : LLThread("nui calibration"), mPool(pool) {}
+		/*virtual*/ void run()	{ mPool->workerLoop(); }
+	private:
+		LLCalibrationPool* mPool;
+	};
+	friend class Worker;
+
+	void workerLoop();
+
+	const frame_list_t&						mFrames;
+	std::vector<Worker*>					mWorkers;
+	LLCondition								mCondition;
+	U32										mGeneration;	// bumped for each batch, guarded by mCondition
+	S32										mIdleWorkers;	// guarded by mCondition
+	bool									mQuit;			// guarded by mCondition
+	const std::vector<LLNuiTrackerSet>*		mCandidates;
+	std::vector<LLGestureScore>*			mScores;
+	LLAtomicS32								mNext;
+};
+
+LLCalibrationPool::LLCalibrationPool(const frame_list_t& frames, S32 threads)
+:	mFrames(frames),
+	mCondition(NULL),
+	mGeneration(0),
+	mIdleWorkers(0),
+	mQuit(false),
+	mCandidates(NULL),
+	mScores(NULL)
+{
+	mNext = 0;
+	for (S32 i = 0; i < threads; ++i)
+	{
+		mWorkers.push_back(new Worker(this));
+		mWorkers.back()->start();
+	}
+}
+
+LLCalibrationPool::~LLCalibrationPool()
+{
+	mCondition.lock();
+	mQuit = true;
+	mCondition.broadcast();
+	mCondition.unlock();
+
+	for (std::vector<Worker*>::iterator it = mWorkers.begin(); it != mWorkers.end(); ++it)
+	{
+		while (!(*it)->isStopped())
+		{
+			ms_sleep(1);
+		}
+		delete *it;
+	}
+}
+
+void LLCalibrationPool::score(const std::vector<LLNuiTrackerSet>& candidates, std::vector<LLGestureScore>& scores)
+{
+	scores.resize(candidates.size());
+
+	mCondition.lock();
+	mCandidates = &candidates;
+	mScores = &scores;
+	mNext = 0;
+	mIdleWorkers = 0;
+	++mGeneration;
+	mCondition.broadcast();
+	while (mIdleWorkers < (S32)mWorkers.size())
+	{
+		mCondition.wait();
+	}
+	mCandidates = NULL;
+	mScores = NULL;
+	mCondition.unlock();
+}
+
+void LLCalibrationPool::workerLoop()
+{
+	U32 generation = 0;
+	while (true)
+	{
+		mCondition.lock();
+		while (!mQuit && generation == mGeneration)
+		{
+			mCondition.wait();
+		}
+		if (mQuit)
+		{
+			mCondition.unlock();
+			return;
+		}
+		generation = mGeneration;
+		const std::vector<LLNuiTrackerSet>& candidates = *mCandidates;
+		std::vector<LLGestureScore>& scores = *mScores;
+		mCondition.unlock();
+
+		// Each candidate is written by exactly one worker, so the scores
+		// need no locking.
+		S32 count = (S32)candidates.size();
+		for (S32 index = mNext++; index < count; index = mNext++)
+		{
+			score_trackers(mFrames, candidates[index], scores[index]);
+		}
+
+		mCondition.lock();
+		++mIdleWorkers;
+		mCondition.broadcast();
+		mCondition.unlock();
+	}
+}
+
+//----------------------------------------------------------------------------
+
+static void print_report(const char* title, const LLGestureScore& score)
+{
+	std::cout << title << "\n";
+	std::cout << "  " << std::left << std::setw(12) << "gesture"
+			  << std::right << std::setw(10) << "frames" << std::setw(10) << "FP rate" << std::setw(10) << "FN rate" << "\n";
+	for (S32 i = 0; i < NUI_INTENT_COUNT; ++i)
+	{
+		std::cout << "  " << std::left << std::setw(12) << nui_intent_name(i)
+				  << std::right << std::setw(10) << (score.mTruePositives[i] + score.mFalseNegatives[i])
+				  << std::fixed << std::setprecision(3)
+				  << std::setw(10) << score.falsePositiveRate(i)
+				  << std::setw(10) << score.falseNegativeRate(i) << "\n";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string output_file("nui_trackers.xml");
+	std::string input_file;
+	S32 threads = llmax((S32)boost::thread::hardware_concurrency(), 1);
+	S32 max_sweeps = 8;
+	F32 fn_weight = 1.f;
+	std::vector<std::string> session_files;
+
+	for (int arg = 1; arg < argc; ++arg)
+	{
+		std::string option(argv[arg]);
+		bool has_value = (arg + 1 < argc);
+		if ((option == "-o" || option == "--output") && has_value)
+		{
+			output_file = argv[++arg];
+		}
+		else if ((option == "-i" || option == "--input") && has_value)
+		{
+			input_file = argv[++arg];
+		}
+		else if ((option == "-t" || option == "--threads") && has_value)
+		{
+			threads = llmax(atoi(argv[++arg]), 1);
+		}
+		else if ((option == "-s" || option == "--sweeps") && has_value)
+		{
+			max_sweeps = llmax(atoi(argv[++arg]), 1);
+		}
+		else if ((option == "-w" || option == "--fn-weight") && has_value)
+		{
+			fn_weight = (F32)atof(argv[++arg]);
+		}
+		else if (!option.empty() && option[0] == '-')
+		{
+			std::cerr << USAGE;
+			return 1;
+		}
+		else
+		{
+			session_files.push_back(option);
+		}
+	}
+
+	if (session_files.empty())
+	{
+		std::cerr << USAGE;
+		return 1;
+	}
+
+	LLError::initForApplication(".");
+	LLError::setDefaultLevel(LLError::LEVEL_WARN);
+	ll_init_apr();
+
+	frame_list_t frames;
+	for (std::vector<std::string>::const_iterator it = session_files.begin(); it != session_files.end(); ++it)
+	{
+		const std::string& filename = *it;
+		bool loaded = false;
+		if (filename.size() > 5 && filename.compare(filename.size() - 5, 5, ".nrec") == 0)
+		{
+			LLNuiRecordingReader reader;
+			loaded = reader.open(filename) && reader.readAll(frames);
+		}
+		else
+		{
+			LLNuiSession session;
+			loaded = session.loadText(filename);
+			frames.insert(frames.end(), session.getFrames().begin(), session.getFrames().end());
+		}
+		if (!loaded)
+		{
+			std::cerr << "Skipping unreadable session " << filename << "\n";
+		}
+	}
+	if (frames.empty())
+	{
+		std::cerr << "No frames to calibrate against.\n";
+		return 1;
+	}
+
+	LLNuiTrackerSet best;
+	if (!input_file.empty() && !best.loadFromFile(input_file))
+	{
+		std::cerr << "Unable to read " << input_file << ", starting from defaults.\n";
+	}
+
+	LLGestureScore best_score;
+	score_trackers(frames, best, best_score);
+	const LLGestureScore start_score = best_score;
+	F64 best_cost = best_score.cost(fn_weight);
+
+	std::cout << frames.size() << " frames from " << session_files.size() << " sessions, "
+			  << threads << " threads, starting cost " << best_cost << "\n";
+
+	{
+		LLCalibrationPool pool(frames, threads);
+		std::vector<LLNuiTrackerSet> candidates;
+		std::vector<LLGestureScore> scores;
+
+		// Coordinate descent: for each tracker try every slider position with
+		// the others held fixed and keep the cheapest. Ties keep the current
+		// position so the result is deterministic and stays close to the
+		// hand-tuned values when the recordings don't constrain a tracker.
+		for (S32 sweep = 0; sweep < max_sweeps; ++sweep)
+		{
+			bool improved = false;
+			for (S32 tracker = 0; tracker < NUI_TRACKER_COUNT; ++tracker)
+			{
+				const LLNuiTrackerDef& def = LLNuiTrackerSet::getDef(tracker);
+				candidates.assign(def.mMax + 1, best);
+				for (S32 position = 0; position <= def.mMax; ++position)
+				{
+					candidates[position].setPosition(tracker, position);
+				}
+
+				pool.score(candidates, scores);
+
+				S32 best_position = best.getPosition(tracker);
+				for (S32 position = 0; position <= def.mMax; ++position)
+				{
+					F64 cost = scores[position].cost(fn_weight);
+					if (cost < best_cost)
+					{
+						best_cost = cost;
+						best_position = position;
+					}
+				}
+
+				if (best_position != best.getPosition(tracker))
+				{
+					best.setPosition(tracker, best_position);
+					best_score = scores[best_position];
+					improved = true;
+				}
+			}
+
+			std::cout << "sweep " << sweep + 1 << ": cost " << best_cost << "\n";
+			if (!improved)
+			{
+				break;
+			}
+		}
+	}
+
+	print_report("Before:", start_score);
+	print_report("After:", best_score);
+
+	std::cout << "Tracker positions:\n";
+	for (S32 tracker = 0; tracker < NUI_TRACKER_COUNT; ++tracker)
+	{
+		const LLNuiTrackerDef& def = LLNuiTrackerSet::getDef(tracker);
+		std::cout << "  " << std::left << std::setw(16) << def.mName
+				  << std::right << std::setw(4) << best.getPosition(tracker)
+				  << "  (default " << def.mDefault << ")\n";
+	}
+
+	if (!best.saveToFile(output_file))
+	{
+		return 1;
+	}
+	std::cout << "Wrote " << output_file << "\n";
+	return 0;
+}
@@ -0,0 +1,271 @@
+/**
+ * @file llnuigesturegraph.h
+ * @brief The nui gesture graph, shared by the live sensor path and the
+ * offline tools.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLNUIGESTUREGRAPH_H
+#define LL_LLNUIGESTUREGRAPH_H
+
+#include "llnuiskeleton.h"
+#include "llnuitrackers.h"
+
+#ifndef M_PI
+#define M_PI 3.14159
+#endif
+
+const float R2DEG = (180 / (float) M_PI);
+
+// The gestures that drive the avatar, written once against a SOURCE that
+// provides the Vector/Scalar/Condition types and the joint(), tracker() and
+// constant() inputs.
+//
+// With NuiLib types (LLNuiLiveSource) build() wires up NuiLib's lazily
+// evaluated graph once. With the plain float types in llnuioffline.h
+// build() evaluates one recorded frame, which is what the calibration tool
+// uses. The maths functions are found by argument dependent lookup, so the
+// same expressions work for both.
+template <class SOURCE>
+class LLNuiGestureGraph
+{
+public:
+	typedef typename SOURCE::Vector		Vector;
+	typedef typename SOURCE::Scalar		Scalar;
+	typedef typename SOURCE::Condition	Condition;
+
+	void build(SOURCE& source);
+
+	//--Move--
+	//True if any of the movement conditions are met.
+	Condition	mCanMove;
+	//True if the user should be pushed forward.
+	Condition	mPush;
+	//True if yawing right or left.
+	Condition	mCanYaw;
+	//How far left or right to yaw (- = yaw left).
+	Scalar		mYaw;
+	//True if pitching up or down.
+	Condition	mCanPitch;
+	//How far up or down to pitch.
+	Scalar		mPitch;
+	//True if flying up or down
+	Condition	mCanFly;
+	//True if flying up, false if flying down.
+	Condition	mFly;
+};
+
+// One evaluation of the graph's outputs, whichever source produced them.
+struct LLNuiGestureState
+{
+	LLNuiGestureState()
+	:	mCanMove(false), mPush(false), mCanYaw(false), mYaw(0.f),
+		mCanPitch(false), mPitch(0.f), mCanFly(false), mFly(false)
+	{ }
+
+	template <class GRAPH>
+	void sample(const GRAPH& graph)
+	{
+		mCanMove = *graph.mCanMove;
+		mPush = *graph.mPush;
+		mCanYaw = *graph.mCanYaw;
+		mYaw = *graph.mYaw;
+		mCanPitch = *graph.mCanPitch;
+		mPitch = *graph.mPitch;
+		mCanFly = *graph.mCanFly;
+		mFly = *graph.mFly;
+	}
+
+	// The intents this state would trigger, in the same terms as
+	// LLNuiSkeletonFrame::mIntents.
+	U32 getIntents() const
+	{
+		U32 intents = NUI_INTENT_NONE;
+		if (!mCanMove)
+		{
+			return intents;
+		}
+		if (mPush)
+		{
+			intents |= NUI_INTENT_PUSH;
+		}
+		if (mCanYaw && mYaw != 0.f)
+		{
+			intents |= (mYaw > 0.f) ? NUI_INTENT_YAW_RIGHT : NUI_INTENT_YAW_LEFT;
+		}
+		if (mCanPitch && mPitch != 0.f)
+		{
+			intents |= (mPitch > 0.f) ? NUI_INTENT_PITCH_UP : NUI_INTENT_PITCH_DOWN;
+		}
+		if (mCanFly)
+		{
+			intents |= mFly ? NUI_INTENT_FLY_UP : NUI_INTENT_FLY_DOWN;
+		}
+		return intents;
+	}
+
+	bool	mCanMove;
+	bool	mPush;
+	bool	mCanYaw;
+	F32		mYaw;
+	bool	mCanPitch;
+	F32		mPitch;
+	bool	mCanFly;
+	bool	mFly;
+};
+
+template <class SOURCE>
+void LLNuiGestureGraph<SOURCE>::build(SOURCE& source)
+{
+	//Get the primary vectors.
+	Vector shoulderR = source.joint(NUI_JOINT_SHOULDER_RIGHT);
+	Vector shoulderL = source.joint(NUI_JOINT_SHOULDER_LEFT);
+	Vector elbowR = source.joint(NUI_JOINT_ELBOW_RIGHT);
+	Vector elbowL = source.joint(NUI_JOINT_ELBOW_LEFT);
+	Vector wristR = source.joint(NUI_JOINT_WRIST_RIGHT);
+	Vector wristL = source.joint(NUI_JOINT_WRIST_LEFT);
+	Vector handR = source.joint(NUI_JOINT_HAND_RIGHT);
+	Vector handL = source.joint(NUI_JOINT_HAND_LEFT);
+	Vector hipC = source.joint(NUI_JOINT_HIP_CENTER);
+	Vector head = source.joint(NUI_JOINT_HEAD);
+
+	Vector yAxis = source.constant("Y", 0.f, 1.f, 0.f);
+	// Normal is the direction the camera is facing.
+	Vector normal = source.constant("Normal", 0.f, 0.f, 1.f);
+
+	//Camera - If the right elbow is raised to be in line with the shoulders the camera is active.
+	Vector upperArmCameraR = elbowR - shoulderR;
+	Vector lowerArmCameraR = elbowR - wristR;
+	Condition cameraActiveR = abs(x(upperArmCameraR)) > (abs(y(upperArmCameraR)) + abs(z(upperArmCameraR))) * 2.f;
+
+	//Camera - If the right elbow is raised to be in line with the shoulders the camera is active.
+	Vector upperArmCameraL = shoulderL - elbowL;
+	Vector lowerArmCameraL = elbowL - wristL;
+	Condition cameraActiveL = abs(x(upperArmCameraL)) > (abs(y(upperArmCameraL)) + abs(z(upperArmCameraL))) * 2.f;
+
+	Condition cameraActive = cameraActiveL || cameraActiveR;
+
+	//Pitch
+	Scalar pitchArmD = source.tracker(NUI_TRACKER_PITCH_ARM_D);
+	Scalar pitchArmR = source.tracker(NUI_TRACKER_PITCH_ARM_R);
+	Scalar pitchArmG = source.tracker(NUI_TRACKER_PITCH_ARM_G);
+	Scalar pitchAS = source.tracker(NUI_TRACKER_PITCH_AS);
+
+	Vector vPlaneCameraR = limit(lowerArmCameraR, false, true, true);
+	Vector vPlaneCameraL = limit(lowerArmCameraL, false, true, true);
+	// Pitch is the angle between normal and the vertical component of the vector between right shoulder and right hand.
+	Scalar pitchR = acos(dot(normalize(vPlaneCameraR), normal)) * invert(x(cross(normal, vPlaneCameraR)) >= 0);
+	Scalar pitchL = acos(dot(normalize(vPlaneCameraL), normal)) * invert(x(cross(normal, vPlaneCameraL)) >= 0);
+	// Constrain the pitch value by 3 values input by 3 trackers.
+	pitchR = constrain(pitchR * R2DEG, pitchArmD, pitchArmR, pitchArmG, true) / pitchAS;
+	pitchL = constrain(pitchL * R2DEG, pitchArmD, pitchArmR, pitchArmG, true) / pitchAS;
+	mPitch = ifScalar(cameraActiveR, pitchR, .0f) + ifScalar(cameraActiveL, pitchL, .0f);
+
+	mCanPitch = cameraActive && mPitch != 0.f;
+
+	//Yaw - Yaw has 3 components. The camera arm. The horizontal lean (head vs hip centre) and the twist of the shoulders.
+	Scalar yawArmD = source.tracker(NUI_TRACKER_YAW_ARM_D);
+	Scalar yawArmR = source.tracker(NUI_TRACKER_YAW_ARM_R);
+	Scalar yawArmG = source.tracker(NUI_TRACKER_YAW_ARM_G);
+	Scalar yawAS = source.tracker(NUI_TRACKER_YAW_AS);
+	Scalar yawLeanD = source.tracker(NUI_TRACKER_YAW_LEAN_D);
+	Scalar yawLeanR = source.tracker(NUI_TRACKER_YAW_LEAN_R);
+	Scalar yawLeanG = source.tracker(NUI_TRACKER_YAW_LEAN_G);
+	Scalar yawTwistD = source.tracker(NUI_TRACKER_YAW_TWIST_D);
+	Scalar yawTwistR = source.tracker(NUI_TRACKER_YAW_TWIST_R);
+	Scalar yawTwistG = source.tracker(NUI_TRACKER_YAW_TWIST_G);
+
+	Vector hPlaneCameraR = limit(lowerArmCameraR, true, false, true);
+	Vector hPlaneCameraL = limit(lowerArmCameraL, true, false, true);
+	// Yaw component 1 is the angle between normal and the horizontal component of the vector between right shoulder and right hand.
+	Scalar yawCameraR = acos(dot(normalize(hPlaneCameraR), normal)) * invert(y(cross(normal, hPlaneCameraR)) >= 0);
+	Scalar yawCameraL = acos(dot(normalize(hPlaneCameraL), normal)) * invert(y(cross(normal, hPlaneCameraL)) >= 0);
+	// Constrain the component value by 3 values input by 3 trackers.
+	yawCameraR = constrain(yawCameraR * R2DEG, yawArmD, yawArmR, yawArmG, true) / yawAS;
+	yawCameraL = constrain(yawCameraL * R2DEG, yawArmD, yawArmR, yawArmG, true) / yawAS;
+	//Only take the value if camera is active
+	yawCameraR = ifScalar(cameraActiveR, yawCameraR, .0f);
+	yawCameraL = ifScalar(cameraActiveL, yawCameraL, .0f);
+
+	Vector yawCore = limit(head - hipC, true, true, false);
+	// Yaw component 2 is how far the user is leaning horizontally. This is calculated the angle between vertical and the vector between the hip centre and the head.
+	Scalar yawLean = acos(dot(normalize(yawCore), yAxis)) * invert(z(cross(yawCore, yAxis)) >= 0);
+	// Constrain the component value by 3 values input by 3 trackers.
+	yawLean = constrain(yawLean * R2DEG, yawLeanD, yawLeanR, yawLeanG, true) / source.tracker(NUI_TRACKER_YAW_LS);
+
+	Vector shoulderDiff = shoulderR - shoulderL;
+	// Yaw component 3 is the twist of the shoulders. This is calculated as the difference between the two z values.
+	Scalar yawTwist = z(shoulderDiff) / magnitude(shoulderDiff);
+	// Constrain the component value by 3 values input by 3 trackers.
+	yawTwist = constrain(yawTwist, yawTwistD, yawTwistR, yawTwistG, true) / source.tracker(NUI_TRACKER_YAW_TS);
+
+	// Combine all 3 components into the final yaw value.
+	mYaw = yawCameraR + yawCameraL + yawLean + yawTwist;
+	mCanYaw = (cameraActive && (yawCameraR + yawCameraL) != 0.f) || yawLean != 0.f || yawTwist != 0.f;
+
+	Scalar flyUpD = source.tracker(NUI_TRACKER_FLY_UP_D);
+	Scalar flyUpR = source.tracker(NUI_TRACKER_FLY_UP_R);
+	Scalar flyDownD = source.tracker(NUI_TRACKER_FLY_DOWN_D);
+	Scalar flyDownR = source.tracker(NUI_TRACKER_FLY_DOWN_R);
+
+	//Fly
+	Vector armR = shoulderR - handR;
+	Vector vPlaneR = limit(armR, false, true, true);
+	// The angle between normal and the vector between the shoulder and the hand.
+	Scalar flyR = acos(dot(normalize(vPlaneR), normal));
+	// Constrain the positive angle to go up past vertical.
+	Scalar upR = constrain(flyR * R2DEG, flyUpD, flyUpR, 0.f, true); //Constraints if R is raised
+	// Constrain the negative angle to stop before vertical so that hands lying by the side doesn't trigger flying down.
+	Scalar downR = constrain(flyR * R2DEG, flyDownD, flyDownR, 0.f, true); //Constraints if R is lowered
+	// Whether the arm is raised or lowered.
+	Condition dirR = x(cross(normal, vPlaneR)) >= 0;
+	// Whether R is in range to fly
+	Condition flyCondR = (magnitude(vPlaneR) > 0.f) && ((dirR && (upR > 0)) || ((!dirR) && (downR > 0)));
+
+	Vector armL = shoulderL - handL;
+	Vector vPlaneL = limit(armL, false, true, true);
+	// The angle between normal and the vector between the shoulder and the hand.
+	Scalar flyL = acos(dot(normalize(vPlaneL), normal)) * R2DEG;
+	// Constrain the positive angle to go up past vertical.
+	Scalar upL = constrain(flyL, flyUpD, flyUpR, 0.f, true); //Constraints if L is raised
+	// Constrain the negative angle to stop before vertical so that hands lying by the side doesn't trigger flying down.
+	Scalar downL = constrain(flyL, flyDownD, flyDownR, 0.f, true); //Constraints if L is lowered
+	// Whether the arm is raised or lowered.
+	Condition dirL = x(cross(normal, vPlaneL)) >= 0;
+	// Whether L is in range to fly
+	Condition flyCondL = magnitude(vPlaneL) > 0.f && (dirL && upL > 0.f) || (!dirL && downL > 0.f);
+
+	//Up trumps down
+	mFly = (dirR && flyCondR) || (dirL && flyCondL);
+	// Fly if camera is inactive and flying with right or left arm
+	mCanFly = (flyCondR && !cameraActiveR) || (flyCondL && !cameraActiveL);
+
+	Scalar pushThresh = source.tracker(NUI_TRACKER_PUSH_THRESHOLD);
+	Condition pushR = z(shoulderR) - z(handR) > pushThresh;
+	Condition pushL = z(shoulderL) - z(handL) > pushThresh;
+	mPush = (pushR && !cameraActiveR) || (pushL && !cameraActiveL);
+
+	mCanMove = mPush || mCanYaw || mCanPitch || mCanFly;
+}
+
+#endif
@@ -0,0 +1,220 @@
+/**
+ * @file llnuiheadtracker.cpp
+ * @brief Head look from a face detector run on the sensor's colour stream.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llnuiheadtracker.h"
+
+#include "lltimer.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+// Kinect colour camera at 640x480. Close enough for predicting a window;
+// the residual offset is absorbed by the tracked mean.
+static const F32 COLOUR_FOCAL_640 = 525.f;
+// Typical face width in metres.
+static const F32 FACE_WIDTH = .16f;
+// Search window side, in expected face widths.
+static const F32 WINDOW_FACES = 2.5f;
+// The face detector runs on the window scaled so the face is about this wide.
+static const F32 DETECT_FACE_PIXELS = 40.f;
+// How long a detection stays valid, and how quickly the resting pose is learnt.
+static const F64 FACE_TIMEOUT = .5;
+static const F32 MEAN_TIME_CONSTANT = 10.f;
+
+class LLNuiHeadTrackerThread : public LLThread
+{
+public:
+	LLNuiHeadTrackerThread(LLNuiHeadTracker* tracker)
+	:	LLThread("nui head tracker"),
+		mTracker(tracker)
+	{ }
+
+	// Sleep in checkPause() until a window is pending.
+	/*virtual*/ bool runCondition()
+	{
+		return mTracker->mPending.CurrentValue() != 0;
+	}
+
+	/*virtual*/ void run()
+	{
+		while (!isQuitting())
+		{
+			checkPause();
+			if (isQuitting())
+			{
+				break;
+			}
+			mTracker->process();
+		}
+	}
+
+private:
+	LLNuiHeadTracker* mTracker;
+};
+
+LLNuiHeadTracker::LLNuiHeadTracker()
+:	mThread(NULL),
+	mFaceSize(0.f),
+	mTime(0.0),
+	mResultMutex(NULL),
+	mYaw(0.f),
+	mPitch(0.f),
+	mMeanYaw(0.f),
+	mMeanPitch(0.f),
+	mLastFaceTime(0.0),
+	mLastResultTime(0.0)
+{
+	mPending = 0;
+}
+
+LLNuiHeadTracker::~LLNuiHeadTracker()
+{
+	stop();
+}
+
+bool LLNuiHeadTracker::start(const std::string& cascade_file)
+{
+	stop();
+
+	if (!mCascade.load(cascade_file))
+	{
+		LL_WARNS("Nui") << "Unable to load face cascade " << cascade_file << LL_ENDL;
+		return false;
+	}
+
+	mPending = 0;
+	mThread = new LLNuiHeadTrackerThread(this);
+	mThread->start();
+	LL_INFOS("Nui") << "Head look started" << LL_ENDL;
+	return true;
+}
+
+void LLNuiHeadTracker::stop()
+{
+	if (mThread)
+	{
+		mThread->shutdown();
+		delete mThread;
+		mThread = NULL;
+	}
+}
+
+bool LLNuiHeadTracker::submitFrame(const cv::Mat& colour, const F32 head[3], F64 time)
+{
+	// The worker owns the window until it clears mPending.
+	if (!mThread || mPending.CurrentValue() || colour.empty() || head[2] <= .1f)
+	{
+		return false;
+	}
+
+	// Project the head joint into the colour frame.
+	F32 focal = COLOUR_FOCAL_640 * (F32)colour.cols / 640.f;
+	F32 u = (F32)colour.cols * .5f + focal * head[0] / head[2];
+	F32 v = (F32)colour.rows * .5f - focal * head[1] / head[2];
+	F32 face_size = focal * FACE_WIDTH / head[2];
+
+	S32 side = llround(face_size * WINDOW_FACES);
+	cv::Rect window(llround(u) - side / 2, llround(v) - side / 2, side, side);
+	window &= cv::Rect(0, 0, colour.cols, colour.rows);
+	if (window.width < side / 2 || window.height < side / 2)
+	{
+		// Head is at the edge of the frame.
+		return false;
+	}
+
+	// Copy only the window, scaled down to what the detector needs, so the
+	// caller's cost is independent of the colour resolution.
+	F32 scale = llmin(DETECT_FACE_PIXELS / face_size, 1.f);
+	cv::resize(colour(window), mWindow, cv::Size(), scale, scale, cv::INTER_AREA);
+	mHeadPixel = cv::Point2f((u - (F32)window.x) * scale, (v - (F32)window.y) * scale);
+	mFaceSize = face_size * scale;
+	mTime = time;
+
+	mPending = 1;
+	mThread->wake();
+	return true;
+}
+
+void LLNuiHeadTracker::process()
+{
+	cv::Mat grey;
+	if (mWindow.channels() == 1)
+	{
+		grey = mWindow;
+	}
+	else
+	{
+		cv::cvtColor(mWindow, grey, mWindow.channels() == 4 ? CV_BGRA2GRAY : CV_BGR2GRAY);
+	}
+	cv::equalizeHist(grey, grey);
+
+	std::vector<cv::Rect> faces;
+	S32 min_size = llround(mFaceSize * .6f);
+	S32 max_size = llround(mFaceSize * 1.6f);
+	mCascade.detectMultiScale(grey, faces, 1.1, 3, CV_HAAR_FIND_BIGGEST_OBJECT,
+							  cv::Size(min_size, min_size), cv::Size(max_size, max_size));
+
+	if (!faces.empty())
+	{
+		const cv::Rect& face = faces[0];
+		F32 yaw = ((F32)face.x + (F32)face.width * .5f - mHeadPixel.x) / (F32)face.width;
+		F32 pitch = (mHeadPixel.y - ((F32)face.y + (F32)face.height * .5f)) / (F32)face.height;
+
+		LLMutexLock lock(&mResultMutex);
+		if (mLastResultTime == 0.0)
+		{
+			mMeanYaw = yaw;
+			mMeanPitch = pitch;
+		}
+		else
+		{
+			F32 dt = (F32)llclamp(mTime - mLastResultTime, 0.0, 1.0);
+			F32 blend = dt / MEAN_TIME_CONSTANT;
+			mMeanYaw += (yaw - mMeanYaw) * blend;
+			mMeanPitch += (pitch - mMeanPitch) * blend;
+		}
+		mYaw = yaw - mMeanYaw;
+		mPitch = pitch - mMeanPitch;
+		mLastFaceTime = mTime;
+		mLastResultTime = mTime;
+	}
+
+	mPending = 0;
+}
+
+bool LLNuiHeadTracker::getLook(F32& yaw, F32& pitch) const
+{
+	LLMutexLock lock(&mResultMutex);
+	if (mLastFaceTime == 0.0 || LLTimer::getTotalSeconds() - mLastFaceTime > FACE_TIMEOUT)
+	{
+		yaw = pitch = 0.f;
+		return false;
+	}
+	yaw = mYaw;
+	pitch = mPitch;
+	return true;
+}
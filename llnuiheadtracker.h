@@ -0,0 +1,95 @@
+/**
+ * @file llnuiheadtracker.h
+ * @brief Head look from a face detector run on the sensor's colour stream.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLNUIHEADTRACKER_H
+#define LL_LLNUIHEADTRACKER_H
+
+#include "llatomic.h"
+#include "llmutex.h"
+#include "llthread.h"
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+
+class LLNuiHeadTrackerThread;
+
+// Estimates where the user is looking from the position of their face
+// within the head region of the colour image.
+//
+// The skeleton's HEAD joint predicts a small window of the colour frame
+// and only that window is copied and handed to a single worker thread,
+// which runs a frontal face cascade on it. A frontal detector's box moves
+// towards the nose as the head turns, so the offset of the face from the
+// head joint, in face widths, is a usable look signal. Its slowly tracked
+// mean is subtracted so the user's resting pose and the offset between the
+// depth and colour cameras read as straight ahead.
+//
+// submitFrame() drops the frame if the worker is still busy, so the caller
+// never waits and at most one window is ever queued.
+class LLNuiHeadTracker
+{
+public:
+	LLNuiHeadTracker();
+	~LLNuiHeadTracker();
+
+	bool start(const std::string& cascade_file);
+	void stop();
+	bool isRunning() const		{ return mThread != NULL; }
+
+	// 'head' is the HEAD joint in sensor space (metres). Returns false if
+	// the frame was skipped.
+	bool submitFrame(const cv::Mat& colour, const F32 head[3], F64 time);
+
+	// Look offsets, positive to the right and up, roughly in face widths.
+	// Returns false if there has been no face for a while.
+	bool getLook(F32& yaw, F32& pitch) const;
+
+private:
+	friend class LLNuiHeadTrackerThread;
+
+	// Worker thread.
+	void process();
+
+	LLNuiHeadTrackerThread*	mThread;
+	cv::CascadeClassifier	mCascade;
+
+	// Handed from the submitter to the worker, guarded by mPending.
+	cv::Mat					mWindow;
+	cv::Point2f				mHeadPixel;	// predicted head centre within mWindow
+	F32						mFaceSize;	// expected face width in pixels
+	F64						mTime;
+	LLAtomicU32				mPending;
+
+	mutable LLMutex			mResultMutex;
+	F32						mYaw;
+	F32						mPitch;
+	F32						mMeanYaw;
+	F32						mMeanPitch;
+	F64						mLastFaceTime;
+	F64						mLastResultTime;
+};
+
+#endif
@@ -0,0 +1,227 @@
+/**
+ * @file llnuioffline.h
+ * @brief Plain float stand-ins for the NuiLib types, used to evaluate the
+ * gesture graph on recorded skeleton frames.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLNUIOFFLINE_H
+#define LL_LLNUIOFFLINE_H
+
+#include "llnuigesturegraph.h"
+
+#include <cmath>
+
+// Each function here mirrors the NuiLib function of the same name, but
+// computes its result immediately instead of building an observable node.
+namespace LLNuiOffline
+{
+	struct Scalar
+	{
+		Scalar(F32 value = 0.f) : mValue(value) {}
+		F32 operator*() const { return mValue; }
+		F32 mValue;
+	};
+
+	struct Condition
+	{
+		Condition(bool value = false) : mValue(value) {}
+		bool operator*() const { return mValue; }
+		bool mValue;
+	};
+
+	struct Vector
+	{
+		Vector(F32 x = 0.f, F32 y = 0.f, F32 z = 0.f) { mV[0] = x; mV[1] = y; mV[2] = z; }
+		F32 mV[3];
+	};
+
+	inline Scalar operator+(const Scalar& a, const Scalar& b)	{ return Scalar(a.mValue + b.mValue); }
+	inline Scalar operator-(const Scalar& a, const Scalar& b)	{ return Scalar(a.mValue - b.mValue); }
+	inline Scalar operator*(const Scalar& a, const Scalar& b)	{ return Scalar(a.mValue * b.mValue); }
+	// NuiLib treats division by zero as zero rather than producing inf/nan.
+	inline Scalar operator/(const Scalar& a, const Scalar& b)	{ return Scalar(b.mValue == 0.f ? 0.f : a.mValue / b.mValue); }
+
+	inline Condition operator>(const Scalar& a, const Scalar& b)	{ return Condition(a.mValue > b.mValue); }
+	inline Condition operator>=(const Scalar& a, const Scalar& b)	{ return Condition(a.mValue >= b.mValue); }
+	inline Condition operator<(const Scalar& a, const Scalar& b)	{ return Condition(a.mValue < b.mValue); }
+	inline Condition operator<=(const Scalar& a, const Scalar& b)	{ return Condition(a.mValue <= b.mValue); }
+	inline Condition operator==(const Scalar& a, const Scalar& b)	{ return Condition(a.mValue == b.mValue); }
+	inline Condition operator!=(const Scalar& a, const Scalar& b)	{ return Condition(a.mValue != b.mValue); }
+
+	inline Condition operator&&(const Condition& a, const Condition& b)	{ return Condition(a.mValue && b.mValue); }
+	inline Condition operator||(const Condition& a, const Condition& b)	{ return Condition(a.mValue || b.mValue); }
+	inline Condition operator!(const Condition& a)						{ return Condition(!a.mValue); }
+
+	inline Vector operator-(const Vector& a, const Vector& b)
+	{
+		return Vector(a.mV[0] - b.mV[0], a.mV[1] - b.mV[1], a.mV[2] - b.mV[2]);
+	}
+
+	inline Scalar x(const Vector& v)	{ return Scalar(v.mV[0]); }
+	inline Scalar y(const Vector& v)	{ return Scalar(v.mV[1]); }
+	inline Scalar z(const Vector& v)	{ return Scalar(v.mV[2]); }
+
+	inline Scalar abs(const Scalar& a)	{ return Scalar(fabsf(a.mValue)); }
+
+	// Clamped so that rounding error on unit vectors cannot produce nan.
+	inline Scalar acos(const Scalar& a)	{ return Scalar(acosf(llclamp(a.mValue, -1.f, 1.f))); }
+
+	inline Scalar dot(const Vector& a, const Vector& b)
+	{
+		return Scalar(a.mV[0] * b.mV[0] + a.mV[1] * b.mV[1] + a.mV[2] * b.mV[2]);
+	}
+
+	inline Vector cross(const Vector& a, const Vector& b)
+	{
+		return Vector(a.mV[1] * b.mV[2] - a.mV[2] * b.mV[1],
+					  a.mV[2] * b.mV[0] - a.mV[0] * b.mV[2],
+					  a.mV[0] * b.mV[1] - a.mV[1] * b.mV[0]);
+	}
+
+	inline Scalar magnitude(const Vector& v)
+	{
+		return Scalar(sqrtf(v.mV[0] * v.mV[0] + v.mV[1] * v.mV[1] + v.mV[2] * v.mV[2]));
+	}
+
+	// A zero length vector normalizes to zero.
+	inline Vector normalize(const Vector& v)
+	{
+		F32 mag = *magnitude(v);
+		if (mag == 0.f)
+		{
+			return Vector();
+		}
+		return Vector(v.mV[0] / mag, v.mV[1] / mag, v.mV[2] / mag);
+	}
+
+	// Keeps only the components whose flag is set.
+	inline Vector limit(const Vector& v, bool keep_x, bool keep_y, bool keep_z)
+	{
+		return Vector(keep_x ? v.mV[0] : 0.f, keep_y ? v.mV[1] : 0.f, keep_z ? v.mV[2] : 0.f);
+	}
+
+	// -1 when the condition holds, 1 otherwise.
+	inline Scalar invert(const Condition& c)	{ return Scalar(c.mValue ? -1.f : 1.f); }
+
+	inline Scalar ifScalar(const Condition& c, const Scalar& if_true, const Scalar& if_false)
+	{
+		return c.mValue ? if_true : if_false;
+	}
+
+	// Maps |value| in [deadzone, deadzone + range] onto [0, 1]. Values past
+	// the range stay at 1 for another 'grace' units and then drop back to 0.
+	// If mirror is set negative input is handled symmetrically, otherwise it
+	// is always 0.
+	inline Scalar constrain(const Scalar& value, const Scalar& deadzone, const Scalar& range, const Scalar& grace, bool mirror)
+	{
+		F32 v = value.mValue;
+		if (v < 0.f && !mirror)
+		{
+			return Scalar(0.f);
+		}
+		F32 mag = fabsf(v) - deadzone.mValue;
+		if (mag <= 0.f || mag > range.mValue + grace.mValue || range.mValue <= 0.f)
+		{
+			return Scalar(0.f);
+		}
+		F32 out = llmin(mag / range.mValue, 1.f);
+		return Scalar(v < 0.f ? -out : out);
+	}
+}
+
+// Feeds one recorded frame and a tracker set into LLNuiGestureGraph.
+class LLNuiOfflineSource
+{
+public:
+	typedef LLNuiOffline::Vector	Vector;
+	typedef LLNuiOffline::Scalar	Scalar;
+	typedef LLNuiOffline::Condition	Condition;
+
+	LLNuiOfflineSource(const LLNuiSkeletonFrame& frame, const LLNuiTrackerSet& trackers)
+	:	mFrame(frame),
+		mTrackers(trackers)
+	{ }
+
+	Vector joint(S32 joint) const
+	{
+		const F32* pos = mFrame.mJoints[joint];
+		return Vector(pos[0], pos[1], pos[2]);
+	}
+	Scalar tracker(S32 tracker) const							{ return Scalar(mTrackers.getValue(tracker)); }
+	Vector constant(const char* name, F32 x, F32 y, F32 z) const	{ return Vector(x, y, z); }
+
+private:
+	const LLNuiSkeletonFrame&	mFrame;
+	const LLNuiTrackerSet&		mTrackers;
+};
+
+typedef LLNuiGestureGraph<LLNuiOfflineSource> LLNuiOfflineGraph;
+
+// Builds the graph on an empty frame, noting which joints it reads.
+class LLNuiJointUsageSource : public LLNuiOfflineSource
+{
+public:
+	LLNuiJointUsageSource(const LLNuiSkeletonFrame& frame, const LLNuiTrackerSet& trackers)
+	:	LLNuiOfflineSource(frame, trackers),
+		mJointMask(0)
+	{ }
+
+	Vector joint(S32 joint)
+	{
+		mJointMask |= 1 << joint;
+		return LLNuiOfflineSource::joint(joint);
+	}
+
+	U32 getJointMask() const	{ return mJointMask; }
+
+private:
+	U32		mJointMask;
+};
+
+// The joints the gesture graph depends on. Anything else the sensor tracks
+// can be left out of capture, recording and filtering.
+inline U32 nui_gesture_joint_mask()
+{
+	LLNuiSkeletonFrame frame;
+	LLNuiTrackerSet trackers;
+	LLNuiJointUsageSource source(frame, trackers);
+	LLNuiGestureGraph<LLNuiJointUsageSource> graph;
+	graph.build(source);
+	return source.getJointMask();
+}
+
+// Evaluates the gesture graph on a frame and returns the intents it would
+// have triggered, in the same terms as LLNuiSkeletonFrame::mIntents.
+inline U32 nui_detect_intents(const LLNuiSkeletonFrame& frame, const LLNuiTrackerSet& trackers)
+{
+	LLNuiOfflineSource source(frame, trackers);
+	LLNuiOfflineGraph graph;
+	graph.build(source);
+
+	LLNuiGestureState state;
+	state.sample(graph);
+	return state.getIntents();
+}
+
+#endif
@@ -0,0 +1,883 @@
+/**
+ * @file llnuirecording.cpp
+ * @brief Compact, seekable recordings of nui skeleton sessions.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llnuirecording.h"
+
+#include "llthread.h"
+#include "lltimer.h"
+
+#include <algorithm>
+
+static const U32 NREC_MAGIC_HEADER	= 0x4345524E;	// "NREC"
+static const U32 NREC_MAGIC_BLOCK	= 0x4B42524E;	// "NRBK"
+static const U32 NREC_MAGIC_INDEX	= 0x5849524E;	// "NRIX"
+static const U32 NREC_MAGIC_END		= 0x4E45524E;	// "NREN"
+
+// Frame times are stored as ticks from the start of their block.
+static const F64 TICKS_PER_SECOND = 10000.0;
+
+// Rice coding: unary quotients of this length or more escape to a raw
+// 32 bit value, which bounds the worst case size of a frame.
+static const U32 RICE_ESCAPE = 24;
+static const U32 RICE_MAX_K = 20;
+// Keyframe positions are absolute, so they use a fixed, wide parameter.
+static const U32 KEYFRAME_K = 12;
+static const U32 MAX_FRAME_BYTES = ((NUI_JOINT_COUNT * 3 + 1) * (RICE_ESCAPE + 32) + 8) / 8 + 8;
+
+static inline U32 zigzag(S32 value)		{ return ((U32)value << 1) ^ (U32)(value >> 31); }
+static inline S32 unzigzag(U32 value)	{ return (S32)(value >> 1) ^ -(S32)(value & 1); }
+
+template <class T>
+static bool write_value(LLFILE* file, const T& value)
+{
+	return fwrite(&value, sizeof(T), 1, file) == 1;
+}
+
+template <class T>
+static bool read_value(LLFILE* file, T& value)
+{
+	return fread(&value, sizeof(T), 1, file) == 1;
+}
+
+//----------------------------------------------------------------------------
+// Bit level coding
+
+class LLNuiBitWriter
+{
+public:
+	void reset(U8* data, U32 capacity)
+	{
+		mData = data;
+		mCapacity = capacity;
+		mBytes = 0;
+		mAccum = 0;
+		mBits = 0;
+	}
+
+	// count <= 24
+	void putBits(U32 value, U32 count)
+	{
+		mAccum |= (U64)(value & ((1u << count) - 1)) << mBits;
+		mBits += count;
+		while (mBits >= 8)
+		{
+			mData[mBytes++] = (U8)mAccum;
+			mAccum >>= 8;
+			mBits -= 8;
+		}
+	}
+
+	void putRice(U32 value, U32 k)
+	{
+		U32 quotient = value >> k;
+		if (quotient < RICE_ESCAPE)
+		{
+			putBits((1u << quotient) - 1, quotient);
+			putBits(0, 1);
+			putBits(value, k);
+		}
+		else
+		{
+			putBits((1u << RICE_ESCAPE) - 1, RICE_ESCAPE);
+			putBits(value & 0xFFFF, 16);
+			putBits(value >> 16, 16);
+		}
+	}
+
+	U32 flush()
+	{
+		if (mBits)
+		{
+			mData[mBytes++] = (U8)mAccum;
+			mAccum = 0;
+			mBits = 0;
+		}
+		return mBytes;
+	}
+
+	// Room left, counting bits not yet flushed as used.
+	U32 getFreeBytes() const	{ return mCapacity - mBytes - 1; }
+
+private:
+	U8*		mData;
+	U32		mCapacity;
+	U32		mBytes;
+	U64		mAccum;
+	U32		mBits;
+};
+
+class LLNuiBitReader
+{
+public:
+	void reset(const U8* data, U32 size)
+	{
+		mData = data;
+		mSize = size;
+		mPos = 0;
+		mAccum = 0;
+		mBits = 0;
+		mOverrun = false;
+	}
+
+	U32 getBits(U32 count)
+	{
+		while (mBits < count)
+		{
+			U64 byte = 0;
+			if (mPos < mSize)
+			{
+				byte = mData[mPos++];
+			}
+			else
+			{
+				mOverrun = true;
+			}
+			mAccum |= byte << mBits;
+			mBits += 8;
+		}
+		U32 value = (U32)(mAccum & ((1u << count) - 1));
+		mAccum >>= count;
+		mBits -= count;
+		return value;
+	}
+
+	U32 getRice(U32 k)
+	{
+		U32 quotient = 0;
+		while (quotient < RICE_ESCAPE && getBits(1))
+		{
+			++quotient;
+		}
+		if (quotient == RICE_ESCAPE)
+		{
+			U32 low = getBits(16);
+			return low | (getBits(16) << 16);
+		}
+		return (quotient << k) | getBits(k);
+	}
+
+	bool overrun() const	{ return mOverrun; }
+
+private:
+	const U8*	mData;
+	U32			mSize;
+	U32			mPos;
+	U64			mAccum;
+	U32			mBits;
+	bool		mOverrun;
+};
+
+// Adaptive Rice parameter for one value stream, in the style of LOCO-I:
+// k is the smallest value with count << k >= sum of recent magnitudes.
+struct LLNuiChannel
+{
+	void reset()
+	{
+		mPrev = 0;
+		// A small prior so the first deltas after a keyframe code cheaply.
+		mCount = 4;
+		mSum = 16;
+	}
+
+	U32 getK() const
+	{
+		U32 k = 0;
+		while ((mCount << k) < mSum && k < RICE_MAX_K)
+		{
+			++k;
+		}
+		return k;
+	}
+
+	void update(U32 magnitude)
+	{
+		mSum += magnitude;
+		if (++mCount >= 64)
+		{
+			mSum >>= 1;
+			mCount >>= 1;
+		}
+	}
+
+	S32		mPrev;
+	U32		mSum;
+	U32		mCount;
+};
+
+struct LLNuiCodecState
+{
+	void reset()
+	{
+		for (S32 joint = 0; joint < NUI_JOINT_COUNT; ++joint)
+		{
+			for (S32 axis = 0; axis < 3; ++axis)
+			{
+				mJoints[joint][axis].reset();
+			}
+		}
+		mTime.reset();
+		mIntents = NUI_INTENT_NONE;
+	}
+
+	LLNuiChannel	mJoints[NUI_JOINT_COUNT][3];
+	LLNuiChannel	mTime;
+	U32				mIntents;
+};
+
+//----------------------------------------------------------------------------
+// LLNuiRecorder
+
+struct LLNuiRecorder::Block
+{
+	enum { CAPACITY = 64 * 1024 };
+
+	void reset()
+	{
+		mWriter.reset(mData, CAPACITY);
+		mState.reset();
+		mBytes = 0;
+		mFrameCount = 0;
+		mStartTime = 0.0;
+		mEndTime = 0.0;
+	}
+
+	U8				mData[CAPACITY];
+	LLNuiBitWriter	mWriter;
+	LLNuiCodecState	mState;
+	U32				mBytes;
+	U32				mFrameCount;
+	F64				mStartTime;
+	F64				mEndTime;
+};
+
+class LLNuiRecorderThread : public LLThread
+{
+public:
+	LLNuiRecorderThread(LLNuiRecorder* recorder)
+	:	LLThread("nui recorder"),
+		mRecorder(recorder)
+	{ }
+
+	/*virtual*/ void run()
+	{
+		while (!isQuitting())
+		{
+			mRecorder->writeFilledBlocks();
+			ms_sleep(20);
+		}
+	}
+
+private:
+	LLNuiRecorder* mRecorder;
+};
+
+LLNuiRecorder::LLNuiRecorder()
+:	mFile(NULL),
+	mThread(NULL),
+	mJointMask(NUI_ALL_JOINTS),
+	mKeyframeInterval(2.f),
+	mQuantum(.001f),
+	mBlocks(NULL),
+	mCurrent(NULL)
+{
+	mFrameCount = 0;
+	mDroppedFrames = 0;
+	mClosing = 0;
+	mInAddFrame = 0;
+}
+
+LLNuiRecorder::~LLNuiRecorder()
+{
+	close();
+}
+
+bool LLNuiRecorder::open(const std::string& filename, U32 joint_mask, F32 keyframe_interval, F32 quantum)
+{
+	close();
+
+	// Keep a concurrent addFrame() out until everything below is set up.
+	mClosing = 1;
+
+	mFile = LLFile::fopen(filename, "wb");
+	if (!mFile)
+	{
+		LL_WARNS("Nui") << "Unable to create nui recording " << filename << LL_ENDL;
+		return false;
+	}
+
+	mFilename = filename;
+	mJointMask = joint_mask & NUI_ALL_JOINTS;
+	mKeyframeInterval = llmax(keyframe_interval, .1f);
+	mQuantum = llmax(quantum, .0001f);
+
+	write_value(mFile, NREC_MAGIC_HEADER);
+	write_value(mFile, NUI_RECORDING_VERSION);
+	write_value(mFile, mJointMask);
+	write_value(mFile, mQuantum);
+	write_value(mFile, mKeyframeInterval);
+
+	// Everything the acquisition thread will ever need is allocated here.
+	mBlocks = new Block[NUM_BLOCKS];
+	for (S32 i = 0; i < NUM_BLOCKS; ++i)
+	{
+		mBlocks[i].reset();
+		mFreeBlocks.push(&mBlocks[i]);
+	}
+	mIndex.clear();
+	mIndex.reserve(1024);
+	mCurrent = NULL;
+	mFrameCount = 0;
+	mDroppedFrames = 0;
+
+	mThread = new LLNuiRecorderThread(this);
+	mThread->start();
+	mClosing = 0;
+
+	LL_INFOS("Nui") << "Recording nui session to " << filename << LL_ENDL;
+	return true;
+}
+
+void LLNuiRecorder::close()
+{
+	if (!mFile)
+	{
+		return;
+	}
+
+	// Stop the producer: once mClosing is set any new addFrame() returns
+	// immediately, and waiting for mInAddFrame to drain covers one that was
+	// already running. Both are atomic increments, so they are ordered.
+	mClosing++;
+	while (mInAddFrame.CurrentValue() != 0)
+	{
+		ms_sleep(1);
+	}
+
+	// The current block now belongs to this thread.
+	if (mCurrent)
+	{
+		submitBlock();
+	}
+
+	mThread->shutdown();
+	delete mThread;
+	mThread = NULL;
+
+	writeFilledBlocks();
+
+	U64 index_offset = (U64)ftell(mFile);
+	write_value(mFile, NREC_MAGIC_INDEX);
+	write_value(mFile, (U32)mIndex.size());
+	for (std::vector<LLNuiRecordingIndexEntry>::const_iterator it = mIndex.begin(); it != mIndex.end(); ++it)
+	{
+		write_value(mFile, it->mStartTime);
+		write_value(mFile, it->mEndTime);
+		write_value(mFile, it->mOffset);
+	}
+	write_value(mFile, index_offset);
+	write_value(mFile, NREC_MAGIC_END);
+
+	fclose(mFile);
+	mFile = NULL;
+
+	LL_INFOS("Nui") << "Closed nui recording " << mFilename << ": " << mFrameCount.CurrentValue()
+					<< " frames, " << mDroppedFrames.CurrentValue() << " dropped" << LL_ENDL;
+
+	delete[] mBlocks;
+	mBlocks = NULL;
+	mFreeBlocks = block_ring_t();
+	mFilledBlocks = block_ring_t();
+}
+
+void LLNuiRecorder::addFrame(const LLNuiSkeletonFrame& frame)
+{
+	mInAddFrame++;
+	if (mClosing.CurrentValue() || !mFile)
+	{
+		mInAddFrame--;
+		return;
+	}
+
+	if (mCurrent
+		&& (frame.mTime - mCurrent->mStartTime >= mKeyframeInterval
+			|| mCurrent->mWriter.getFreeBytes() < MAX_FRAME_BYTES))
+	{
+		submitBlock();
+	}
+
+	if (!mCurrent)
+	{
+		if (!mFreeBlocks.pop(mCurrent))
+		{
+			// The writer has fallen behind. Never wait on it here.
+			mCurrent = NULL;
+			mDroppedFrames++;
+			mInAddFrame--;
+			return;
+		}
+		startBlock(frame);
+	}
+	else
+	{
+		LLNuiBitWriter& writer = mCurrent->mWriter;
+		LLNuiCodecState& state = mCurrent->mState;
+
+		S32 tick = llround((F32)((frame.mTime - mCurrent->mStartTime) * TICKS_PER_SECOND));
+		U32 time_delta = (U32)llmax(tick - state.mTime.mPrev, 0);
+		writer.putRice(time_delta, state.mTime.getK());
+		state.mTime.update(time_delta);
+		state.mTime.mPrev += (S32)time_delta;
+
+		if (frame.mIntents != state.mIntents)
+		{
+			writer.putBits(1, 1);
+			writer.putBits(frame.mIntents, NUI_INTENT_COUNT);
+			state.mIntents = frame.mIntents;
+		}
+		else
+		{
+			writer.putBits(0, 1);
+		}
+
+		for (S32 joint = 0; joint < NUI_JOINT_COUNT; ++joint)
+		{
+			if (!(mJointMask & (1 << joint)))
+			{
+				continue;
+			}
+			for (S32 axis = 0; axis < 3; ++axis)
+			{
+				LLNuiChannel& channel = state.mJoints[joint][axis];
+				S32 value = llround(frame.mJoints[joint][axis] / mQuantum);
+				U32 coded = zigzag(value - channel.mPrev);
+				writer.putRice(coded, channel.getK());
+				channel.update(coded);
+				channel.mPrev = value;
+			}
+		}
+		mCurrent->mEndTime = frame.mTime;
+		++mCurrent->mFrameCount;
+	}
+
+	mFrameCount++;
+	mInAddFrame--;
+}
+
+void LLNuiRecorder::startBlock(const LLNuiSkeletonFrame& frame)
+{
+	mCurrent->reset();
+	mCurrent->mStartTime = frame.mTime;
+	mCurrent->mEndTime = frame.mTime;
+	mCurrent->mFrameCount = 1;
+
+	LLNuiBitWriter& writer = mCurrent->mWriter;
+	LLNuiCodecState& state = mCurrent->mState;
+
+	writer.putBits(frame.mIntents, NUI_INTENT_COUNT);
+	state.mIntents = frame.mIntents;
+
+	for (S32 joint = 0; joint < NUI_JOINT_COUNT; ++joint)
+	{
+		if (!(mJointMask & (1 << joint)))
+		{
+			continue;
+		}
+		for (S32 axis = 0; axis < 3; ++axis)
+		{
+			S32 value = llround(frame.mJoints[joint][axis] / mQuantum);
+			writer.putRice(zigzag(value), KEYFRAME_K);
+			state.mJoints[joint][axis].mPrev = value;
+		}
+	}
+}
+
+bool LLNuiRecorder::submitBlock()
+{
+	mCurrent->mBytes = mCurrent->mWriter.flush();
+	// Every block is always in exactly one ring or owned by one side, so
+	// the filled ring cannot be full.
+	bool pushed = mFilledBlocks.push(mCurrent);
+	llassert(pushed);
+	mCurrent = NULL;
+	return pushed;
+}
+
+void LLNuiRecorder::writeFilledBlocks()
+{
+	Block* block = NULL;
+	while (mFilledBlocks.pop(block))
+	{
+		LLNuiRecordingIndexEntry entry;
+		entry.mStartTime = block->mStartTime;
+		entry.mEndTime = block->mEndTime;
+		entry.mOffset = (U64)ftell(mFile);
+
+		bool ok = write_value(mFile, NREC_MAGIC_BLOCK)
+			&& write_value(mFile, block->mBytes)
+			&& write_value(mFile, block->mFrameCount)
+			&& write_value(mFile, block->mStartTime)
+			&& write_value(mFile, block->mEndTime)
+			&& fwrite(block->mData, 1, block->mBytes, mFile) == block->mBytes;
+		if (ok)
+		{
+			mIndex.push_back(entry);
+		}
+		else
+		{
+			LL_WARNS_ONCE("Nui") << "Write failed on nui recording " << mFilename << LL_ENDL;
+			mDroppedFrames += block->mFrameCount;
+		}
+
+		block->reset();
+		mFreeBlocks.push(block);
+	}
+}
+
+//----------------------------------------------------------------------------
+// LLNuiRecordingReader
+
+struct LLNuiRecordingReader::DecodeState
+{
+	LLNuiBitReader	mReader;
+	LLNuiCodecState	mCodec;
+};
+
+LLNuiRecordingReader::LLNuiRecordingReader()
+:	mFile(NULL),
+	mJointMask(NUI_ALL_JOINTS),
+	mQuantum(.001f),
+	mBlock(0),
+	mFramesLeft(0),
+	mFramesDecoded(0),
+	mBlockStartTime(0.0),
+	mBlockEndTime(0.0),
+	mState(new DecodeState),
+	mHavePending(false)
+{ }
+
+LLNuiRecordingReader::~LLNuiRecordingReader()
+{
+	close();
+	delete mState;
+}
+
+bool LLNuiRecordingReader::open(const std::string& filename)
+{
+	close();
+
+	mFile = LLFile::fopen(filename, "rb");
+	if (!mFile)
+	{
+		LL_WARNS("Nui") << "Unable to open nui recording " << filename << LL_ENDL;
+		return false;
+	}
+
+	U32 magic = 0;
+	U32 version = 0;
+	F32 keyframe_interval = 0.f;
+	if (!read_value(mFile, magic) || magic != NREC_MAGIC_HEADER
+		|| !read_value(mFile, version) || version != NUI_RECORDING_VERSION
+		|| !read_value(mFile, mJointMask)
+		|| !read_value(mFile, mQuantum)
+		|| !read_value(mFile, keyframe_interval))
+	{
+		LL_WARNS("Nui") << filename << " is not a nui recording this viewer can read" << LL_ENDL;
+		close();
+		return false;
+	}
+
+	if (!readIndex() && !rebuildIndex())
+	{
+		LL_WARNS("Nui") << filename << " contains no frames" << LL_ENDL;
+		close();
+		return false;
+	}
+
+	return seek(getStartTime());
+}
+
+void LLNuiRecordingReader::close()
+{
+	if (mFile)
+	{
+		fclose(mFile);
+		mFile = NULL;
+	}
+	mIndex.clear();
+	mPayload.clear();
+	mFramesLeft = 0;
+	mHavePending = false;
+}
+
+F64 LLNuiRecordingReader::getStartTime() const
+{
+	return mIndex.empty() ? 0.0 : mIndex.front().mStartTime;
+}
+
+F64 LLNuiRecordingReader::getEndTime() const
+{
+	return mIndex.empty() ? 0.0 : mIndex.back().mEndTime;
+}
+
+bool LLNuiRecordingReader::readIndex()
+{
+	U64 index_offset = 0;
+	U32 magic = 0;
+	if (fseek(mFile, -(long)(sizeof(index_offset) + sizeof(magic)), SEEK_END) != 0
+		|| !read_value(mFile, index_offset)
+		|| !read_value(mFile, magic)
+		|| magic != NREC_MAGIC_END
+		|| fseek(mFile, (long)index_offset, SEEK_SET) != 0)
+	{
+		return false;
+	}
+
+	U32 count = 0;
+	if (!read_value(mFile, magic) || magic != NREC_MAGIC_INDEX || !read_value(mFile, count))
+	{
+		return false;
+	}
+
+	mIndex.resize(count);
+	for (U32 i = 0; i < count; ++i)
+	{
+		LLNuiRecordingIndexEntry& entry = mIndex[i];
+		if (!read_value(mFile, entry.mStartTime)
+			|| !read_value(mFile, entry.mEndTime)
+			|| !read_value(mFile, entry.mOffset))
+		{
+			mIndex.clear();
+			return false;
+		}
+	}
+	return !mIndex.empty();
+}
+
+bool LLNuiRecordingReader::rebuildIndex()
+{
+	const long first_block = (long)(5 * sizeof(U32));
+	fseek(mFile, first_block, SEEK_SET);
+
+	mIndex.clear();
+	while (true)
+	{
+		LLNuiRecordingIndexEntry entry;
+		entry.mOffset = (U64)ftell(mFile);
+
+		U32 magic = 0;
+		U32 bytes = 0;
+		U32 frames = 0;
+		if (!read_value(mFile, magic) || magic != NREC_MAGIC_BLOCK
+			|| !read_value(mFile, bytes)
+			|| !read_value(mFile, frames)
+			|| !read_value(mFile, entry.mStartTime)
+			|| !read_value(mFile, entry.mEndTime)
+			|| fseek(mFile, (long)bytes, SEEK_CUR) != 0)
+		{
+			break;
+		}
+		mIndex.push_back(entry);
+	}
+
+	if (!mIndex.empty())
+	{
+		LL_INFOS("Nui") << "Rebuilt index of unterminated nui recording, " << mIndex.size() << " blocks" << LL_ENDL;
+	}
+	return !mIndex.empty();
+}
+
+bool LLNuiRecordingReader::loadBlock(U32 block)
+{
+	// Advance even if the block turns out to be unreadable, so readFrame()
+	// moves on past it.
+	mBlock = block;
+	mFramesLeft = 0;
+	if (block >= mIndex.size()
+		|| fseek(mFile, (long)mIndex[block].mOffset, SEEK_SET) != 0)
+	{
+		return false;
+	}
+
+	U32 magic = 0;
+	U32 bytes = 0;
+	U32 frames = 0;
+	if (!read_value(mFile, magic) || magic != NREC_MAGIC_BLOCK
+		|| !read_value(mFile, bytes)
+		|| !read_value(mFile, frames)
+		|| !read_value(mFile, mBlockStartTime)
+		|| !read_value(mFile, mBlockEndTime))
+	{
+		return false;
+	}
+
+	mPayload.resize(bytes);
+	if (bytes && fread(&mPayload[0], 1, bytes, mFile) != bytes)
+	{
+		// A block cut short by a crash: decode nothing rather than garbage.
+		return false;
+	}
+
+	mFramesLeft = frames;
+	mFramesDecoded = 0;
+	mState->mReader.reset(mPayload.empty() ? NULL : &mPayload[0], bytes);
+	mState->mCodec.reset();
+	return true;
+}
+
+bool LLNuiRecordingReader::decodeFrame(LLNuiSkeletonFrame& frame)
+{
+	if (!mFramesLeft)
+	{
+		return false;
+	}
+
+	LLNuiBitReader& reader = mState->mReader;
+	LLNuiCodecState& state = mState->mCodec;
+	bool keyframe = (mFramesDecoded == 0);
+
+	if (keyframe)
+	{
+		state.mIntents = reader.getBits(NUI_INTENT_COUNT);
+	}
+	else
+	{
+		U32 time_delta = reader.getRice(state.mTime.getK());
+		state.mTime.update(time_delta);
+		state.mTime.mPrev += (S32)time_delta;
+		if (reader.getBits(1))
+		{
+			state.mIntents = reader.getBits(NUI_INTENT_COUNT);
+		}
+	}
+	frame.mTime = mBlockStartTime + (F64)state.mTime.mPrev / TICKS_PER_SECOND;
+	frame.mIntents = state.mIntents;
+
+	for (S32 joint = 0; joint < NUI_JOINT_COUNT; ++joint)
+	{
+		if (!(mJointMask & (1 << joint)))
+		{
+			frame.mJoints[joint][0] = frame.mJoints[joint][1] = frame.mJoints[joint][2] = 0.f;
+			continue;
+		}
+		for (S32 axis = 0; axis < 3; ++axis)
+		{
+			LLNuiChannel& channel = state.mJoints[joint][axis];
+			if (keyframe)
+			{
+				channel.mPrev = unzigzag(reader.getRice(KEYFRAME_K));
+			}
+			else
+			{
+				U32 coded = reader.getRice(channel.getK());
+				channel.update(coded);
+				channel.mPrev += unzigzag(coded);
+			}
+			frame.mJoints[joint][axis] = (F32)channel.mPrev * mQuantum;
+		}
+	}
+
+	--mFramesLeft;
+	++mFramesDecoded;
+	if (reader.overrun())
+	{
+		LL_WARNS_ONCE("Nui") << "Corrupt block in nui recording" << LL_ENDL;
+		mFramesLeft = 0;
+		return false;
+	}
+	return true;
+}
+
+bool LLNuiRecordingReader::seek(F64 time)
+{
+	if (mIndex.empty())
+	{
+		return false;
+	}
+
+	// Last block starting at or before 'time'.
+	U32 block = 0;
+	for (U32 i = 1; i < mIndex.size() && mIndex[i].mStartTime <= time; ++i)
+	{
+		block = i;
+	}
+
+	mHavePending = false;
+	for (; block < mIndex.size(); ++block)
+	{
+		if (!loadBlock(block))
+		{
+			continue;
+		}
+		while (decodeFrame(mPending))
+		{
+			if (mPending.mTime >= time)
+			{
+				mHavePending = true;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool LLNuiRecordingReader::readFrame(LLNuiSkeletonFrame& frame)
+{
+	if (!mFile)
+	{
+		return false;
+	}
+	if (mHavePending)
+	{
+		frame = mPending;
+		mHavePending = false;
+		return true;
+	}
+	while (!decodeFrame(frame))
+	{
+		if (mBlock + 1 >= mIndex.size())
+		{
+			return false;
+		}
+		loadBlock(mBlock + 1);
+	}
+	return true;
+}
+
+bool LLNuiRecordingReader::readAll(std::vector<LLNuiSkeletonFrame>& frames)
+{
+	if (!seek(getStartTime()))
+	{
+		return false;
+	}
+	LLNuiSkeletonFrame frame;
+	while (readFrame(frame))
+	{
+		frames.push_back(frame);
+	}
+	return true;
+}
@@ -0,0 +1,168 @@
+/**
+ * @file llnuirecording.h
+ * @brief Compact, seekable recordings of nui skeleton sessions.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLNUIRECORDING_H
+#define LL_LLNUIRECORDING_H
+
+#include "llatomic.h"
+#include "llfile.h"
+#include "llnuiskeleton.h"
+#include "llspscring.h"
+
+#include <vector>
+
+// File layout (.nrec, host byte order):
+//
+//   header   'NREC', version, joint mask, quantum (metres), keyframe interval
+//   block*   'NRBK', payload bytes, frame count, start time, end time, payload
+//   index    'NRIX', block count, (start time, end time, offset) per block
+//   footer   index offset, 'NREN'
+//
+// Each block starts with a keyframe and decodes on its own, so a reader can
+// seek to any block through the index. Joint positions are quantized and
+// every following frame stores the per-joint, per-axis delta to the previous
+// frame, zigzag mapped and Rice coded with a parameter that adapts to the
+// recent magnitude of that channel. A recording that was never closed has
+// no index; the reader rebuilds it by walking the block headers.
+
+const U32 NUI_RECORDING_VERSION = 1;
+
+struct LLNuiRecordingIndexEntry
+{
+	F64		mStartTime;
+	F64		mEndTime;
+	U64		mOffset;
+};
+
+class LLNuiRecorderThread;
+
+// Writes a recording. addFrame() may be called from the sensor acquisition
+// thread: it encodes into preallocated blocks and hands full blocks to a
+// writer thread through lock-free rings, so it never allocates, locks or
+// touches the disk. If the writer falls behind, frames are dropped and
+// counted rather than blocking the sensor.
+class LLNuiRecorder
+{
+public:
+	LLNuiRecorder();
+	~LLNuiRecorder();
+
+	bool open(const std::string& filename, U32 joint_mask = NUI_ALL_JOINTS,
+			  F32 keyframe_interval = 2.f, F32 quantum = .001f);
+	// Flushes the last block and writes the index. Call from the thread that
+	// opened the recording.
+	void close();
+	bool isOpen() const				{ return mFile != NULL; }
+
+	// Single producer only.
+	void addFrame(const LLNuiSkeletonFrame& frame);
+
+	U32 getFrameCount() const		{ return mFrameCount.CurrentValue(); }
+	U32 getDroppedFrames() const	{ return mDroppedFrames.CurrentValue(); }
+
+	struct Block;
+
+private:
+	friend class LLNuiRecorderThread;
+
+	void startBlock(const LLNuiSkeletonFrame& frame);
+	bool submitBlock();
+	// Writer thread: writes any filled blocks and recycles them.
+	void writeFilledBlocks();
+
+	enum { NUM_BLOCKS = 16 };
+	typedef LLSPSCRing<Block*, NUM_BLOCKS> block_ring_t;
+
+	LLFILE*						mFile;
+	std::string					mFilename;
+	LLNuiRecorderThread*		mThread;
+	U32							mJointMask;
+	F32							mKeyframeInterval;
+	F32							mQuantum;
+
+	Block*						mBlocks;
+	block_ring_t				mFreeBlocks;	// writer -> producer
+	block_ring_t				mFilledBlocks;	// producer -> writer
+	Block*						mCurrent;		// owned by the producer
+
+	std::vector<LLNuiRecordingIndexEntry>	mIndex;	// writer thread only
+
+	LLAtomicU32					mFrameCount;
+	LLAtomicU32					mDroppedFrames;
+	LLAtomicU32					mClosing;
+	LLAtomicU32					mInAddFrame;
+};
+
+// Reads a recording back with random access by time.
+class LLNuiRecordingReader
+{
+public:
+	LLNuiRecordingReader();
+	~LLNuiRecordingReader();
+
+	bool open(const std::string& filename);
+	void close();
+	bool isOpen() const			{ return mFile != NULL; }
+
+	F64 getStartTime() const;
+	F64 getEndTime() const;
+	U32 getJointMask() const	{ return mJointMask; }
+
+	// Positions the reader so the next readFrame() returns the first frame
+	// at or after 'time' (recording clock, see getStartTime()).
+	bool seek(F64 time);
+	// Returns false at the end of the recording.
+	bool readFrame(LLNuiSkeletonFrame& frame);
+
+	// Convenience for tools: appends every frame to 'frames'.
+	bool readAll(std::vector<LLNuiSkeletonFrame>& frames);
+
+private:
+	bool readIndex();
+	bool rebuildIndex();
+	bool loadBlock(U32 block);
+	bool decodeFrame(LLNuiSkeletonFrame& frame);
+
+	LLFILE*					mFile;
+	U32						mJointMask;
+	F32						mQuantum;
+	std::vector<LLNuiRecordingIndexEntry>	mIndex;
+
+	// Current block decode state.
+	U32						mBlock;
+	std::vector<U8>			mPayload;
+	U32						mFramesLeft;
+	U32						mFramesDecoded;
+	F64						mBlockStartTime;
+	F64						mBlockEndTime;
+	struct DecodeState;
+	DecodeState*			mState;
+
+	bool					mHavePending;
+	LLNuiSkeletonFrame		mPending;
+};
+
+#endif
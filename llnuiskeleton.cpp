@@ -0,0 +1,172 @@
+/**
+ * @file llnuiskeleton.cpp
+ * @brief Plain skeleton frames and recorded nui sessions.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llnuiskeleton.h"
+
+#include "llfile.h"
+
+#include <sstream>
+#include <boost/algorithm/string.hpp>
+
+static const char* const INTENT_NAMES[NUI_INTENT_COUNT] =
+{
+	"push",
+	"yaw_left",
+	"yaw_right",
+	"pitch_up",
+	"pitch_down",
+	"fly_up",
+	"fly_down"
+};
+
+const char* nui_intent_name(S32 bit_index)
+{
+	if (bit_index < 0 || bit_index >= NUI_INTENT_COUNT)
+	{
+		return NULL;
+	}
+	return INTENT_NAMES[bit_index];
+}
+
+bool nui_parse_intents(const std::string& text, U32& intents)
+{
+	intents = NUI_INTENT_NONE;
+	if (text.empty() || text == "-")
+	{
+		return true;
+	}
+
+	std::vector<std::string> names;
+	boost::split(names, text, boost::is_any_of(","));
+	for (std::vector<std::string>::const_iterator it = names.begin(); it != names.end(); ++it)
+	{
+		S32 i = 0;
+		for (; i < NUI_INTENT_COUNT; ++i)
+		{
+			if (*it == INTENT_NAMES[i])
+			{
+				intents |= (1 << i);
+				break;
+			}
+		}
+		if (i == NUI_INTENT_COUNT)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+LLNuiSkeletonFrame::LLNuiSkeletonFrame()
+:	mTime(0.0),
+	mIntents(NUI_INTENT_NONE)
+{
+	memset(mJoints, 0, sizeof(mJoints));
+}
+
+// -----------------------------------------------------------------------------
+bool LLNuiSession::loadText(const std::string& filename)
+{
+	llifstream file(filename);
+	if (!file.is_open())
+	{
+		LL_WARNS("Nui") << "Unable to open nui session " << filename << LL_ENDL;
+		return false;
+	}
+
+	mName = filename;
+	mFrames.clear();
+
+	std::string line;
+	S32 line_number = 0;
+	while (std::getline(file, line))
+	{
+		++line_number;
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		std::istringstream fields(line);
+		LLNuiSkeletonFrame frame;
+		std::string intents;
+		fields >> frame.mTime >> intents;
+		for (S32 joint = 0; joint < NUI_JOINT_COUNT; ++joint)
+		{
+			fields >> frame.mJoints[joint][0] >> frame.mJoints[joint][1] >> frame.mJoints[joint][2];
+		}
+
+		if (fields.fail() || !nui_parse_intents(intents, frame.mIntents))
+		{
+			LL_WARNS("Nui") << filename << ":" << line_number << ": malformed frame, skipped" << LL_ENDL;
+			continue;
+		}
+		mFrames.push_back(frame);
+	}
+
+	return !mFrames.empty();
+}
+
+bool LLNuiSession::saveText(const std::string& filename) const
+{
+	llofstream file(filename);
+	if (!file.is_open())
+	{
+		LL_WARNS("Nui") << "Unable to write nui session " << filename << LL_ENDL;
+		return false;
+	}
+
+	file << "# seconds intents joints[" << NUI_JOINT_COUNT << "](x y z)\n";
+	for (frame_list_t::const_iterator it = mFrames.begin(); it != mFrames.end(); ++it)
+	{
+		file << it->mTime << ' ';
+		if (it->mIntents == NUI_INTENT_NONE)
+		{
+			file << '-';
+		}
+		else
+		{
+			bool first = true;
+			for (S32 i = 0; i < NUI_INTENT_COUNT; ++i)
+			{
+				if (it->mIntents & (1 << i))
+				{
+					file << (first ? "" : ",") << INTENT_NAMES[i];
+					first = false;
+				}
+			}
+		}
+		for (S32 joint = 0; joint < NUI_JOINT_COUNT; ++joint)
+		{
+			file << ' ' << it->mJoints[joint][0] << ' ' << it->mJoints[joint][1] << ' ' << it->mJoints[joint][2];
+		}
+		file << '\n';
+	}
+	return true;
+}
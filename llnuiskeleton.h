@@ -0,0 +1,120 @@
+/**
+ * @file llnuiskeleton.h
+ * @brief Plain skeleton frames and recorded nui sessions.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLNUISKELETON_H
+#define LL_LLNUISKELETON_H
+
+#include "stdtypes.h"
+
+#include <string>
+#include <vector>
+
+// Joint indices. These follow the Kinect NUI_SKELETON_POSITION_INDEX
+// ordering, which is also the ordering NuiLib's joint() takes.
+typedef enum e_nui_joint
+{
+	NUI_JOINT_HIP_CENTER = 0,
+	NUI_JOINT_SPINE,
+	NUI_JOINT_SHOULDER_CENTER,
+	NUI_JOINT_HEAD,
+	NUI_JOINT_SHOULDER_LEFT,
+	NUI_JOINT_ELBOW_LEFT,
+	NUI_JOINT_WRIST_LEFT,
+	NUI_JOINT_HAND_LEFT,
+	NUI_JOINT_SHOULDER_RIGHT,
+	NUI_JOINT_ELBOW_RIGHT,
+	NUI_JOINT_WRIST_RIGHT,
+	NUI_JOINT_HAND_RIGHT,
+	NUI_JOINT_HIP_LEFT,
+	NUI_JOINT_KNEE_LEFT,
+	NUI_JOINT_ANKLE_LEFT,
+	NUI_JOINT_FOOT_LEFT,
+	NUI_JOINT_HIP_RIGHT,
+	NUI_JOINT_KNEE_RIGHT,
+	NUI_JOINT_ANKLE_RIGHT,
+	NUI_JOINT_FOOT_RIGHT,
+	NUI_JOINT_COUNT
+} ENuiJoint;
+
+// Sets of joints as bit masks of 1 << ENuiJoint.
+const U32 NUI_ALL_JOINTS = (1 << NUI_JOINT_COUNT) - 1;
+
+// What the user meant to do in a recorded frame. Used as labels when
+// calibrating the gesture trackers offline. Yaw right and pitch up are the
+// positive outputs of the gesture graph (see LLViewerNui::agentYaw/agentPitch).
+typedef enum e_nui_intent
+{
+	NUI_INTENT_NONE			= 0,
+	NUI_INTENT_PUSH			= 1 << 0,
+	NUI_INTENT_YAW_LEFT		= 1 << 1,
+	NUI_INTENT_YAW_RIGHT	= 1 << 2,
+	NUI_INTENT_PITCH_UP		= 1 << 3,
+	NUI_INTENT_PITCH_DOWN	= 1 << 4,
+	NUI_INTENT_FLY_UP		= 1 << 5,
+	NUI_INTENT_FLY_DOWN		= 1 << 6
+} ENuiIntent;
+
+const S32 NUI_INTENT_COUNT = 7;
+
+// Name of a single intent bit ("push", "yaw_left", ...), NULL if out of range.
+const char* nui_intent_name(S32 bit_index);
+// Parses "push,yaw_left" (or "-" for none) into an intent mask.
+bool nui_parse_intents(const std::string& text, U32& intents);
+
+// One skeleton sample, positions in metres in sensor space.
+struct LLNuiSkeletonFrame
+{
+	LLNuiSkeletonFrame();
+
+	F64		mTime;
+	U32		mIntents;
+	F32		mJoints[NUI_JOINT_COUNT][3];
+};
+
+// A recorded sequence of skeleton frames.
+//
+// The text form is one frame per line:
+//   <seconds> <intents> <x y z for each of the NUI_JOINT_COUNT joints>
+// where <intents> is a comma separated list of intent names or "-".
+// Lines starting with '#' are comments.
+class LLNuiSession
+{
+public:
+	typedef std::vector<LLNuiSkeletonFrame> frame_list_t;
+
+	bool loadText(const std::string& filename);
+	bool saveText(const std::string& filename) const;
+
+	const std::string& getName() const		{ return mName; }
+	const frame_list_t& getFrames() const	{ return mFrames; }
+	frame_list_t& getFrames()				{ return mFrames; }
+
+private:
+	std::string		mName;
+	frame_list_t	mFrames;
+};
+
+#endif
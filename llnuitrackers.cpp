@@ -0,0 +1,156 @@
+/**
+ * @file llnuitrackers.cpp
+ * @brief Tunable thresholds used by the nui gesture graph.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llnuitrackers.h"
+
+#include "llfile.h"
+#include "llsdserialize.h"
+
+// Hand-tuned defaults: name, max, scale, min, default position.
+static const LLNuiTrackerDef TRACKER_DEFS[NUI_TRACKER_COUNT] =
+{
+	{ "PitchArmD",		20,		1.f,	0.f,	10 },
+	{ "PitchArmR",		40,		2.f,	10.f,	17 },
+	{ "PitchArmG",		30,		1.f,	0.f,	15 },
+	{ "PitchAS",		29,		1.f,	1.f,	20 },
+	{ "YawArmD",		20,		1.f,	0.f,	10 },
+	{ "YawArmR",		40,		2.f,	10.f,	15 },
+	{ "YawArmG",		20,		1.f,	0.f,	10 },
+	{ "YawAS",			29,		1.f,	1.f,	20 },
+	{ "YawLeanD",		20,		.5f,	0.f,	10 },
+	{ "YawLeanR",		20,		1.f,	0.f,	15 },
+	{ "YawLeanG",		50,		1.f,	0.f,	30 },
+	{ "YawLS",			29,		1.f,	1.f,	20 },
+	{ "YawTwistD",		10,		.025f,	0.f,	6 },
+	{ "YawTwistR",		20,		.05f,	0.f,	9 },
+	{ "YawTwistG",		20,		1.f,	0.f,	10 },
+	{ "YawTS",			29,		1.f,	1.f,	20 },
+	{ "FlyUpD",			120,	1.f,	0.f,	65 },
+	{ "FlyUpR",			120,	1.f,	0.f,	50 },
+	{ "FlyDownD",		120,	1.f,	0.f,	45 },
+	{ "FlyDownR",		120,	1.f,	0.f,	15 },
+	{ "PushThreshold",	30,		.05f,	.0f,	9 }
+};
+
+//static
+const LLNuiTrackerDef& LLNuiTrackerSet::getDef(S32 tracker)
+{
+	llassert(tracker >= 0 && tracker < NUI_TRACKER_COUNT);
+	return TRACKER_DEFS[tracker];
+}
+
+//static
+S32 LLNuiTrackerSet::findTracker(const std::string& name)
+{
+	for (S32 i = 0; i < NUI_TRACKER_COUNT; ++i)
+	{
+		if (name == TRACKER_DEFS[i].mName)
+		{
+			return i;
+		}
+	}
+	return NUI_TRACKER_COUNT;
+}
+
+LLNuiTrackerSet::LLNuiTrackerSet()
+{
+	resetToDefaults();
+}
+
+void LLNuiTrackerSet::resetToDefaults()
+{
+	for (S32 i = 0; i < NUI_TRACKER_COUNT; ++i)
+	{
+		mPositions[i] = TRACKER_DEFS[i].mDefault;
+	}
+}
+
+void LLNuiTrackerSet::setPosition(S32 tracker, S32 position)
+{
+	mPositions[tracker] = llclamp(position, 0, TRACKER_DEFS[tracker].mMax);
+}
+
+F32 LLNuiTrackerSet::getValue(S32 tracker) const
+{
+	const LLNuiTrackerDef& def = TRACKER_DEFS[tracker];
+	return def.mMin + (F32)mPositions[tracker] * def.mScale;
+}
+
+LLSD LLNuiTrackerSet::asLLSD() const
+{
+	LLSD sd = LLSD::emptyMap();
+	for (S32 i = 0; i < NUI_TRACKER_COUNT; ++i)
+	{
+		sd[TRACKER_DEFS[i].mName] = mPositions[i];
+	}
+	return sd;
+}
+
+void LLNuiTrackerSet::fromLLSD(const LLSD& sd)
+{
+	for (LLSD::map_const_iterator it = sd.beginMap(); it != sd.endMap(); ++it)
+	{
+		S32 tracker = findTracker(it->first);
+		if (tracker == NUI_TRACKER_COUNT)
+		{
+			LL_WARNS("Nui") << "Ignoring unknown tracker " << it->first << LL_ENDL;
+			continue;
+		}
+		setPosition(tracker, it->second.asInteger());
+	}
+}
+
+bool LLNuiTrackerSet::loadFromFile(const std::string& filename)
+{
+	llifstream file(filename);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	LLSD sd;
+	if (LLSDSerialize::fromXML(sd, file) == LLSDParser::PARSE_FAILURE || !sd.isMap())
+	{
+		LL_WARNS("Nui") << "Unable to parse tracker file " << filename << LL_ENDL;
+		return false;
+	}
+	fromLLSD(sd);
+	return true;
+}
+
+bool LLNuiTrackerSet::saveToFile(const std::string& filename) const
+{
+	llofstream file(filename);
+	if (!file.is_open())
+	{
+		LL_WARNS("Nui") << "Unable to write tracker file " << filename << LL_ENDL;
+		return false;
+	}
+	LLSDSerialize::toPrettyXML(asLLSD(), file);
+	return true;
+}
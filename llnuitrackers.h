@@ -0,0 +1,103 @@
+/**
+ * @file llnuitrackers.h
+ * @brief Tunable thresholds used by the nui gesture graph.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLNUITRACKERS_H
+#define LL_LLNUITRACKERS_H
+
+#include "stdtypes.h"
+#include "llsd.h"
+
+#include <string>
+#include <vector>
+
+// Every tracker the gesture graph reads. The order matches the
+// definitions table in llnuitrackers.cpp.
+typedef enum e_nui_tracker
+{
+	NUI_TRACKER_PITCH_ARM_D = 0,
+	NUI_TRACKER_PITCH_ARM_R,
+	NUI_TRACKER_PITCH_ARM_G,
+	NUI_TRACKER_PITCH_AS,
+	NUI_TRACKER_YAW_ARM_D,
+	NUI_TRACKER_YAW_ARM_R,
+	NUI_TRACKER_YAW_ARM_G,
+	NUI_TRACKER_YAW_AS,
+	NUI_TRACKER_YAW_LEAN_D,
+	NUI_TRACKER_YAW_LEAN_R,
+	NUI_TRACKER_YAW_LEAN_G,
+	NUI_TRACKER_YAW_LS,
+	NUI_TRACKER_YAW_TWIST_D,
+	NUI_TRACKER_YAW_TWIST_R,
+	NUI_TRACKER_YAW_TWIST_G,
+	NUI_TRACKER_YAW_TS,
+	NUI_TRACKER_FLY_UP_D,
+	NUI_TRACKER_FLY_UP_R,
+	NUI_TRACKER_FLY_DOWN_D,
+	NUI_TRACKER_FLY_DOWN_R,
+	NUI_TRACKER_PUSH_THRESHOLD,
+	NUI_TRACKER_COUNT
+} ENuiTracker;
+
+// Mirrors the arguments of NuiLib::tracker(): a slider with positions
+// 0..mMax whose value is mMin + position * mScale.
+struct LLNuiTrackerDef
+{
+	const char*	mName;
+	S32			mMax;
+	F32			mScale;
+	F32			mMin;
+	S32			mDefault;
+};
+
+// A complete set of slider positions for the gesture trackers.
+class LLNuiTrackerSet
+{
+public:
+	LLNuiTrackerSet();
+
+	static const LLNuiTrackerDef& getDef(S32 tracker);
+	// Returns NUI_TRACKER_COUNT if no tracker has that name.
+	static S32 findTracker(const std::string& name);
+
+	S32 getPosition(S32 tracker) const		{ return mPositions[tracker]; }
+	void setPosition(S32 tracker, S32 position);
+	F32 getValue(S32 tracker) const;
+
+	void resetToDefaults();
+
+	// Serialized as a map of tracker name to slider position. Unknown names
+	// are ignored, missing names keep their current position.
+	LLSD asLLSD() const;
+	void fromLLSD(const LLSD& sd);
+
+	bool loadFromFile(const std::string& filename);
+	bool saveToFile(const std::string& filename) const;
+
+private:
+	S32		mPositions[NUI_TRACKER_COUNT];
+};
+
+#endif
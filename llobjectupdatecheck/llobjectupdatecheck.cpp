@@ -0,0 +1,446 @@
+/**
+ * @file llobjectupdatecheck.cpp
+ * @brief Checks the object update decoder against the template reader.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+// Usage:
+//   llobjectupdatecheck [options] [trace ...]
+//
+// Decodes ObjectUpdateCompressed messages with LLObjectUpdateDecoder, on
+// job system workers and flushed in batches as idleNetwork() does, and
+// with LLTemplateMessageReader, reading them as
+// LLViewerObjectList::processObjectUpdate() does, and compares the two:
+// region handle, time dilation, and for each object its update flags, ID,
+// local ID, PCode and data, inflated where it was sent zlib compressed.
+//
+// It checks random messages first, a third of whose objects have zlib
+// compressed data, some of it corrupt, then every ObjectUpdateCompressed
+// in each packet trace given (see MessageTraceRecord). It prints how many
+// messages matched, and exits with 1 if any did not.
+
+#include "linden_common.h"
+#include "llapr.h"
+#include "lldatapacker.h"
+#include "llerrorcontrol.h"
+#include "llmessagetemplate.h"
+#include "lltemplatemessagebuilder.h"
+#include "lltemplatemessagereader.h"
+#include "message.h"
+#include "net.h"
+#include "object_flags.h"
+#include "zlib/zlib.h"
+
+#include "lljobsystem.h"
+#include "llmainloopbenchmark.h"
+#include "llobjectupdatedecoder.h"
+#include "llpacketreceiver.h"
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+static const char USAGE[] = "\n"
+"usage:\tllobjectupdatecheck [options] [trace ...]\n"
+"\n"
+" -t, --template <file>\n"
+"        Message template (default message_template.msg).\n"
+" -n, --messages <n>\n"
+"        Random messages to check (default 20000).\n"
+" -w, --workers <n>\n"
+"        Job system workers to decode on, 0 to decode on the main thread\n"
+"        (default 2).\n"
+"\n";
+
+// Messages queued between flushes.
+static const S32 FLUSH_EVERY = 16;
+
+// An object as processObjectUpdate() reads it from the template reader.
+struct ExpectedObject
+{
+	U32					mUpdateFlags;
+	LLUUID				mFullID;
+	U32					mLocalID;
+	U8					mPCode;
+	std::vector<U8>		mData;
+};
+
+struct ExpectedUpdate
+{
+	U64							mRegionHandle;
+	U16							mTimeDilation;
+	std::vector<ExpectedObject>	mObjects;
+};
+
+// The messages queued on the decoder since the last flush, oldest first,
+// and how their batches compared.
+struct CheckState
+{
+	std::vector<ExpectedUpdate>	mExpected;
+	size_t						mNext;
+	bool						mFlushing;
+	U32							mMatched;
+	U32							mObjects;
+	U32							mCompressed;
+};
+
+static CheckState sState;
+
+static void ignore_message(LLMessageSystem*, void**)
+{ }
+
+static bool same_object(const ExpectedObject& expected, const LLObjectUpdateRecord& record)
+{
+	return record.mUpdateFlags == expected.mUpdateFlags
+		&& record.mFullID == expected.mFullID
+		&& record.mLocalID == expected.mLocalID
+		&& record.mPCode == expected.mPCode
+		&& record.mDataSize == (S32)expected.mData.size()
+		&& (!record.mDataSize || !memcmp(record.mData, &expected.mData[0], record.mDataSize));
+}
+
+// Decoder apply function: compares the batch with the next expected update.
+static void apply_batch(const LLObjectUpdateBatch& batch)
+{
+	if (sState.mNext >= sState.mExpected.size())
+	{
+		std::cerr << "Decoder applied more batches than were queued\n";
+		return;
+	}
+	const ExpectedUpdate& expected = sState.mExpected[sState.mNext++];
+	bool match = batch.mRegionHandle == expected.mRegionHandle
+				 && batch.mTimeDilation == expected.mTimeDilation
+				 && batch.mRecords.size() == expected.mObjects.size();
+	for (size_t i = 0; match && i < expected.mObjects.size(); ++i)
+	{
+		match = same_object(expected.mObjects[i], batch.mRecords[i]);
+	}
+	if (match)
+	{
+		sState.mMatched++;
+	}
+}
+
+// The decoder drops a batch that ran off the end of its packet, which the
+// template reader read whole, so it counts as a mismatch.
+static void ran_off_end(LLMessageSystem*, void*, EMessageException)
+{
+	if (sState.mFlushing)
+	{
+		sState.mNext++;
+	}
+}
+
+static void flush(LLObjectUpdateDecoder* decoder)
+{
+	sState.mFlushing = true;
+	decoder->flush();
+	sState.mFlushing = false;
+	if (sState.mNext != sState.mExpected.size())
+	{
+		std::cerr << "Decoder applied " << sState.mNext << " of " << sState.mExpected.size() << " batches\n";
+	}
+	sState.mExpected.clear();
+	sState.mNext = 0;
+}
+
+// Reads the message with the template reader, as processObjectUpdate()
+// reads the compressed case. It does not check uncompress(); the decoder
+// hands over no data where it fails, which processCompressedUpdateBatch()
+// skips. Returns false if the reader rejects the message, which the
+// message system would not pass on.
+static bool read_expected(LLTemplateMessageReader& reader, const U8* data, S32 size, const LLHost& sender,
+						  ExpectedUpdate& expected)
+{
+	bool ok = reader.validateMessage(data, size, sender, true) && reader.readMessage(data, sender);
+	if (ok)
+	{
+		reader.getU64(_PREHASH_RegionData, _PREHASH_RegionHandle, expected.mRegionHandle);
+		reader.getU16(_PREHASH_RegionData, _PREHASH_TimeDilation, expected.mTimeDilation);
+		S32 count = reader.getNumberOfBlocks(_PREHASH_ObjectData);
+		expected.mObjects.resize(count);
+		for (S32 i = 0; i < count; ++i)
+		{
+			ExpectedObject& object = expected.mObjects[i];
+			reader.getU32(_PREHASH_ObjectData, _PREHASH_UpdateFlags, object.mUpdateFlags, i);
+			S32 data_size = reader.getSize(_PREHASH_ObjectData, i, _PREHASH_Data);
+			object.mData.resize(data_size);
+			if (data_size)
+			{
+				reader.getBinaryData(_PREHASH_ObjectData, _PREHASH_Data, &object.mData[0], data_size, i);
+			}
+			if (data_size && (object.mUpdateFlags & FLAGS_ZLIB_COMPRESSED))
+			{
+				std::vector<U8> inflated(OBJECT_DATA_INFLATED_SIZE);
+				uLongf inflated_size = OBJECT_DATA_INFLATED_SIZE;
+				if (uncompress(&inflated[0], &inflated_size, &object.mData[0], (uLong)data_size) == Z_OK)
+				{
+					inflated.resize(inflated_size);
+				}
+				else
+				{
+					inflated.clear();
+				}
+				object.mData.swap(inflated);
+				sState.mCompressed++;
+			}
+
+			object.mLocalID = 0;
+			object.mPCode = 0;
+			if (!object.mData.empty())
+			{
+				LLDataPackerBinaryBuffer dp(&object.mData[0], (S32)object.mData.size());
+				dp.unpackUUID(object.mFullID, "ID");
+				dp.unpackU32(object.mLocalID, "LocalID");
+				dp.unpackU8(object.mPCode, "PCode");
+			}
+		}
+		sState.mObjects += count;
+	}
+	reader.clearMessage();
+	return ok;
+}
+
+// Checks one message both ways. Returns false if the reader rejected it.
+static bool check_message(LLTemplateMessageReader& reader, LLObjectUpdateDecoder* decoder,
+						  const U8* data, S32 size, const LLHost& sender)
+{
+	ExpectedUpdate expected;
+	if (!read_expected(reader, data, size, sender, expected))
+	{
+		return false;
+	}
+	sState.mExpected.push_back(expected);
+	decoder->queue(data, size, sender);
+	if ((S32)sState.mExpected.size() >= FLUSH_EVERY)
+	{
+		flush(decoder);
+	}
+	return true;
+}
+
+// Random object data: the header processObjectUpdate() unpacks, then
+// mostly zeroes, as object updates are.
+static void make_data(S32 size, std::vector<U8>& data)
+{
+	data.resize(size);
+	for (S32 i = 0; i < size; ++i)
+	{
+		data[i] = (i < 21 || !(rand() % 4)) ? (U8)(rand() % 256) : 0;
+	}
+}
+
+// Builds 'count' random messages with the message system's builder. Some
+// have no objects, half of those without the ObjectData count, as a sender
+// with an older template would leave a trailing variable block out.
+// Returns the number the reader accepted.
+static U32 check_random(LLTemplateMessageReader& reader, LLObjectUpdateDecoder* decoder, U32 count)
+{
+	LLTemplateMessageBuilder builder(gMessageSystem->mMessageTemplates);
+	LLHost sender(ip_string_to_u32("127.0.0.1"), 13000);
+	U8 buffer[NET_BUFFER_SIZE];
+	std::vector<U8> data, compressed;
+	U32 accepted = 0;
+	for (U32 n = 0; n < count; ++n)
+	{
+		builder.newMessage(_PREHASH_ObjectUpdateCompressed);
+		builder.nextBlock(_PREHASH_RegionData);
+		builder.addU64(_PREHASH_RegionHandle, ((U64)rand() << 32) | (U32)rand());
+		builder.addU16(_PREHASH_TimeDilation, (U16)rand());
+		S32 objects = (n % 10) ? 1 + rand() % 12 : 0;
+		for (S32 i = 0; i < objects; ++i)
+		{
+			bool zlib = !(rand() % 3);
+			U32 flags = (U32)rand() & ~FLAGS_ZLIB_COMPRESSED;
+			S32 size = (rand() % 8) ? 21 + rand() % (zlib ? OBJECT_DATA_INFLATED_SIZE - 21 : 200) : rand() % 21;
+			make_data(size, data);
+			if (zlib && size)
+			{
+				flags |= FLAGS_ZLIB_COMPRESSED;
+				uLongf compressed_size = compressBound((uLong)size);
+				compressed.resize(compressed_size);
+				compress(&compressed[0], &compressed_size, &data[0], (uLong)size);
+				compressed.resize(compressed_size);
+				if (!(rand() % 10))
+				{
+					// Corrupt: the decoder must not inflate it either.
+					compressed[compressed_size / 2] ^= 0x5A;
+					compressed.pop_back();
+				}
+				data.swap(compressed);
+			}
+			if (builder.getMessageSize() + 6 + (S32)data.size() > NET_BUFFER_SIZE / 2)
+			{
+				break;
+			}
+			builder.nextBlock(_PREHASH_ObjectData);
+			builder.addU32(_PREHASH_UpdateFlags, flags);
+			builder.addBinaryData(_PREHASH_Data, data.empty() ? NULL : &data[0], (S32)data.size());
+		}
+
+		memset(buffer, 0, LL_PACKET_ID_SIZE);
+		S32 size = (S32)builder.buildMessage(buffer, NET_BUFFER_SIZE, 0);
+		if (!objects && n % 20 && size == LL_PACKET_ID_SIZE + 1 + 8 + 2 + 1 && !buffer[size - 1])
+		{
+			size--;
+		}
+		builder.clearMessage();
+		if (check_message(reader, decoder, buffer, size, sender))
+		{
+			accepted++;
+		}
+	}
+	flush(decoder);
+	return accepted;
+}
+
+// Every ObjectUpdateCompressed in the trace, expanded as the receive
+// thread expands it and without the acks the message system takes off.
+// Returns the number the reader accepted, or -1 if the trace did not load.
+static S32 check_trace(const std::string& filename, LLTemplateMessageReader& reader, LLObjectUpdateDecoder* decoder)
+{
+	LLMessageTrace trace;
+	if (!trace.load(filename))
+	{
+		return -1;
+	}
+	U8 packet[NET_BUFFER_SIZE];
+	U8 expanded[NET_BUFFER_SIZE];
+	LLHost sender, receiving_interface;
+	S32 accepted = 0;
+	while (!trace.isFinished())
+	{
+		while (S32 size = trace.replay((char*)packet, sender, receiving_interface))
+		{
+			size = LLPacketReceiver::expandPacket(packet, size, expanded);
+			if (size && (expanded[0] & LL_ACK_FLAG))
+			{
+				S32 acks = expanded[size - 1];
+				size = (size - 1 >= acks * (S32)sizeof(U32) + LL_MINIMUM_VALID_PACKET_SIZE)
+					   ? size - 1 - acks * (S32)sizeof(U32) : 0;
+			}
+			if (size && LLPacketReceiver::getMessageNumber(expanded, size) == decoder->getMessageNumber()
+				&& check_message(reader, decoder, expanded, size, sender))
+			{
+				accepted++;
+			}
+		}
+		trace.nextFrame();
+	}
+	flush(decoder);
+	return accepted;
+}
+
+static bool report(const std::string& label, U32 messages)
+{
+	U32 matched = sState.mMatched;
+	std::cout << label << matched << " of " << messages << " messages (" << sState.mObjects << " objects, "
+			  << sState.mCompressed << " zlib compressed) decode as the template reader reads them\n";
+	bool ok = (matched == messages);
+	sState.mMatched = sState.mObjects = sState.mCompressed = 0;
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	std::string template_file("message_template.msg");
+	U32 count = 20000;
+	S32 workers = 2;
+	std::vector<std::string> traces;
+
+	for (int arg = 1; arg < argc; ++arg)
+	{
+		std::string option(argv[arg]);
+		bool has_value = (arg + 1 < argc);
+		if ((option == "-t" || option == "--template") && has_value)
+		{
+			template_file = argv[++arg];
+		}
+		else if ((option == "-n" || option == "--messages") && has_value)
+		{
+			count = (U32)llmax(atoi(argv[++arg]), 0);
+		}
+		else if ((option == "-w" || option == "--workers") && has_value)
+		{
+			workers = llmax(atoi(argv[++arg]), 0);
+		}
+		else if (!option.empty() && option[0] != '-')
+		{
+			traces.push_back(option);
+		}
+		else
+		{
+			std::cerr << USAGE;
+			return 1;
+		}
+	}
+
+	LLError::initForApplication(".");
+	ll_init_apr();
+
+	// No circuits: the socket it opens is never read.
+	gMessageSystem = new LLMessageSystem(template_file, 0, 1, 0, 0, false, 5.f, 100.f);
+	message_template_name_map_t::const_iterator object_update = gMessageSystem->mMessageTemplates.find(_PREHASH_ObjectUpdateCompressed);
+	if (!gMessageSystem->isOK() || object_update == gMessageSystem->mMessageTemplates.end())
+	{
+		std::cerr << "Unable to load ObjectUpdateCompressed from " << template_file << "\n";
+		delete gMessageSystem;
+		gMessageSystem = NULL;
+		ll_cleanup_apr();
+		return 1;
+	}
+	gMessageSystem->setHandlerFuncFast(_PREHASH_ObjectUpdateCompressed, ignore_message);
+	gMessageSystem->setExceptionFunc(MX_RAN_OFF_END_OF_PACKET, ran_off_end);
+
+	if (workers)
+	{
+		LLJobSystem::initClass(workers);
+	}
+	LLObjectUpdateDecoder::initClass(object_update->second, apply_batch);
+	LLObjectUpdateDecoder* decoder = LLObjectUpdateDecoder::getInstance();
+	LLTemplateMessageReader reader(gMessageSystem->mMessageNumbers);
+	sState.mNext = 0;
+	sState.mFlushing = false;
+	sState.mMatched = sState.mObjects = sState.mCompressed = 0;
+
+	srand(1);
+	bool ok = report("random:  ", check_random(reader, decoder, count));
+	for (std::vector<std::string>::const_iterator it = traces.begin(); it != traces.end(); ++it)
+	{
+		S32 messages = check_trace(*it, reader, decoder);
+		if (messages < 0)
+		{
+			std::cerr << "Unable to load " << *it << "\n";
+			ok = false;
+			continue;
+		}
+		ok = report(*it + ": ", (U32)messages) && ok;
+	}
+
+	LLObjectUpdateDecoder::cleanupClass();
+	LLJobSystem::cleanupClass();
+	delete gMessageSystem;
+	gMessageSystem = NULL;
+	ll_cleanup_apr();
+	return ok ? 0 : 1;
+}
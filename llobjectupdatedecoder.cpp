@@ -0,0 +1,470 @@
+/**
+ * @file llobjectupdatedecoder.cpp
+ * @brief Decodes ObjectUpdateCompressed messages on the job system.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llobjectupdatedecoder.h"
+
+#include "lldatapacker.h"
+#include "llfasttimer.h"
+#include "lljobsystem.h"
+#include "llmessagetemplate.h"
+#include "llthread.h"
+#include "lltimer.h"
+#include "message.h"
+#include "object_flags.h"
+#include "zlib/zlib.h"
+
+#include <boost/bind.hpp>
+
+static LLFastTimer::DeclareTimer FTM_OBJECT_UPDATE_DECODE_WAIT("Object Update Decode Wait");
+
+// Enough for most packets, so reused entries rarely grow.
+static const size_t RECORDS_RESERVED = 32;
+
+LLObjectUpdateDecoder* LLObjectUpdateDecoder::sInstance = NULL;
+
+static const LLMessageVariable* find_variable(const LLMessageTemplate* message, const char* name)
+{
+	for (LLMessageTemplate::message_block_map_t::const_iterator bit = message->mMemberBlocks.begin();
+		 bit != message->mMemberBlocks.end(); ++bit)
+	{
+		const LLMessageBlock* block = *bit;
+		for (LLMessageBlock::message_variable_map_t::const_iterator vit = block->mMemberVariables.begin();
+			 vit != block->mMemberVariables.end(); ++vit)
+		{
+			if (!strcmp((*vit)->getName(), name))
+			{
+				return *vit;
+			}
+		}
+	}
+	llerrs << message->mName << " has no " << name << llendl;
+	return NULL;
+}
+
+//static
+void LLObjectUpdateDecoder::initClass(const LLMessageTemplate* message, const apply_func_t& apply,
+									  const LLPacketView* current_packet)
+{
+	llassert(!sInstance);
+	sInstance = new LLObjectUpdateDecoder(message, apply, current_packet);
+}
+
+//static
+void LLObjectUpdateDecoder::cleanupClass()
+{
+	delete sInstance;
+	sInstance = NULL;
+}
+
+//static
+void LLObjectUpdateDecoder::processRawMessage(const U8* data, S32 size, const LLHost& sender, void**)
+{
+	if (sInstance)
+	{
+		sInstance->queue(data, size, sender);
+	}
+}
+
+LLObjectUpdateDecoder::LLObjectUpdateDecoder(const LLMessageTemplate* message, const apply_func_t& apply,
+											 const LLPacketView* current_packet)
+:	mTemplate(message),
+	mRegionHandle(find_variable(message, "RegionHandle")),
+	mTimeDilation(find_variable(message, "TimeDilation")),
+	mUpdateFlags(find_variable(message, "UpdateFlags")),
+	mData(find_variable(message, "Data")),
+	mApply(apply),
+	mCurrentPacket(current_packet),
+	mPendingHead(NULL),
+	mPendingTail(NULL),
+	mFree(NULL),
+	mCondition(new LLCondition(NULL)),
+	mJobsQueued(0),
+	mFlushTime(0),
+	mAllocations(0)
+{ }
+
+LLObjectUpdateDecoder::~LLObjectUpdateDecoder()
+{
+	while (mPendingHead)
+	{
+		Pending* pending = mPendingHead;
+		mPendingHead = pending->mNext;
+		waitFor(pending);
+		pending->mNext = mFree;
+		mFree = pending;
+	}
+	// Jobs for entries decoded here or by flush() may still be queued, and
+	// refer to the entries.
+	mCondition->lock();
+	while (mJobsQueued > 0 && LLJobSystem::getInstance())
+	{
+		mCondition->unlock();
+		if (!LLJobSystem::getInstance()->runJob())
+		{
+			ms_sleep(1);
+		}
+		mCondition->lock();
+	}
+	mCondition->unlock();
+	while (mFree)
+	{
+		Pending* pending = mFree;
+		mFree = pending->mNext;
+		delete pending;
+	}
+	delete mCondition;
+}
+
+U32 LLObjectUpdateDecoder::getMessageNumber() const
+{
+	return mTemplate->mMessageNumber;
+}
+
+void LLObjectUpdateDecoder::queue(const U8* data, S32 size, const LLHost& sender)
+{
+	Pending* pending = mFree;
+	if (pending)
+	{
+		mFree = pending->mNext;
+	}
+	else
+	{
+		pending = new Pending;
+		pending->mDecoder = this;
+		pending->mBatch.mRecords.reserve(RECORDS_RESERVED);
+		pending->mRecordCapacity = pending->mBatch.mRecords.capacity();
+		pending->mInflatedCapacity = 0;
+		mAllocations += 2;
+	}
+
+	if (mCurrentPacket && mCurrentPacket->contains(data, size))
+	{
+		// Read in place, the buffer stays ours until the view goes.
+		pending->mView = *mCurrentPacket;
+		pending->mPacket = data;
+	}
+	else
+	{
+		if (pending->mCopy.capacity() < (size_t)size)
+		{
+			// Room for any packet, so it only grows once.
+			pending->mCopy.reserve(llmax((size_t)NET_BUFFER_SIZE, (size_t)size));
+			mAllocations++;
+		}
+		pending->mCopy.assign(data, data + size);
+		pending->mPacket = size ? &pending->mCopy[0] : NULL;
+	}
+	pending->mSize = size;
+	pending->mBatch.mSender = sender;
+	pending->mNext = NULL;
+	if (mPendingTail)
+	{
+		mPendingTail->mNext = pending;
+	}
+	else
+	{
+		mPendingHead = pending;
+	}
+	mPendingTail = pending;
+
+	// Under the lock, so a job left over from the entry's last use sees
+	// it whole if it claims it.
+	LLJobSystem* jobs = LLJobSystem::getInstance();
+	mCondition->lock();
+	pending->mState = PENDING_QUEUED;
+	if (jobs)
+	{
+		mJobsQueued++;
+	}
+	mCondition->unlock();
+	if (jobs)
+	{
+		jobs->submit(JOB_PRIORITY_FRAME, boost::bind(&LLObjectUpdateDecoder::decodeJob, pending));
+	}
+	else
+	{
+		claim(pending);
+		decodeClaimed(pending);
+	}
+}
+
+//static
+void LLObjectUpdateDecoder::decodeJob(Pending* pending)
+{
+	LLObjectUpdateDecoder* self = pending->mDecoder;
+	self->mCondition->lock();
+	self->mJobsQueued--;
+	self->mCondition->unlock();
+	if (self->claim(pending))
+	{
+		self->decodeClaimed(pending);
+	}
+}
+
+bool LLObjectUpdateDecoder::claim(Pending* pending)
+{
+	LLMutexLock lock(mCondition);
+	if (pending->mState != PENDING_QUEUED)
+	{
+		return false;
+	}
+	pending->mState = PENDING_DECODING;
+	return true;
+}
+
+void LLObjectUpdateDecoder::decodeClaimed(Pending* pending)
+{
+	decode(pending->mPacket, pending->mSize, pending->mBatch);
+
+	mCondition->lock();
+	pending->mState = PENDING_DONE;
+	mCondition->broadcast();
+	mCondition->unlock();
+}
+
+void LLObjectUpdateDecoder::waitFor(Pending* pending)
+{
+	if (claim(pending))
+	{
+		// Still queued, perhaps behind texture decode slices.
+		decodeClaimed(pending);
+		return;
+	}
+	LLFastTimer t(FTM_OBJECT_UPDATE_DECODE_WAIT);
+	mCondition->lock();
+	while (pending->mState != PENDING_DONE)
+	{
+		mCondition->wait();
+	}
+	mCondition->unlock();
+}
+
+S32 LLObjectUpdateDecoder::flush()
+{
+	if (!mPendingHead)
+	{
+		return 0;
+	}
+	U64 start = totalTime();
+	S32 objects = 0;
+	while (mPendingHead)
+	{
+		Pending* pending = mPendingHead;
+		mPendingHead = pending->mNext;
+		if (!mPendingHead)
+		{
+			mPendingTail = NULL;
+		}
+		waitFor(pending);
+		if (pending->mBatch.mRecords.capacity() > pending->mRecordCapacity)
+		{
+			// Grown by the decode.
+			pending->mRecordCapacity = pending->mBatch.mRecords.capacity();
+			mAllocations++;
+		}
+		if (pending->mBatch.mInflated.capacity() > pending->mInflatedCapacity)
+		{
+			pending->mInflatedCapacity = pending->mBatch.mInflated.capacity();
+			mAllocations++;
+		}
+
+		if (pending->mBatch.mValid)
+		{
+			mApply(pending->mBatch);
+			objects += (S32)pending->mBatch.mRecords.size();
+		}
+		else
+		{
+			// As LLTemplateMessageReader reports it.
+			llwarns << "Ran off end of " << mTemplate->mName << " from " << pending->mBatch.mSender << llendl;
+			gMessageSystem->callExceptionFunc(MX_RAN_OFF_END_OF_PACKET);
+		}
+
+		// Kept for the next update, with the capacity it has grown to.
+		pending->mView.reset();
+		pending->mBatch.mRecords.clear();
+		pending->mNext = mFree;
+		mFree = pending;
+	}
+	mFlushTime += totalTime() - start;
+	return objects;
+}
+
+U64 LLObjectUpdateDecoder::takeFlushTime()
+{
+	U64 time = mFlushTime;
+	mFlushTime = 0;
+	return time;
+}
+
+void LLObjectUpdateDecoder::decode(const U8* data, S32 size, LLObjectUpdateBatch& batch) const
+{
+	batch.mRegionHandle = 0;
+	batch.mTimeDilation = 0;
+	batch.mRecords.clear();
+	batch.mValid = false;
+
+	// Walked as LLTemplateMessageReader::decodeData() walks it.
+	if (size <= PHL_OFFSET)
+	{
+		return;
+	}
+	S32 pos = LL_PACKET_ID_SIZE + (S32)mTemplate->mFrequency + data[PHL_OFFSET];
+
+	for (LLMessageTemplate::message_block_map_t::const_iterator bit = mTemplate->mMemberBlocks.begin();
+		 bit != mTemplate->mMemberBlocks.end(); ++bit)
+	{
+		const LLMessageBlock* block = *bit;
+		S32 repeat = 1;
+		if (block->mType == MBT_MULTIPLE)
+		{
+			repeat = block->mNumber;
+		}
+		else if (block->mType == MBT_VARIABLE)
+		{
+			// A variable block missing from the end of the message is legal,
+			// and has none.
+			repeat = (pos < size) ? data[pos++] : 0;
+		}
+
+		for (S32 i = 0; i < repeat; ++i)
+		{
+			LLObjectUpdateRecord* record = NULL;
+			for (LLMessageBlock::message_variable_map_t::const_iterator vit = block->mMemberVariables.begin();
+				 vit != block->mMemberVariables.end(); ++vit)
+			{
+				const LLMessageVariable* variable = *vit;
+				S32 field_size = variable->getSize();
+				if (variable->getType() == MVT_VARIABLE)
+				{
+					if (pos + field_size > size)
+					{
+						return;
+					}
+					U32 length = 0;
+					switch (field_size)
+					{
+					case 1:
+						length = data[pos];
+						break;
+					case 2:
+						{
+							U16 length16;
+							htonmemcpy(&length16, &data[pos], MVT_U16, 2);
+							length = length16;
+						}
+						break;
+					default:
+						htonmemcpy(&length, &data[pos], MVT_U32, 4);
+						break;
+					}
+					pos += field_size;
+					field_size = (S32)length;
+				}
+				if (field_size < 0 || pos + field_size > size)
+				{
+					return;
+				}
+
+				const U8* field = &data[pos];
+				pos += field_size;
+				if (variable == mRegionHandle)
+				{
+					htonmemcpy(&batch.mRegionHandle, field, MVT_U64, 8);
+				}
+				else if (variable == mTimeDilation)
+				{
+					htonmemcpy(&batch.mTimeDilation, field, MVT_U16, 2);
+				}
+				else if (variable == mUpdateFlags || variable == mData)
+				{
+					if (!record)
+					{
+						batch.mRecords.push_back(LLObjectUpdateRecord());
+						record = &batch.mRecords.back();
+						record->mUpdateFlags = 0;
+						record->mLocalID = 0;
+						record->mPCode = 0;
+						record->mData = NULL;
+						record->mDataSize = 0;
+					}
+					if (variable == mUpdateFlags)
+					{
+						htonmemcpy(&record->mUpdateFlags, field, MVT_U32, 4);
+					}
+					else
+					{
+						record->mData = field;
+						record->mDataSize = field_size;
+					}
+				}
+			}
+		}
+	}
+
+	// Sized first, as records point into it.
+	size_t compressed = 0;
+	for (std::vector<LLObjectUpdateRecord>::const_iterator it = batch.mRecords.begin(); it != batch.mRecords.end(); ++it)
+	{
+		if (it->mDataSize && (it->mUpdateFlags & FLAGS_ZLIB_COMPRESSED))
+		{
+			compressed++;
+		}
+	}
+	if (batch.mInflated.size() < compressed * OBJECT_DATA_INFLATED_SIZE)
+	{
+		batch.mInflated.resize(compressed * OBJECT_DATA_INFLATED_SIZE);
+	}
+
+	U8* inflated = compressed ? &batch.mInflated[0] : NULL;
+	for (std::vector<LLObjectUpdateRecord>::iterator it = batch.mRecords.begin(); it != batch.mRecords.end(); ++it)
+	{
+		if (!it->mDataSize)
+		{
+			continue;
+		}
+		if (it->mUpdateFlags & FLAGS_ZLIB_COMPRESSED)
+		{
+			uLongf inflated_size = OBJECT_DATA_INFLATED_SIZE;
+			bool ok = uncompress(inflated, &inflated_size, it->mData, (uLong)it->mDataSize) == Z_OK;
+			it->mData = ok ? inflated : NULL;
+			it->mDataSize = ok ? (S32)inflated_size : 0;
+			inflated += OBJECT_DATA_INFLATED_SIZE;
+			if (!ok)
+			{
+				continue;
+			}
+		}
+		// Only read from.
+		LLDataPackerBinaryBuffer dp(const_cast<U8*>(it->mData), it->mDataSize);
+		dp.unpackUUID(it->mFullID, "ID");
+		dp.unpackU32(it->mLocalID, "LocalID");
+		dp.unpackU8(it->mPCode, "PCode");
+	}
+	batch.mValid = true;
+}
@@ -0,0 +1,179 @@
+/**
+ * @file llobjectupdatedecoder.h
+ * @brief Decodes ObjectUpdateCompressed messages on the job system.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLOBJECTUPDATEDECODER_H
+#define LL_LLOBJECTUPDATEDECODER_H
+
+#include "llhost.h"
+#include "llpacketbuffer.h"
+#include "lluuid.h"
+
+#include <boost/function.hpp>
+#include <vector>
+
+class LLCondition;
+class LLMessageTemplate;
+class LLMessageVariable;
+
+// Compressed object data inflates into a buffer this size, as it does in
+// LLViewerObjectList::processObjectUpdate().
+const S32 OBJECT_DATA_INFLATED_SIZE = 2048;
+
+// One ObjectData block of an ObjectUpdateCompressed message, with the
+// header of its data unpacked as LLViewerObjectList::processObjectUpdate()
+// unpacks it.
+struct LLObjectUpdateRecord
+{
+	U32				mUpdateFlags;
+	LLUUID			mFullID;
+	U32				mLocalID;
+	U8				mPCode;
+	const U8*		mData;		// the whole Data field, header included, in the packet or inflated
+	S32				mDataSize;	// 0 if it was compressed and would not inflate
+};
+
+struct LLObjectUpdateBatch
+{
+	LLHost								mSender;
+	U64									mRegionHandle;
+	U16									mTimeDilation;
+	std::vector<LLObjectUpdateRecord>	mRecords;
+	std::vector<U8>						mInflated;	// data of compressed records
+	bool								mValid;		// false if it ran off the end of the packet
+};
+
+// Takes ObjectUpdateCompressed messages from the message system before
+// LLTemplateMessageReader decodes them, and decodes each into an
+// LLObjectUpdateBatch on the job system, without building the message
+// system's per-variable data. The main thread then applies the batches to
+// the object list in the order the messages arrived.
+//
+// The decode only reads the packet and the message template, so it gives
+// the same records wherever it runs; with no job system it runs in
+// queue(). Records point into the packet rather than copying their data,
+// so a batch is only good while it is being applied. Data the simulator
+// sent zlib compressed (FLAGS_ZLIB_COMPRESSED) is inflated into the batch,
+// into at most OBJECT_DATA_INFLATED_SIZE bytes as processObjectUpdate()
+// inflates it. The packet is kept by a view of the receive buffer it
+// arrived in when there is one, and copied otherwise; the queue entries
+// are reused, so once they have grown to the load, queueing an update
+// allocates nothing.
+//
+// For every other message to see the objects as it would have without
+// this, flush() must be called before the message system is given anything
+// but another ObjectUpdateCompressed, see idleNetwork(). flush() decodes
+// any message no job has started on itself, rather than wait for a worker
+// to get to it.
+//
+// Main thread, but for the decode jobs.
+class LLObjectUpdateDecoder
+{
+public:
+	typedef boost::function<void (const LLObjectUpdateBatch&)> apply_func_t;
+
+	// 'current_packet' is the view of the packet the message system is
+	// reading, see LLPacketReceiver::getCurrentPacket(), or NULL.
+	static void initClass(const LLMessageTemplate* message, const apply_func_t& apply,
+						  const LLPacketView* current_packet = NULL);
+	// Waits for the decode jobs, queued batches are dropped. Before the job
+	// system goes.
+	static void cleanupClass();
+	static LLObjectUpdateDecoder* getInstance()	{ return sInstance; }
+
+	// Message system raw handler for ObjectUpdateCompressed. 'size' leaves
+	// out appended acks.
+	static void processRawMessage(const U8* data, S32 size, const LLHost& sender, void** user_data);
+
+	void queue(const U8* data, S32 size, const LLHost& sender);
+	// Applies every queued batch, returns the number of objects updated.
+	S32 flush();
+	// Microseconds spent in flush() since the last call, so the time can be
+	// put down to object updates rather than the message that caused it.
+	U64 takeFlushTime();
+
+	bool hasPending() const			{ return mPendingHead != NULL; }
+	U32 getMessageNumber() const;
+	// Heap allocations made for queued updates: new queue entries, and
+	// growing their packet copies, record lists and inflated data.
+	U32 getAllocationCount() const	{ return mAllocations; }
+
+	// Any thread.
+	void decode(const U8* data, S32 size, LLObjectUpdateBatch& batch) const;
+
+private:
+	LLObjectUpdateDecoder(const LLMessageTemplate* message, const apply_func_t& apply,
+						  const LLPacketView* current_packet);
+	~LLObjectUpdateDecoder();
+
+	struct Pending
+	{
+		LLObjectUpdateDecoder*	mDecoder;
+		Pending*				mNext;
+		LLPacketView			mView;		// the packet, or empty if copied
+		std::vector<U8>			mCopy;
+		const U8*				mPacket;
+		S32						mSize;
+		LLObjectUpdateBatch		mBatch;
+		size_t					mRecordCapacity;
+		size_t					mInflatedCapacity;
+		S32						mState;		// guarded by mCondition
+	};
+
+	enum
+	{
+		PENDING_QUEUED = 0,
+		PENDING_DECODING,
+		PENDING_DONE
+	};
+
+	// Job system thread. Static, so the job fits in a job_func_t without
+	// allocating. Does nothing if the entry is not waiting to be decoded,
+	// which is the case once flush() has decoded it itself.
+	static void decodeJob(Pending* pending);
+	// Decodes the entry on this thread if no job has started on it.
+	bool claim(Pending* pending);
+	void decodeClaimed(Pending* pending);
+	void waitFor(Pending* pending);
+
+	const LLMessageTemplate*	mTemplate;
+	const LLMessageVariable*	mRegionHandle;
+	const LLMessageVariable*	mTimeDilation;
+	const LLMessageVariable*	mUpdateFlags;
+	const LLMessageVariable*	mData;
+	apply_func_t				mApply;
+	const LLPacketView*			mCurrentPacket;
+	Pending*					mPendingHead;	// oldest first
+	Pending*					mPendingTail;
+	Pending*					mFree;			// to reuse
+	LLCondition*				mCondition;
+	S32							mJobsQueued;	// guarded by mCondition
+	U64							mFlushTime;
+	U32							mAllocations;
+
+	static LLObjectUpdateDecoder*	sInstance;
+};
+
+#endif
@@ -0,0 +1,426 @@
+/**
+ * @file llpacketbench.cpp
+ * @brief Measures the packet receive thread against a local UDP sender.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+// Usage:
+//   llpacketbench [options]
+//
+// Sends zero coded packets shaped like a burst of object updates over
+// loopback to an LLPacketReceiver, with the main thread taking them off as
+// idleNetwork() would, once reading a packet per system call and once per
+// batch (recvmmsg(), Linux only; elsewhere both runs read one at a time).
+// For each it prints packets per second, packets per receive call and the
+// receive thread's cost per packet.
+//
+// With --check it instead checks LLPacketReceiver::expandPacket() against
+// the message system's expansion on random packets, and that packets sent
+// over loopback come out of the receive thread whole and in order. It
+// exits with 1 if either fails.
+
+#include "linden_common.h"
+#include "llapr.h"
+#include "llerrorcontrol.h"
+#include "llthread.h"
+#include "lltimer.h"
+#include "message.h"
+#include "net.h"
+
+#include "llpacketreceiver.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+static const char USAGE[] = "\n"
+"usage:\tllpacketbench [options]\n"
+"\n"
+" -n, --packets <n>\n"
+"        Packets per run (default 200000).\n"
+" -s, --size <bytes>\n"
+"        Unencoded message size (default 600).\n"
+" -b, --batch <n>\n"
+"        Datagrams per recvmmsg() call in the batched run (default 32).\n"
+" -r, --burst <n>\n"
+"        Packets the sender sends between yields (default 64).\n"
+" -c, --check\n"
+"        Check packet expansion and the receive thread instead, with\n"
+"        --packets random packets each (default 20000).\n"
+"\n";
+
+// Zero codes as LLMessageSystem::zeroCode() does, after the packet id.
+static void zero_code(const std::vector<U8>& message, std::vector<U8>& packet)
+{
+	packet.assign(message.begin(), message.begin() + LL_PACKET_ID_SIZE);
+	packet[0] |= LL_ZERO_CODE_FLAG;
+	size_t i = LL_PACKET_ID_SIZE;
+	while (i < message.size())
+	{
+		if (message[i])
+		{
+			packet.push_back(message[i++]);
+			continue;
+		}
+		U8 zeroes = 0;
+		while (i < message.size() && !message[i] && zeroes < 255)
+		{
+			zeroes++;
+			i++;
+		}
+		packet.push_back(0);
+		packet.push_back(zeroes);
+	}
+}
+
+// Expands the 'size' bytes of a zero coded packet body into 'out' as
+// LLMessageSystem::zeroCodeExpand() does, less its buffer size check, so
+// 'out' has room for 256 bytes per byte in. Returns the expanded size.
+static S32 zero_code_expand(const U8* in, S32 size, std::vector<U8>& out)
+{
+	out.assign(LL_PACKET_ID_SIZE + (size_t)size * 256, 0);
+	S32 count = size;
+	const U8* inptr = in;
+	U8* outptr = &out[0];
+	for (S32 i = 0; i < LL_PACKET_ID_SIZE; ++i)
+	{
+		count--;
+		*outptr++ = *inptr++;
+	}
+	out[0] &= ~LL_ZERO_CODE_FLAG;
+	while (count--)
+	{
+		if (!(*outptr++ = *inptr++))
+		{
+			while ((count--) && !(*inptr))
+			{
+				*outptr++ = *inptr++;
+				outptr += 255;
+			}
+			if (count < 0)
+			{
+				break;
+			}
+			outptr += *inptr - 1;
+			inptr++;
+		}
+	}
+	return (S32)(outptr - &out[0]);
+}
+
+// A random message of 'size' bytes, a third of them set after the header.
+static void make_message(S32 size, U32 id, std::vector<U8>& message)
+{
+	message.resize(size);
+	for (S32 i = 0; i < size; ++i)
+	{
+		message[i] = (rand() % 3) ? 0 : (U8)(1 + rand() % 255);
+	}
+	// Flags, big endian sequence number, no extra header.
+	message[0] = LL_RELIABLE_FLAG;
+	message[1] = (U8)(id >> 24);
+	message[2] = (U8)(id >> 16);
+	message[3] = (U8)(id >> 8);
+	message[4] = (U8)id;
+	message[5] = 0;
+}
+
+// Half the packets are zero coded messages, half random bytes after the
+// header, mostly zeroes, which is how runs longer than 255 zeroes and a
+// zero as the last byte come up. Some have acks appended, which are not
+// coded. Returns the number that came out wrong.
+static U32 check_expand(U32 count)
+{
+	U32 bad = 0;
+	std::vector<U8> message, packet, expected;
+	U8 out[NET_BUFFER_SIZE];
+	for (U32 n = 0; n < count; ++n)
+	{
+		S32 size = LL_MINIMUM_VALID_PACKET_SIZE + rand() % 3000;
+		make_message(size, n, message);
+		if (n % 2)
+		{
+			zero_code(message, packet);
+		}
+		else
+		{
+			packet = message;
+			packet[0] |= LL_ZERO_CODE_FLAG;
+			for (S32 i = LL_PACKET_ID_SIZE; i < size; ++i)
+			{
+				packet[i] = (rand() % 4) ? 0 : (U8)(rand() % 256);
+			}
+		}
+		const S32 body_size = (S32)packet.size();
+		S32 acks = rand() % 3;
+		if (acks)
+		{
+			packet[0] |= LL_ACK_FLAG;
+			for (S32 i = 0; i < acks * (S32)sizeof(U32); ++i)
+			{
+				packet.push_back((U8)(rand() % 256));
+			}
+			packet.push_back((U8)acks);
+		}
+
+		S32 expanded_size = zero_code_expand(&packet[0], body_size, expected);
+		expected.resize(expanded_size);
+		expected.insert(expected.end(), packet.begin() + body_size, packet.end());
+		if (expected.size() > NET_BUFFER_SIZE)
+		{
+			// Too big: dropped.
+			expected.clear();
+		}
+		else if (n % 2 && (expanded_size != size || !std::equal(message.begin() + 1, message.end(), expected.begin() + 1)))
+		{
+			bad++;
+			continue;
+		}
+
+		S32 out_size = LLPacketReceiver::expandPacket(&packet[0], (S32)packet.size(), out);
+		if (out_size != (S32)expected.size() || (out_size && memcmp(out, &expected[0], out_size)))
+		{
+			bad++;
+		}
+	}
+	return bad;
+}
+
+// Sends 'count' zero coded messages over loopback to a receive thread,
+// a few at a time so none are dropped, and checks each comes back
+// expanded and in order. Returns the number received, 'bad' the number
+// that were wrong or out of order.
+static U32 check_loopback(U32 count, S32 batch_size, U32& bad)
+{
+	bad = 0;
+	S32 receive_socket = 0, send_socket = 0;
+	int receive_port = NET_USE_OS_ASSIGNED_PORT, send_port = NET_USE_OS_ASSIGNED_PORT;
+	if (start_net(receive_socket, receive_port) || start_net(send_socket, send_port))
+	{
+		std::cerr << "Unable to open loopback sockets\n";
+		return 0;
+	}
+
+	LLPacketReceiver receiver(receive_socket, batch_size);
+	receiver.start();
+	U32 address = ip_string_to_u32("127.0.0.1");
+
+	std::vector<std::vector<U8> > messages(count);
+	std::vector<U8> packet;
+	U32 sent = 0, taken = 0;
+	const char* data = NULL;
+	LLHost host, receiving_interface;
+	LLTimer idle;
+	while (taken < count && idle.getElapsedTimeF32() < 1.f)
+	{
+		for (U32 burst = 0; burst < 50 && sent < count; ++burst, ++sent)
+		{
+			make_message(LL_MINIMUM_VALID_PACKET_SIZE + rand() % 1200, sent, messages[sent]);
+			zero_code(messages[sent], packet);
+			send_packet(send_socket, (const char*)&packet[0], (int)packet.size(), address, receive_port);
+		}
+		ms_sleep(2);
+		while (S32 size = receiver.nextPacketView(data, host, receiving_interface))
+		{
+			const std::vector<U8>& message = messages[taken];
+			if (size != (S32)message.size()
+				|| (U8)data[0] != message[0]
+				|| memcmp(data + 1, &message[1], size - 1))
+			{
+				bad++;
+			}
+			taken++;
+			idle.reset();
+		}
+	}
+
+	receiver.shutdown();
+	end_net(send_socket);
+	end_net(receive_socket);
+	return taken;
+}
+
+static int check(U32 count, S32 batch_size)
+{
+	srand(1);
+	U32 expand_bad = check_expand(count);
+	std::cout << "expand:    " << count - expand_bad << " of " << count << " packets match zeroCodeExpand()\n";
+
+	U32 loopback_bad = 0;
+	U32 received = check_loopback(count, batch_size, loopback_bad);
+	std::cout << "loopback:  " << received - loopback_bad << " of " << count << " packets received whole and in order\n";
+
+	return (expand_bad || received != count || loopback_bad) ? 1 : 0;
+}
+
+// The stand-in region: sends the same packets as fast as the socket takes
+// them, a burst at a time.
+class LLPacketSender : public LLThread
+{
+public:
+	LLPacketSender(S32 socket, U32 address, S32 port, const std::vector<std::vector<U8> >& packets,
+				   U32 count, U32 burst)
+	:	LLThread("Packet sender"),
+		mSocket(socket),
+		mAddress(address),
+		mPort(port),
+		mPackets(packets),
+		mCount(count),
+		mBurst(burst)
+	{ }
+
+	/*virtual*/ void run()
+	{
+		for (U32 sent = 0; sent < mCount && !isQuitting(); ++sent)
+		{
+			const std::vector<U8>& packet = mPackets[sent % mPackets.size()];
+			send_packet(mSocket, (const char*)&packet[0], (int)packet.size(), mAddress, mPort);
+			if (sent % mBurst == mBurst - 1)
+			{
+				ms_sleep(0);
+			}
+		}
+	}
+
+private:
+	S32									mSocket;
+	U32									mAddress;
+	S32									mPort;
+	const std::vector<std::vector<U8> >&	mPackets;
+	U32									mCount;
+	U32									mBurst;
+};
+
+static void run(const char* label, S32 batch_size, const std::vector<std::vector<U8> >& packets, U32 count, U32 burst)
+{
+	S32 receive_socket = 0, send_socket = 0;
+	int receive_port = NET_USE_OS_ASSIGNED_PORT, send_port = NET_USE_OS_ASSIGNED_PORT;
+	if (start_net(receive_socket, receive_port) || start_net(send_socket, send_port))
+	{
+		std::cerr << "Unable to open loopback sockets\n";
+		return;
+	}
+
+	LLPacketReceiver receiver(receive_socket, batch_size);
+	receiver.start();
+	LLPacketSender sender(send_socket, ip_string_to_u32("127.0.0.1"), receive_port, packets, count, burst);
+
+	LLTimer timer;
+	sender.start();
+	const char* data = NULL;
+	LLHost host, receiving_interface;
+	U32 taken = 0;
+	LLTimer idle;
+	// Until everything is in, or nothing has come for a second: loopback
+	// drops what does not fit in the socket buffer.
+	while (taken < count && idle.getElapsedTimeF32() < 1.f)
+	{
+		if (receiver.nextPacketView(data, host, receiving_interface))
+		{
+			taken++;
+			idle.reset();
+		}
+	}
+	F64 seconds = timer.getElapsedTimeF64() - (taken < count ? 1.0 : 0.0);
+
+	sender.shutdown();
+	receiver.shutdown();
+	end_net(send_socket);
+	end_net(receive_socket);
+
+	U32 calls = llmax(receiver.getReceiveCalls(), (U32)1);
+	std::cout << std::left << std::setw(12) << label << std::right << std::fixed
+			  << std::setw(9) << taken << " of " << count << " packets"
+			  << std::setw(12) << std::setprecision(0) << taken / llmax(seconds, 0.000001) << " /s"
+			  << std::setw(8) << std::setprecision(2) << (F64)receiver.getReceivedCount() / calls << " per call"
+			  << std::setw(8) << std::setprecision(2) << seconds * 1000000.0 / llmax(taken, (U32)1) << " us each\n";
+}
+
+int main(int argc, char** argv)
+{
+	U32 count = 0;
+	S32 size = 600;
+	S32 batch = LLPacketReceiver::DEFAULT_BATCH_SIZE;
+	U32 burst = 64;
+	bool checking = false;
+
+	for (int arg = 1; arg < argc; ++arg)
+	{
+		std::string option(argv[arg]);
+		bool has_value = (arg + 1 < argc);
+		if ((option == "-n" || option == "--packets") && has_value)
+		{
+			count = (U32)llmax(atoi(argv[++arg]), 1);
+		}
+		else if ((option == "-s" || option == "--size") && has_value)
+		{
+			size = llclamp(atoi(argv[++arg]), LL_MINIMUM_VALID_PACKET_SIZE, 4000);
+		}
+		else if ((option == "-b" || option == "--batch") && has_value)
+		{
+			batch = llmax(atoi(argv[++arg]), 2);
+		}
+		else if ((option == "-r" || option == "--burst") && has_value)
+		{
+			burst = (U32)llmax(atoi(argv[++arg]), 1);
+		}
+		else if (option == "-c" || option == "--check")
+		{
+			checking = true;
+		}
+		else
+		{
+			std::cerr << USAGE;
+			return 1;
+		}
+	}
+
+	LLError::initForApplication(".");
+	ll_init_apr();
+
+	if (checking)
+	{
+		int result = check(count ? count : 20000, batch);
+		ll_cleanup_apr();
+		return result;
+	}
+	count = count ? count : 200000;
+
+	// Object updates are mostly zeroes: a third of the bytes set.
+	std::vector<std::vector<U8> > packets(64);
+	std::vector<U8> message;
+	for (size_t p = 0; p < packets.size(); ++p)
+	{
+		make_message(size, (U32)p + 1, message);
+		zero_code(message, packets[p]);
+	}
+
+	std::cout << count << " packets of " << packets[0].size() << " bytes, " << size << " expanded\n";
+	run("single", 1, packets, count, burst);
+	run(llformat("batch %d", batch).c_str(), batch, packets, count, burst);
+
+	ll_cleanup_apr();
+	return 0;
+}
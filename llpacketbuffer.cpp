@@ -0,0 +1,121 @@
+/**
+ * @file llpacketbuffer.cpp
+ * @brief Fixed pool of packet buffers, shared through reference counted views.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llpacketbuffer.h"
+
+LLPacketBufferPool::LLPacketBufferPool()
+:	mBuffers(new LLPacketBuffer[POOL_SIZE]),
+	mAllocations(1)
+{
+	mExhausted = 0;
+	for (U16 i = 0; i < POOL_SIZE; ++i)
+	{
+		mBuffers[i].mRefs = 0;
+		mBuffers[i].mSize = 0;
+		mBuffers[i].mMessageNumber = 0;
+		mFree.push(i);
+	}
+}
+
+LLPacketBufferPool::~LLPacketBufferPool()
+{
+	delete[] mBuffers;
+}
+
+bool LLPacketBufferPool::acquire(U16& index)
+{
+	if (!mFree.pop(index))
+	{
+		mExhausted++;
+		return false;
+	}
+	return true;
+}
+
+void LLPacketBufferPool::release(U16 index)
+{
+	LLPacketBuffer& buffer = mBuffers[index];
+	llassert(buffer.mRefs > 0);
+	if (!--buffer.mRefs)
+	{
+		// There is room for every buffer.
+		mFree.push(index);
+	}
+}
+
+//----------------------------------------------------------------------------
+
+LLPacketView::LLPacketView(LLPacketBufferPool* pool, U16 index)
+:	mPool(pool),
+	mIndex(index)
+{
+	mPool->addRef(mIndex);
+}
+
+LLPacketView::LLPacketView(const LLPacketView& other)
+:	mPool(other.mPool),
+	mIndex(other.mIndex)
+{
+	if (mPool)
+	{
+		mPool->addRef(mIndex);
+	}
+}
+
+LLPacketView& LLPacketView::operator=(const LLPacketView& other)
+{
+	// Referenced first, in case both are the last view of the same buffer.
+	if (other.mPool)
+	{
+		other.mPool->addRef(other.mIndex);
+	}
+	reset();
+	mPool = other.mPool;
+	mIndex = other.mIndex;
+	return *this;
+}
+
+void LLPacketView::reset()
+{
+	if (mPool)
+	{
+		mPool->release(mIndex);
+		mPool = NULL;
+		mIndex = 0;
+	}
+}
+
+bool LLPacketView::contains(const U8* data, S32 size) const
+{
+	if (!mPool)
+	{
+		return false;
+	}
+	const LLPacketBuffer& buffer = mPool->get(mIndex);
+	return data >= buffer.mData && size >= 0 && data + size <= buffer.mData + buffer.mSize;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file llpacketbuffer.h
+ * @brief Fixed pool of packet buffers, shared through reference counted views.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLPACKETBUFFER_H
+#define LL_LLPACKETBUFFER_H
+
+#include "llhost.h"
+#include "llspscring.h"
+#include "net.h"
+
+// One received packet, expanded.
+struct LLPacketBuffer
+{
+	LLHost	mSender;
+	LLHost	mReceivingInterface;
+	U32		mMessageNumber;
+	S32		mSize;
+	S32		mCodedSize;	// as received, 0 if it was not zero coded
+	U32		mRefs;		// main thread, see LLPacketView
+	U8		mData[NET_BUFFER_SIZE];
+};
+
+// Every buffer the packet receiver reads into, allocated once. A buffer
+// goes from the receive thread to the main thread, which passes views of
+// it around instead of copying the packet: the message system reads from
+// it, and a handler that wants the packet later, such as the object update
+// decoder, keeps a view rather than a copy. It goes back to the receive
+// thread when the last view is gone.
+//
+// The receive thread takes buffers and the main thread gives them back,
+// through a single-producer ring, so neither locks or allocates.
+class LLPacketBufferPool
+{
+public:
+	enum { POOL_SIZE = 256 };	// power of two
+
+	LLPacketBufferPool();
+	~LLPacketBufferPool();
+
+	// Receive thread. Returns false if every buffer is in use.
+	bool acquire(U16& index);
+	LLPacketBuffer& get(U16 index)				{ return mBuffers[index]; }
+	const LLPacketBuffer& get(U16 index) const	{ return mBuffers[index]; }
+
+	// Main thread.
+	void addRef(U16 index)						{ mBuffers[index].mRefs++; }
+	void release(U16 index);
+
+	// Any thread, approximate.
+	U32 getFreeCount() const					{ return mFree.size(); }
+	// Times the receive thread found no buffer free.
+	U32 getExhaustedCount() const				{ return mExhausted.CurrentValue(); }
+	// Heap allocations made by the pool, all of them in the constructor.
+	U32 getAllocationCount() const				{ return mAllocations; }
+
+private:
+	LLPacketBuffer*					mBuffers;	// POOL_SIZE
+	LLSPSCRing<U16, POOL_SIZE>		mFree;
+	LLAtomicU32						mExhausted;
+	U32								mAllocations;
+};
+
+// A reference to one buffer of an LLPacketBufferPool, which stays valid
+// and unchanged for as long as any view of it exists. Copying a view only
+// counts a reference.
+//
+// Main thread only, but a job may read a buffer while the main thread
+// holds a view of it.
+class LLPacketView
+{
+public:
+	LLPacketView()
+	:	mPool(NULL),
+		mIndex(0)
+	{ }
+	// Takes a reference.
+	LLPacketView(LLPacketBufferPool* pool, U16 index);
+	LLPacketView(const LLPacketView& other);
+	LLPacketView& operator=(const LLPacketView& other);
+	~LLPacketView()								{ reset(); }
+
+	void reset();
+	bool notNull() const						{ return mPool != NULL; }
+	bool isNull() const							{ return mPool == NULL; }
+
+	const U8* getData() const					{ return mPool->get(mIndex).mData; }
+	S32 getSize() const							{ return mPool->get(mIndex).mSize; }
+	const LLHost& getSender() const				{ return mPool->get(mIndex).mSender; }
+	const LLHost& getReceivingInterface() const	{ return mPool->get(mIndex).mReceivingInterface; }
+	U32 getMessageNumber() const				{ return mPool->get(mIndex).mMessageNumber; }
+
+	// Whether 'data' lies in this buffer, e.g. a field a handler was given.
+	bool contains(const U8* data, S32 size) const;
+
+private:
+	LLPacketBufferPool*	mPool;
+	U16					mIndex;
+};
+
+#endif
@@ -0,0 +1,644 @@
+/**
+ * @file llpacketreceiver.cpp
+ * @brief Reads and expands UDP packets on their own thread for the message system.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llpacketreceiver.h"
+
+#include "lltimer.h"
+#include "message.h"
+
+#include <algorithm>
+#include <vector>
+
+#if LL_LINUX
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+#if !LL_WINDOWS
+#include <sys/select.h>
+#endif
+
+// Short enough for shutdown not to wait on it.
+static const S32 RECEIVE_WAIT_MS = 10;
+
+static const char* CONTROL_MESSAGES[] =
+{
+	"PacketAck", "StartPingCheck", "CompletePingCheck",
+	NULL
+};
+
+static const char* CRITICAL_MESSAGES[] =
+{
+	"AgentMovementComplete", "AgentDataUpdate", "CrossedRegion", "RegionHandshake",
+	"EnableSimulator", "DisableSimulator", "KickUser", "LogoutReply",
+	"TeleportStart", "TeleportProgress", "TeleportFailed", "TeleportFinish", "TeleportLocal",
+	"ChatFromSimulator", "ImprovedInstantMessage", "AlertMessage", "AgentAlertMessage",
+	"AvatarSitResponse", "ScriptDialog", "ScriptQuestion", "ScriptTeleportRequest",
+	NULL
+};
+
+static const char* OBJECT_MESSAGES[] =
+{
+	"ObjectUpdate", "ObjectUpdateCompressed", "ObjectUpdateCached", "ImprovedTerseObjectUpdate", "KillObject",
+	NULL
+};
+
+#if LL_LINUX
+// Everything one recvmmsg() call reads into, set up once.
+struct LLPacketReceiver::Batch
+{
+	Batch(S32 size)
+	:	mHeaders(size),
+		mVectors(size),
+		mAddresses(size),
+		mControl(size * CONTROL_SIZE)
+	{
+		for (S32 i = 0; i < size; ++i)
+		{
+			mVectors[i].iov_len = NET_BUFFER_SIZE;
+			msghdr& header = mHeaders[i].msg_hdr;
+			memset(&header, 0, sizeof(header));
+			header.msg_iov = &mVectors[i];
+			header.msg_iovlen = 1;
+			header.msg_name = &mAddresses[i];
+			header.msg_control = &mControl[i * CONTROL_SIZE];
+		}
+	}
+
+	// Reads datagram 'i' into 'buffer'. The kernel writes back the lengths.
+	void reset(S32 i, U8* buffer)
+	{
+		mVectors[i].iov_base = buffer;
+		mHeaders[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+		mHeaders[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+	}
+
+	enum { CONTROL_SIZE = 64 };	// room for IP_PKTINFO
+
+	std::vector<mmsghdr>		mHeaders;
+	std::vector<iovec>			mVectors;
+	std::vector<sockaddr_in>	mAddresses;
+	std::vector<U8>				mControl;
+};
+#else
+struct LLPacketReceiver::Batch
+{ };
+#endif
+
+LLPacketReceiver::LLPacketReceiver(S32 socket, S32 batch_size)
+:	LLThread("Packet receiver"),
+	mSocket(socket),
+	mBatchSize(llclamp(batch_size, 1, (S32)POOL_SIZE)),
+	mBatch(NULL),
+	mHeldCount(0),
+	mSpare(0),
+	mHaveSpare(false),
+	mSenderQueued(0),
+	mFarCursor(0),
+	mTaken(0),
+	mExpandedPackets(0),
+	mCodedBytes(0),
+	mExpandedBytes(0)
+{
+	mDropped = 0;
+	mReceived = 0;
+	mReceiveCalls = 0;
+#if LL_LINUX
+	if (mBatchSize > 1)
+	{
+		mBatch = new Batch(mBatchSize);
+	}
+#endif
+}
+
+LLPacketReceiver::~LLPacketReceiver()
+{
+	shutdown();
+	mCurrent.reset();
+	delete mBatch;
+}
+
+void LLPacketReceiver::run()
+{
+	while (!isQuitting())
+	{
+		if (!mHaveSpare)
+		{
+			mHaveSpare = mPool.acquire(mSpare);
+		}
+		if (!mHaveSpare || !holdBuffers(mBatch ? mBatchSize : 1))
+		{
+			// The main thread is behind, the socket buffers for us.
+			ms_sleep(1);
+			continue;
+		}
+		if (!waitForData(RECEIVE_WAIT_MS))
+		{
+			continue;
+		}
+
+		if (mBatch)
+		{
+			receiveBatch();
+		}
+		else
+		{
+			receiveOne();
+		}
+	}
+}
+
+S32 LLPacketReceiver::holdBuffers(S32 count)
+{
+	// Kept from one read to the next, the pool only takes them back from
+	// the main thread.
+	while (mHeldCount < count && mPool.acquire(mHeld[mHeldCount]))
+	{
+		mHeldCount++;
+	}
+	return mHeldCount;
+}
+
+bool LLPacketReceiver::waitForData(S32 ms)
+{
+	fd_set readable;
+	FD_ZERO(&readable);
+	FD_SET(mSocket, &readable);
+	struct timeval timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = ms * 1000;
+	return select(mSocket + 1, &readable, NULL, NULL, &timeout) > 0;
+}
+
+void LLPacketReceiver::receiveOne()
+{
+	U16 index = mHeld[mHeldCount - 1];
+	S32 size = receive_packet(mSocket, (char*)mPool.get(index).mData);
+	mReceiveCalls++;
+	if (size > 0)
+	{
+		mHeldCount--;
+		// Both describe the packet receive_packet() just read; this is the
+		// only thread calling it.
+		queuePacket(index, size, get_sender(), get_receiving_interface());
+	}
+}
+
+void LLPacketReceiver::receiveBatch()
+{
+#if LL_LINUX
+	S32 count = mHeldCount;
+	for (S32 i = 0; i < count; ++i)
+	{
+		mBatch->reset(i, mPool.get(mHeld[i]).mData);
+	}
+	S32 received = recvmmsg(mSocket, &mBatch->mHeaders[0], count, MSG_DONTWAIT, NULL);
+	mReceiveCalls++;
+
+	// Buffers not read into stay held, packed at the front, and so do those
+	// of packets bigger than any message, dropped as receive_packet() would
+	// cut them.
+	mHeldCount = 0;
+	for (S32 i = 0; i < count; ++i)
+	{
+		U16 index = mHeld[i];
+		msghdr& header = mBatch->mHeaders[i].msg_hdr;
+		if (i >= received || (header.msg_flags & MSG_TRUNC))
+		{
+			mHeld[mHeldCount++] = index;
+			continue;
+		}
+		const sockaddr_in& address = mBatch->mAddresses[i];
+		LLHost receiving_interface;
+		for (cmsghdr* control = CMSG_FIRSTHDR(&header); control; control = CMSG_NXTHDR(&header, control))
+		{
+			if (control->cmsg_level == IPPROTO_IP && control->cmsg_type == IP_PKTINFO)
+			{
+				const in_pktinfo* info = (const in_pktinfo*)CMSG_DATA(control);
+				receiving_interface = LLHost(info->ipi_addr.s_addr, 0);
+			}
+		}
+		queuePacket(index, (S32)mBatch->mHeaders[i].msg_len,
+					LLHost(address.sin_addr.s_addr, ntohs(address.sin_port)), receiving_interface);
+	}
+#endif
+}
+
+void LLPacketReceiver::queuePacket(U16 index, S32 size, const LLHost& sender, const LLHost& receiving_interface)
+{
+	LLPacketBuffer* packet = &mPool.get(index);
+	S32 coded_size = 0;
+	if (size >= LL_MINIMUM_VALID_PACKET_SIZE && (packet->mData[0] & LL_ZERO_CODE_FLAG))
+	{
+		// Expanded into the spare, which takes the packet's place.
+		coded_size = size;
+		size = expandPacket(packet->mData, size, mPool.get(mSpare).mData);
+		if (!size)
+		{
+			// The message system could not have expanded it either. Kept
+			// for the next read, the pool only takes buffers back from the
+			// main thread.
+			mHeld[mHeldCount++] = index;
+			mDropped++;
+			return;
+		}
+		std::swap(index, mSpare);
+		packet = &mPool.get(index);
+	}
+	packet->mCodedSize = coded_size;
+	packet->mSender = sender;
+	packet->mReceivingInterface = receiving_interface;
+	packet->mSize = size;
+	packet->mMessageNumber = getMessageNumber(packet->mData, size);
+
+	std::map<U32, U8>::const_iterator found = mLanes.find(packet->mMessageNumber);
+	ELane lane = (found != mLanes.end()) ? (ELane)found->second : LANE_BULK;
+	mPacketLanes[index] = (U8)lane;
+	S32 ring = RING_SENDERS;
+	if (lane == LANE_CONTROL)
+	{
+		ring = RING_CONTROL;
+	}
+	else if (lane == LANE_BULK)
+	{
+		ring = RING_BULK;
+	}
+	// Never full, no ring holds more than the pool.
+	mFull[ring].push(index);
+	mReceived++;
+}
+
+//static
+LLPacketReceiver::ELane LLPacketReceiver::getLaneForMessage(const std::string& name)
+{
+	for (const char** it = CONTROL_MESSAGES; *it; ++it)
+	{
+		if (name == *it)
+		{
+			return LANE_CONTROL;
+		}
+	}
+	for (const char** it = CRITICAL_MESSAGES; *it; ++it)
+	{
+		if (name == *it)
+		{
+			return LANE_CRITICAL;
+		}
+	}
+	for (const char** it = OBJECT_MESSAGES; *it; ++it)
+	{
+		if (name == *it)
+		{
+			return LANE_OBJECTS;
+		}
+	}
+	return LANE_BULK;
+}
+
+void LLPacketReceiver::setNearHost(const LLHost& host)
+{
+	mNearHost = host;
+}
+
+U32 LLPacketReceiver::getQueuedCount() const
+{
+	U32 count = mSenderQueued;
+	for (S32 ring = 0; ring < RING_COUNT; ++ring)
+	{
+		count += mFull[ring].size();
+	}
+	return count;
+}
+
+void LLPacketReceiver::takeExpandedCounts(U32& packets, U32& coded_bytes, U32& expanded_bytes)
+{
+	packets = mExpandedPackets;
+	coded_bytes = mCodedBytes;
+	expanded_bytes = mExpandedBytes;
+	mExpandedPackets = mCodedBytes = mExpandedBytes = 0;
+}
+
+void LLPacketReceiver::sortBySender()
+{
+	U16 index;
+	while (mFull[RING_SENDERS].pop(index))
+	{
+		const LLHost& sender = mPool.get(index).mSender;
+		S32 queue = -1;
+		S32 unused = -1;
+		for (S32 i = 0; i < (S32)mSenders.size() && queue < 0; ++i)
+		{
+			if (mSenders[i].mHost == sender)
+			{
+				queue = i;
+			}
+			else if (unused < 0 && mSenders[i].mHead < 0)
+			{
+				unused = i;
+			}
+		}
+		if (queue < 0)
+		{
+			// A sender seen for the first time, or again after its queue
+			// ran dry and was given to another.
+			if (unused < 0)
+			{
+				unused = (S32)mSenders.size();
+				mSenders.push_back(SenderQueue());
+			}
+			queue = unused;
+			mSenders[queue].mHost = sender;
+			mSenders[queue].mHead = mSenders[queue].mTail = -1;
+		}
+
+		SenderQueue& sender_queue = mSenders[queue];
+		mNext[index] = -1;
+		if (sender_queue.mTail >= 0)
+		{
+			mNext[sender_queue.mTail] = index;
+		}
+		else
+		{
+			sender_queue.mHead = index;
+		}
+		sender_queue.mTail = index;
+		mSenderQueued++;
+	}
+}
+
+S32 LLPacketReceiver::pickSource()
+{
+	sortBySender();
+	if (!mFull[RING_CONTROL].empty())
+	{
+		return SOURCE_CONTROL;
+	}
+
+	// Critical messages first, but not ahead of what their own sender sent
+	// before them. Meanwhile find the near sender, and the first of the
+	// others from where the last far packet was taken.
+	S32 count = (S32)mSenders.size();
+	S32 near_sender = -1;
+	S32 far_sender = -1;
+	for (S32 n = 0; n < count; ++n)
+	{
+		S32 i = (mFarCursor + n) % count;
+		const SenderQueue& sender_queue = mSenders[i];
+		if (sender_queue.mHead < 0)
+		{
+			continue;
+		}
+		if (mPacketLanes[sender_queue.mHead] == LANE_CRITICAL)
+		{
+			return i;
+		}
+		if (sender_queue.mHost == mNearHost)
+		{
+			near_sender = i;
+		}
+		else if (far_sender < 0)
+		{
+			far_sender = i;
+		}
+	}
+
+	bool bulk = !mFull[RING_BULK].empty();
+	bool lowest_first = (mTaken % LOW_LANE_INTERVAL == LOW_LANE_INTERVAL - 1);
+	if (lowest_first && bulk)
+	{
+		return SOURCE_BULK;
+	}
+	if (lowest_first && far_sender >= 0)
+	{
+		return far_sender;
+	}
+	if (near_sender >= 0)
+	{
+		return near_sender;
+	}
+	if (far_sender >= 0)
+	{
+		return far_sender;
+	}
+	return bulk ? SOURCE_BULK : SOURCE_NONE;
+}
+
+S32 LLPacketReceiver::peekIndex(S32 source) const
+{
+	if (source >= 0)
+	{
+		return mSenders[source].mHead;
+	}
+	const U16* index = NULL;
+	if (source == SOURCE_CONTROL)
+	{
+		index = mFull[RING_CONTROL].peek();
+	}
+	else if (source == SOURCE_BULK)
+	{
+		index = mFull[RING_BULK].peek();
+	}
+	return index ? *index : -1;
+}
+
+LLPacketView LLPacketReceiver::takePacket()
+{
+	S32 source = pickSource();
+	U16 index = 0;
+	if (source >= 0)
+	{
+		SenderQueue& sender_queue = mSenders[source];
+		index = (U16)sender_queue.mHead;
+		sender_queue.mHead = mNext[index];
+		if (sender_queue.mHead < 0)
+		{
+			sender_queue.mTail = -1;
+		}
+		mSenderQueued--;
+		if (sender_queue.mHost != mNearHost)
+		{
+			// The other regions take turns.
+			mFarCursor = source + 1;
+		}
+	}
+	else if (source == SOURCE_NONE
+			 || !mFull[source == SOURCE_CONTROL ? RING_CONTROL : RING_BULK].pop(index))
+	{
+		return LLPacketView();
+	}
+	if (mPacketLanes[index] > LANE_CRITICAL)
+	{
+		mTaken++;
+	}
+	const LLPacketBuffer& packet = mPool.get(index);
+	if (packet.mCodedSize)
+	{
+		mExpandedPackets++;
+		mCodedBytes += packet.mCodedSize;
+		mExpandedBytes += packet.mSize;
+	}
+	// The thread does not touch the buffer again until the pool has it back.
+	return LLPacketView(&mPool, index);
+}
+
+S32 LLPacketReceiver::nextPacketView(const char*& data, LLHost& sender, LLHost& receiving_interface)
+{
+	// The message system is done with the last one.
+	mCurrent = takePacket();
+	if (mCurrent.isNull())
+	{
+		return 0;
+	}
+	data = (const char*)mCurrent.getData();
+	sender = mCurrent.getSender();
+	receiving_interface = mCurrent.getReceivingInterface();
+	return mCurrent.getSize();
+}
+
+S32 LLPacketReceiver::nextPacket(char* buffer, LLHost& sender, LLHost& receiving_interface)
+{
+	LLPacketView packet = takePacket();
+	if (packet.isNull())
+	{
+		return 0;
+	}
+	memcpy(buffer, packet.getData(), packet.getSize());
+	sender = packet.getSender();
+	receiving_interface = packet.getReceivingInterface();
+	return packet.getSize();
+}
+
+U32 LLPacketReceiver::peekMessageNumber()
+{
+	S32 index = peekIndex(pickSource());
+	return (index >= 0) ? mPool.get(index).mMessageNumber : 0;
+}
+
+LLPacketReceiver::ELane LLPacketReceiver::peekLane()
+{
+	S32 index = peekIndex(pickSource());
+	return (index >= 0) ? (ELane)mPacketLanes[index] : LANE_COUNT;
+}
+
+//static
+U32 LLPacketReceiver::getMessageNumber(const U8* packet, S32 size)
+{
+	// High frequency numbers take one byte, medium ones 0xFF and one byte,
+	// low ones 0xFF 0xFF and two bytes, big endian.
+	const U8* number = packet + LL_PACKET_ID_SIZE;
+	if (size < LL_MINIMUM_VALID_PACKET_SIZE || (packet[0] & LL_ZERO_CODE_FLAG))
+	{
+		return 0;
+	}
+	if (number[0] != 0xFF)
+	{
+		return number[0];
+	}
+	if (size >= LL_MINIMUM_VALID_PACKET_SIZE + 1 && number[1] != 0xFF)
+	{
+		return (0xFF << 8) | number[1];
+	}
+	if (size >= LL_MINIMUM_VALID_PACKET_SIZE + 3)
+	{
+		return 0xFFFF0000 | (number[2] << 8) | number[3];
+	}
+	return 0;
+}
+
+//static
+S32 LLPacketReceiver::expandPacket(const U8* in, S32 size, U8* out)
+{
+	if (size < LL_MINIMUM_VALID_PACKET_SIZE || !(in[0] & LL_ZERO_CODE_FLAG))
+	{
+		memcpy(out, in, size);
+		return size;
+	}
+
+	// Appended acks are not zero coded: a count in the last byte, after
+	// that many packet ids.
+	S32 acks_size = 0;
+	if (in[0] & LL_ACK_FLAG)
+	{
+		acks_size = 1 + in[size - 1] * sizeof(U32);
+		if (size - acks_size < LL_MINIMUM_VALID_PACKET_SIZE)
+		{
+			// checkMessages() would throw it away as malformed.
+			return 0;
+		}
+	}
+	const S32 body_size = size - acks_size;
+	const S32 max_size = NET_BUFFER_SIZE - acks_size;
+
+	// As LLMessageSystem::zeroCodeExpand(): the packet id field is never
+	// coded, after it a zero is followed by how many zeroes it stands for,
+	// with each extra zero before the count adding 256.
+	memcpy(out, in, LL_PACKET_ID_SIZE);
+	S32 in_pos = LL_PACKET_ID_SIZE;
+	S32 out_pos = LL_PACKET_ID_SIZE;
+	bool overflow = false;
+	while (in_pos < body_size && !overflow)
+	{
+		U8 byte = in[in_pos++];
+		if (byte)
+		{
+			overflow = out_pos >= max_size;
+			if (!overflow)
+			{
+				out[out_pos++] = byte;
+			}
+			continue;
+		}
+
+		S32 zeroes = 1;
+		while (in_pos < body_size && !in[in_pos])
+		{
+			zeroes += 256;
+			in_pos++;
+		}
+		if (in_pos < body_size)
+		{
+			zeroes += in[in_pos++] - 1;
+		}
+		overflow = out_pos + zeroes > max_size;
+		if (!overflow)
+		{
+			memset(out + out_pos, 0, zeroes);
+			out_pos += zeroes;
+		}
+	}
+
+	if (overflow)
+	{
+		// Too big expanded, zeroCodeExpand() would only have given up
+		// part way.
+		return 0;
+	}
+
+	out[0] &= ~LL_ZERO_CODE_FLAG;
+	memcpy(out + out_pos, in + body_size, acks_size);
+	return out_pos + acks_size;
+}
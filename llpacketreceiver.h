@@ -0,0 +1,213 @@
+/**
+ * @file llpacketreceiver.h
+ * @brief Reads and expands UDP packets on their own thread for the message system.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLPACKETRECEIVER_H
+#define LL_LLPACKETRECEIVER_H
+
+#include "llhost.h"
+#include "llpacketbuffer.h"
+#include "llthread.h"
+#include "net.h"
+
+#include <map>
+#include <vector>
+
+// Reads the message system's UDP socket on its own thread, so packets do
+// not wait in the kernel for the main thread to get to idleNetwork(), and
+// the main thread does not pay for the reads.
+//
+// Zero coded packets are expanded here too. What the main thread gets is
+// the same packet with the zero code flag cleared, so
+// LLMessageSystem::checkMessages() skips its own expansion and goes
+// straight to acks and dispatch, and never writes to the buffer. A packet
+// that cannot be expanded, which the message system would have thrown
+// away or only half expanded, is dropped here. Acks and circuit
+// bookkeeping stay on the main thread, they share the circuit data with
+// the rest of the message system.
+//
+// Packets are read straight into the buffers of an LLPacketBufferPool
+// and handed over through single-producer rings. A zero coded packet is
+// expanded into a spare buffer, which takes its place, so no packet is
+// copied on the way. The main thread gets a view of the buffer, which the
+// message system reads from and a handler can keep, and the buffer comes
+// back when the last view is gone. When the main thread falls behind and
+// no buffer is free, the thread stops reading and leaves the packets
+// queued in the socket, as before.
+//
+// On Linux one recvmmsg() call reads up to 'batch_size' datagrams, as many
+// as there are free buffers, so a burst of object updates costs a system
+// call per batch rather than per packet. Elsewhere, or with a batch size
+// of 1, packets are read one at a time with receive_packet().
+//
+// llpacketbench measures both against a local sender.
+//
+// Each packet is put in a lane by its message number, and the main thread
+// takes them in priority order, so under load agent movement, teleports
+// and chat do not wait behind other regions' object updates, and updates
+// from the region the camera is in go before those from its neighbours.
+// Messages from one region that depend on each other keep their order:
+// - Acks and pings go first. Nothing depends on where they fall.
+// - Critical messages and object updates are kept in one queue per
+//   sender, in the order they arrived, and only the front of a queue is
+//   ever taken. A critical message at the front of its queue goes before
+//   anything else, so AvatarSitResponse, CrossedRegion or DisableSimulator
+//   still wait for the object updates their region sent first. Otherwise
+//   the queue of the region the camera is in goes first, then the others
+//   in turn. Which region is near is decided as packets are taken, so
+//   setNearHost() never splits a region's updates.
+// - Everything else comes last, in the order it arrived. A critical
+//   message or object update may go before a bulk message its region sent
+//   earlier, as the handlers of bulk messages do not depend on either.
+// To keep the lowest lanes moving, every LOW_LANE_INTERVAL-th packet after
+// the critical ones comes from the bulk lane if it has any, or else from
+// a region other than the near one.
+class LLPacketReceiver : public LLThread
+{
+public:
+	enum { POOL_SIZE = LLPacketBufferPool::POOL_SIZE };
+	enum { DEFAULT_BATCH_SIZE = 32 };
+	enum { LOW_LANE_INTERVAL = 8 };
+
+	typedef enum e_lane
+	{
+		LANE_CONTROL = 0,		// acks and pings
+		LANE_CRITICAL,			// agent movement, teleports, region changes, chat
+		LANE_OBJECTS,			// object updates
+		LANE_BULK,				// everything else
+		LANE_COUNT
+	} ELane;
+
+	LLPacketReceiver(S32 socket, S32 batch_size = DEFAULT_BATCH_SIZE);
+	~LLPacketReceiver();
+
+	/*virtual*/ void run();
+
+	// Before start(). Messages not given a lane go in LANE_BULK.
+	void setLane(U32 message_number, ELane lane)	{ mLanes[message_number] = (U8)lane; }
+	static ELane getLaneForMessage(const std::string& name);
+	// Main thread, whenever the camera's region changes.
+	void setNearHost(const LLHost& host);
+
+	// Main thread. The next packet, or a null view if none is waiting.
+	LLPacketView takePacket();
+	// Main thread: the packet view source for LLPacketRing. Points 'data'
+	// at the next packet, which stays valid until the next call, and
+	// returns its size, or 0 if no packet is waiting.
+	S32 nextPacketView(const char*& data, LLHost& sender, LLHost& receiving_interface);
+	// The packet nextPacketView() last returned, for a handler that wants
+	// to keep it.
+	const LLPacketView& getCurrentPacket() const	{ return mCurrent; }
+	// As nextPacketView(), but copies the packet into 'buffer'.
+	S32 nextPacket(char* buffer, LLHost& sender, LLHost& receiving_interface);
+
+	// Main thread. The message number of the packet nextPacket() would
+	// return, as LLTemplateMessageReader decodes it, or 0 if there is none.
+	U32 peekMessageNumber();
+	// Its lane, LANE_COUNT if there is nothing waiting.
+	ELane peekLane();
+
+	// Main thread.
+	U32 getQueuedCount() const;
+	// Main thread. The zero coded packets handed over since the last call,
+	// with their size as received and expanded, for the message system's
+	// own counts, which it can no longer keep. Clears them.
+	void takeExpandedCounts(U32& packets, U32& coded_bytes, U32& expanded_bytes);
+	// Any thread.
+	U32 getReceivedCount() const	{ return mReceived.CurrentValue(); }
+	// Zero coded packets that could not be expanded, and were dropped.
+	U32 getDroppedCount() const		{ return mDropped.CurrentValue(); }
+	U32 getReceiveCalls() const		{ return mReceiveCalls.CurrentValue(); }
+	const LLPacketBufferPool& getPool() const	{ return mPool; }
+
+	// Any thread. Expands a zero coded packet into 'out', which has room for
+	// NET_BUFFER_SIZE bytes, and returns its size, or 0 if its appended
+	// acks are malformed or it would not fit expanded. Anything else is
+	// copied as it is.
+	static S32 expandPacket(const U8* in, S32 size, U8* out);
+	// Of an expanded packet, 0 if it is too short to have one.
+	static U32 getMessageNumber(const U8* packet, S32 size);
+
+private:
+	struct Batch;
+
+	// Receive thread. Takes up to 'count' buffers from the pool into
+	// mHeld, returns how many are held.
+	S32 holdBuffers(S32 count);
+	// Waits up to 'ms' for the socket to be readable.
+	bool waitForData(S32 ms);
+	void receiveOne();
+	void receiveBatch();
+	// Expands the packet if need be and hands the buffer over.
+	void queuePacket(U16 index, S32 size, const LLHost& sender, const LLHost& receiving_interface);
+
+	// The receive thread's rings to the main thread.
+	enum { RING_CONTROL = 0, RING_SENDERS, RING_BULK, RING_COUNT };
+	// Where the next packet comes from: a sender's queue, or one of these.
+	enum { SOURCE_NONE = -3, SOURCE_BULK = -2, SOURCE_CONTROL = -1 };
+
+	// Main thread. Critical and object packets from one sender, in the
+	// order they arrived, linked through mNext.
+	struct SenderQueue
+	{
+		LLHost	mHost;
+		S32		mHead;			// -1 if empty
+		S32		mTail;
+	};
+
+	// Main thread. Moves what the receive thread has queued in
+	// RING_SENDERS to the senders' queues.
+	void sortBySender();
+	S32 pickSource();
+	// -1 if the source is empty.
+	S32 peekIndex(S32 source) const;
+
+	S32							mSocket;
+	S32							mBatchSize;
+	Batch*						mBatch;			// recvmmsg() headers, NULL if not batching
+	LLPacketBufferPool			mPool;
+	LLSPSCRing<U16, POOL_SIZE>	mFull[RING_COUNT];	// to the main thread
+	U8							mPacketLanes[POOL_SIZE];	// by buffer, set before it is queued
+	U16							mHeld[POOL_SIZE];	// receive thread, taken from the pool
+	S32							mHeldCount;
+	U16							mSpare;				// receive thread, to expand into
+	bool						mHaveSpare;
+	LLPacketView				mCurrent;			// main thread
+	std::map<U32, U8>			mLanes;				// by message number, read only once running
+	std::vector<SenderQueue>	mSenders;			// main thread
+	S32							mNext[POOL_SIZE];	// main thread, by buffer
+	U32							mSenderQueued;		// main thread
+	S32							mFarCursor;			// main thread, the next sender to look at
+	LLHost						mNearHost;			// main thread
+	U32							mTaken;				// main thread
+	U32							mExpandedPackets;	// main thread, see takeExpandedCounts()
+	U32							mCodedBytes;
+	U32							mExpandedBytes;
+	LLAtomicU32					mDropped;
+	LLAtomicU32					mReceived;
+	LLAtomicU32					mReceiveCalls;
+};
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * @file llspscring.h
+ * @brief Fixed capacity single producer, single consumer lock-free queue.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLSPSCRING_H
+#define LL_LLSPSCRING_H
+
+#include "llatomic.h"
+
+// One thread may push and one (other) thread may pop; neither ever blocks
+// or allocates. The indices only ever increase and are published with an
+// atomic increment, which is a full barrier, so the slot contents are
+// visible before the index that hands them over.
+//
+// CAPACITY must be a power of two.
+template <class T, U32 CAPACITY>
+class LLSPSCRing
+{
+public:
+	LLSPSCRing()
+	{
+		mHead = 0;
+		mTail = 0;
+	}
+
+	// Producer side. Returns false if the ring is full.
+	bool push(const T& item)
+	{
+		U32 head = mHead.CurrentValue();
+		if (head - mTail.CurrentValue() >= CAPACITY)
+		{
+			return false;
+		}
+		mItems[head & (CAPACITY - 1)] = item;
+		mHead++;
+		return true;
+	}
+
+	// Consumer side. Returns false if the ring is empty.
+	bool pop(T& item)
+	{
+		U32 tail = mTail.CurrentValue();
+		if (tail == mHead.CurrentValue())
+		{
+			return false;
+		}
+		item = mItems[tail & (CAPACITY - 1)];
+		mTail++;
+		return true;
+	}
+
+	// Consumer side. The returned slot stays valid until the next pop().
+	const T* peek() const
+	{
+		U32 tail = mTail.CurrentValue();
+		if (tail == mHead.CurrentValue())
+		{
+			return NULL;
+		}
+		return &mItems[tail & (CAPACITY - 1)];
+	}
+
+	// Approximate when called from a third thread.
+	U32 size() const	{ return mHead.CurrentValue() - mTail.CurrentValue(); }
+	bool empty() const	{ return size() == 0; }
+
+private:
+	T				mItems[CAPACITY];
+	LLAtomicU32		mHead;	// written by the producer only
+	LLAtomicU32		mTail;	// written by the consumer only
+};
+
+#endif
@@ -0,0 +1,230 @@
+/**
+ * @file llstallcapture.cpp
+ * @brief Keeps recent frames' fast timer counts and saves them on a stall.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "llstallcapture.h"
+#include "lldate.h"
+#include "llfile.h"
+
+static const U32 STALL_MAGIC_HEADER	= 0x4C545453;	// "STTL"
+static const U32 STALL_MAGIC_END	= 0x4E455453;	// "STEN"
+static const U32 STALL_CAPTURE_VERSION = 1;
+
+template <class T>
+static void append_value(std::string& buffer, const T& value)
+{
+	buffer.append((const char*)&value, sizeof(T));
+}
+
+template <class T>
+static bool read_value(LLFILE* file, T& value)
+{
+	return fread(&value, sizeof(T), 1, file) == 1;
+}
+
+LLStallCapture::LLStallCapture()
+:	mRing(RING_FRAMES),
+	mRecorded(0),
+	mStallPending(false),
+	mSaveCountdown(-1),
+	mStallFrame(0),
+	mMaxFiles(10),
+	mFilesWritten(0)
+{ }
+
+void LLStallCapture::recordFrame(U32 frame, F32 frame_seconds)
+{
+	LLStallFrame& slot = mRing[mRecorded % RING_FRAMES];
+	slot.mFrame = frame;
+	slot.mSeconds = frame_seconds;
+	slot.mStalled = mStallPending;
+	slot.mCounts.clear();	// keeps its capacity, so this settles to no allocation
+	collect(LLFastTimer::NamedTimer::getRootNamedTimer(), slot);
+	mRecorded++;
+
+	if (mStallPending)
+	{
+		mStallPending = false;
+		if (mSaveCountdown < 0)
+		{
+			mStallFrame = frame;
+			mSaveCountdown = FRAMES_AFTER;
+		}
+	}
+	else if (mSaveCountdown > 0 && --mSaveCountdown == 0)
+	{
+		save(mStallFrame);
+		mSaveCountdown = -1;
+	}
+}
+
+void LLStallCapture::markStall()
+{
+	mStallPending = true;
+}
+
+void LLStallCapture::collect(LLFastTimer::NamedTimer& timer, LLStallFrame& frame)
+{
+	U32 ticks = timer.getHistoricalCount(0);
+	if (!ticks)
+	{
+		// Nothing below it ran either.
+		return;
+	}
+	LLStallTimerCount count;
+	count.mTimer = getTimerIndex(&timer);
+	count.mTicks = ticks;
+	frame.mCounts.push_back(count);
+
+	std::vector<LLFastTimer::NamedTimer*>& children = timer.getChildren();
+	for (std::vector<LLFastTimer::NamedTimer*>::iterator it = children.begin(); it != children.end(); ++it)
+	{
+		collect(**it, frame);
+	}
+}
+
+U16 LLStallCapture::getTimerIndex(LLFastTimer::NamedTimer* timer)
+{
+	std::map<LLFastTimer::NamedTimer*, U16>::iterator found = mTimerIndex.find(timer);
+	if (found != mTimerIndex.end())
+	{
+		return found->second;
+	}
+	U16 index = (U16)mTimers.size();
+	mTimerIndex[timer] = index;
+	mTimers.push_back(timer);
+	return index;
+}
+
+void LLStallCapture::save(U32 stall_frame)
+{
+	if (mFilesWritten >= mMaxFiles || mFilePrefix.empty())
+	{
+		return;
+	}
+
+	// Built in memory and written with one call, this is right after a
+	// stall and should not add another.
+	std::string buffer;
+	append_value(buffer, STALL_MAGIC_HEADER);
+	append_value(buffer, STALL_CAPTURE_VERSION);
+	append_value(buffer, LLFastTimer::countsPerSecond());
+
+	append_value(buffer, (U32)mTimers.size());
+	for (std::vector<LLFastTimer::NamedTimer*>::iterator it = mTimers.begin(); it != mTimers.end(); ++it)
+	{
+		// Parents as they are now; timers can move up the tree while running.
+		LLFastTimer::NamedTimer* parent = (*it)->getParent();
+		std::map<LLFastTimer::NamedTimer*, U16>::iterator found = mTimerIndex.find(parent);
+		S16 parent_index = (parent && parent != *it && found != mTimerIndex.end()) ? (S16)found->second : -1;
+		const std::string& name = (*it)->getName();
+		U8 length = (U8)llmin(name.size(), (size_t)255);
+		append_value(buffer, parent_index);
+		append_value(buffer, length);
+		buffer.append(name, 0, length);
+	}
+
+	U32 frames = llmin(mRecorded, (U32)RING_FRAMES);
+	append_value(buffer, frames);
+	for (U32 i = mRecorded - frames; i < mRecorded; ++i)
+	{
+		const LLStallFrame& frame = mRing[i % RING_FRAMES];
+		append_value(buffer, frame.mFrame);
+		append_value(buffer, frame.mSeconds);
+		append_value(buffer, (U8)frame.mStalled);
+		append_value(buffer, (U16)frame.mCounts.size());
+		for (std::vector<LLStallTimerCount>::const_iterator it = frame.mCounts.begin(); it != frame.mCounts.end(); ++it)
+		{
+			append_value(buffer, it->mTimer);
+			append_value(buffer, it->mTicks);
+		}
+	}
+	append_value(buffer, STALL_MAGIC_END);
+
+	std::string filename = mFilePrefix + llformat("%s_%u.lltimers", LLDate::now().toHTTPDateString("%Y%m%d_%H%M%S").c_str(), stall_frame);
+	LLFILE* file = LLFile::fopen(filename, "wb");
+	if (!file)
+	{
+		LL_WARNS("StallCapture") << "Can't write " << filename << LL_ENDL;
+		return;
+	}
+	bool ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+	fclose(file);
+	mFilesWritten++;
+	LL_INFOS("StallCapture") << (ok ? "Saved " : "Failed to save ") << filename << LL_ENDL;
+}
+
+//----------------------------------------------------------------------------
+
+bool LLStallCaptureReader::read(const std::string& filename)
+{
+	mTimers.clear();
+	mFrames.clear();
+
+	LLFILE* file = LLFile::fopen(filename, "rb");
+	if (!file)
+	{
+		return false;
+	}
+
+	U32 magic = 0, version = 0, timers = 0, frames = 0;
+	bool ok = read_value(file, magic) && magic == STALL_MAGIC_HEADER
+			  && read_value(file, version) && version == STALL_CAPTURE_VERSION
+			  && read_value(file, mTicksPerSecond)
+			  && read_value(file, timers);
+	for (U32 i = 0; ok && i < timers; ++i)
+	{
+		S16 parent;
+		U8 length;
+		ok = read_value(file, parent) && read_value(file, length);
+		LLStallTimerInfo info;
+		info.mParent = parent;
+		info.mName.resize(length);
+		ok = ok && (length == 0 || fread(&info.mName[0], 1, length, file) == length);
+		mTimers.push_back(info);
+	}
+
+	ok = ok && read_value(file, frames);
+	for (U32 i = 0; ok && i < frames; ++i)
+	{
+		mFrames.push_back(LLStallFrame());
+		LLStallFrame& frame = mFrames.back();
+		U8 stalled;
+		U16 count;
+		ok = read_value(file, frame.mFrame) && read_value(file, frame.mSeconds)
+			 && read_value(file, stalled) && read_value(file, count);
+		frame.mStalled = stalled != 0;
+		frame.mCounts.resize(count);
+		for (U16 j = 0; ok && j < count; ++j)
+		{
+			ok = read_value(file, frame.mCounts[j].mTimer) && read_value(file, frame.mCounts[j].mTicks)
+				 && frame.mCounts[j].mTimer < mTimers.size();
+		}
+	}
+	ok = ok && read_value(file, magic) && magic == STALL_MAGIC_END;
+	fclose(file);
+	return ok;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file llstallcapture.h
+ * @brief Keeps recent frames' fast timer counts and saves them on a stall.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLSTALLCAPTURE_H
+#define LL_LLSTALLCAPTURE_H
+
+#include "llfasttimer.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// One timer's ticks in one frame. Frames only store timers that ran.
+struct LLStallTimerCount
+{
+	U16		mTimer;		// index into the capture's timer table
+	U32		mTicks;
+};
+
+struct LLStallFrame
+{
+	U32								mFrame;		// gFrameCount
+	F32								mSeconds;
+	bool							mStalled;
+	std::vector<LLStallTimerCount>	mCounts;
+};
+
+struct LLStallTimerInfo
+{
+	std::string		mName;
+	S32				mParent;	// -1 for the root
+};
+
+// Main thread. Once per frame, after LLFastTimer::nextFrame(), the counts
+// every fast timer collected in the frame just finished are appended to a
+// ring of recent frames. When a frame is marked as a stall, the ring is
+// written out a few frames later, so the file shows the frames leading up
+// to the stall and the ones after it.
+//
+// llstallview prints the captures.
+class LLStallCapture
+{
+public:
+	enum { RING_FRAMES = 64, FRAMES_AFTER = 8 };
+
+	LLStallCapture();
+
+	// 'frame_seconds' is how long the finished frame took.
+	void recordFrame(U32 frame, F32 frame_seconds);
+	// The frame being worked on (the next one recorded) stalled.
+	void markStall();
+
+	// Captures are written to <prefix><date>_<frame>.lltimers, nothing is
+	// written until this is set.
+	void setFilePrefix(const std::string& prefix)	{ mFilePrefix = prefix; }
+	void setMaxFiles(S32 max_files)		{ mMaxFiles = max_files; }
+	S32 getFilesWritten() const			{ return mFilesWritten; }
+
+private:
+	void collect(LLFastTimer::NamedTimer& timer, LLStallFrame& frame);
+	U16 getTimerIndex(LLFastTimer::NamedTimer* timer);
+	void save(U32 stall_frame);
+
+	std::vector<LLStallFrame>					mRing;
+	U32											mRecorded;		// frames ever recorded
+	std::map<LLFastTimer::NamedTimer*, U16>		mTimerIndex;
+	std::vector<LLFastTimer::NamedTimer*>		mTimers;
+	bool										mStallPending;	// mark the next recorded frame
+	S32											mSaveCountdown;	// frames to go before saving, -1 if none
+	U32											mStallFrame;
+	std::string									mFilePrefix;
+	S32											mMaxFiles;
+	S32											mFilesWritten;
+};
+
+// Reads a capture back, for llstallview.
+class LLStallCaptureReader
+{
+public:
+	bool read(const std::string& filename);
+
+	U64								mTicksPerSecond;
+	std::vector<LLStallTimerInfo>	mTimers;
+	std::vector<LLStallFrame>		mFrames;	// oldest first
+};
+
+#endif
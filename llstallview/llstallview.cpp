@@ -0,0 +1,295 @@
+/**
+ * @file llstallview.cpp
+ * @brief Prints the fast timer captures the viewer saves when a frame stalls.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+// Usage:
+//   llstallview [options] <capture> [<capture> ...]
+//
+// A capture is a stall_<date>_<frame>.lltimers file from the viewer's logs
+// directory (see LLStallCapture). For each one the tool draws the frame
+// times around the stall as a bar chart, then the fast timer tree of every
+// stalled frame next to the median of the frames that did not stall, and
+// lists the timers that grew the most.
+
+#include "linden_common.h"
+#include "llapr.h"
+#include "llerrorcontrol.h"
+
+#include "llstallcapture.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+static const char USAGE[] = "\n"
+"usage:\tllstallview [options] <capture> [<capture> ...]\n"
+"\n"
+" -m, --min-ms <ms>\n"
+"        Leave out timers shorter than this in the stalled frame (default 0.5).\n"
+" -n, --top <n>\n"
+"        Number of largest increases to list (default 10).\n"
+" -w, --width <n>\n"
+"        Width of the frame time bars (default 60).\n"
+"\n";
+
+// One capture, with every frame's counts spread into per-timer arrays.
+class LLStallView
+{
+public:
+	LLStallView(const LLStallCaptureReader& capture)
+	:	mCapture(capture),
+		mChildren(capture.mTimers.size())
+	{
+		S32 timers = (S32)capture.mTimers.size();
+		for (S32 i = 0; i < timers; ++i)
+		{
+			S32 parent = capture.mTimers[i].mParent;
+			if (parent >= 0 && parent < timers)
+			{
+				mChildren[parent].push_back(i);
+			}
+			else
+			{
+				mRoots.push_back(i);
+			}
+		}
+
+		mMilliseconds.resize(capture.mFrames.size(), std::vector<F64>(timers, 0.0));
+		for (size_t f = 0; f < capture.mFrames.size(); ++f)
+		{
+			const std::vector<LLStallTimerCount>& counts = capture.mFrames[f].mCounts;
+			for (std::vector<LLStallTimerCount>::const_iterator it = counts.begin(); it != counts.end(); ++it)
+			{
+				mMilliseconds[f][it->mTimer] = (F64)it->mTicks * 1000.0 / (F64)capture.mTicksPerSecond;
+			}
+		}
+
+		// The baseline is each timer's median over the frames that did not stall.
+		mBaseline.resize(timers, 0.0);
+		for (S32 i = 0; i < timers; ++i)
+		{
+			std::vector<F64> values;
+			for (size_t f = 0; f < capture.mFrames.size(); ++f)
+			{
+				if (!capture.mFrames[f].mStalled)
+				{
+					values.push_back(mMilliseconds[f][i]);
+				}
+			}
+			if (!values.empty())
+			{
+				std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+				mBaseline[i] = values[values.size() / 2];
+			}
+		}
+	}
+
+	void printFrames(S32 width) const
+	{
+		F32 longest = 0.f;
+		for (size_t f = 0; f < mCapture.mFrames.size(); ++f)
+		{
+			longest = llmax(longest, mCapture.mFrames[f].mSeconds);
+		}
+		for (size_t f = 0; f < mCapture.mFrames.size(); ++f)
+		{
+			const LLStallFrame& frame = mCapture.mFrames[f];
+			S32 bar = longest > 0.f ? llround(frame.mSeconds / longest * (F32)width) : 0;
+			std::cout << std::setw(8) << frame.mFrame << " " << std::setw(9) << std::fixed << std::setprecision(1)
+					  << frame.mSeconds * 1000.f << " ms " << std::string(bar, frame.mStalled ? '#' : '=')
+					  << (frame.mStalled ? "  <- stall" : "") << "\n";
+		}
+	}
+
+	void printTree(size_t frame, F64 min_ms) const
+	{
+		std::cout << "\nFrame " << mCapture.mFrames[frame].mFrame << " (ms, median of other frames in brackets):\n";
+		for (std::vector<S32>::const_iterator it = mRoots.begin(); it != mRoots.end(); ++it)
+		{
+			printTimer(frame, *it, 0, min_ms);
+		}
+	}
+
+	void printIncreases(size_t frame, S32 top) const
+	{
+		// Self time, so a slow leaf is not also reported as every parent.
+		std::vector<std::pair<F64, S32> > increases;
+		for (S32 i = 0; i < (S32)mMilliseconds[frame].size(); ++i)
+		{
+			F64 increase = selfTime(frame, i) - selfBaseline(i);
+			if (increase >= 0.01)
+			{
+				increases.push_back(std::make_pair(increase, i));
+			}
+		}
+		std::sort(increases.rbegin(), increases.rend());
+		if ((S32)increases.size() > top)
+		{
+			increases.resize(top);
+		}
+
+		std::cout << "\nLargest increases in self time:\n";
+		for (size_t i = 0; i < increases.size(); ++i)
+		{
+			std::cout << std::setw(10) << std::fixed << std::setprecision(2) << increases[i].first << " ms  "
+					  << path(increases[i].second) << "\n";
+		}
+	}
+
+private:
+	void printTimer(size_t frame, S32 timer, S32 depth, F64 min_ms) const
+	{
+		F64 ms = mMilliseconds[frame][timer];
+		if (ms < min_ms)
+		{
+			return;
+		}
+		std::cout << std::string(depth * 2, ' ') << std::left << std::setw(llmax(40 - depth * 2, 1))
+				  << mCapture.mTimers[timer].mName << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+				  << ms << "  (" << mBaseline[timer] << ")\n";
+
+		std::vector<std::pair<F64, S32> > children;
+		for (std::vector<S32>::const_iterator it = mChildren[timer].begin(); it != mChildren[timer].end(); ++it)
+		{
+			children.push_back(std::make_pair(mMilliseconds[frame][*it], *it));
+		}
+		std::sort(children.rbegin(), children.rend());
+		for (size_t i = 0; i < children.size(); ++i)
+		{
+			printTimer(frame, children[i].second, depth + 1, min_ms);
+		}
+	}
+
+	F64 selfTime(size_t frame, S32 timer) const
+	{
+		F64 ms = mMilliseconds[frame][timer];
+		for (std::vector<S32>::const_iterator it = mChildren[timer].begin(); it != mChildren[timer].end(); ++it)
+		{
+			ms -= mMilliseconds[frame][*it];
+		}
+		return llmax(ms, 0.0);
+	}
+
+	F64 selfBaseline(S32 timer) const
+	{
+		F64 ms = mBaseline[timer];
+		for (std::vector<S32>::const_iterator it = mChildren[timer].begin(); it != mChildren[timer].end(); ++it)
+		{
+			ms -= mBaseline[*it];
+		}
+		return llmax(ms, 0.0);
+	}
+
+	std::string path(S32 timer) const
+	{
+		std::string result = mCapture.mTimers[timer].mName;
+		for (S32 parent = mCapture.mTimers[timer].mParent, depth = 0;
+			 parent >= 0 && parent < (S32)mCapture.mTimers.size() && depth < 64;
+			 parent = mCapture.mTimers[parent].mParent, ++depth)
+		{
+			result = mCapture.mTimers[parent].mName + " > " + result;
+		}
+		return result;
+	}
+
+	const LLStallCaptureReader&			mCapture;
+	std::vector<std::vector<S32> >		mChildren;
+	std::vector<S32>					mRoots;
+	std::vector<std::vector<F64> >		mMilliseconds;	// [frame][timer]
+	std::vector<F64>					mBaseline;
+};
+
+int main(int argc, char** argv)
+{
+	F64 min_ms = 0.5;
+	S32 top = 10;
+	S32 width = 60;
+	std::vector<std::string> capture_files;
+
+	for (int arg = 1; arg < argc; ++arg)
+	{
+		std::string option(argv[arg]);
+		bool has_value = (arg + 1 < argc);
+		if ((option == "-m" || option == "--min-ms") && has_value)
+		{
+			min_ms = atof(argv[++arg]);
+		}
+		else if ((option == "-n" || option == "--top") && has_value)
+		{
+			top = llmax(atoi(argv[++arg]), 0);
+		}
+		else if ((option == "-w" || option == "--width") && has_value)
+		{
+			width = llmax(atoi(argv[++arg]), 1);
+		}
+		else if (!option.empty() && option[0] == '-')
+		{
+			std::cerr << USAGE;
+			return 1;
+		}
+		else
+		{
+			capture_files.push_back(option);
+		}
+	}
+
+	if (capture_files.empty())
+	{
+		std::cerr << USAGE;
+		return 1;
+	}
+
+	LLError::initForApplication(".");
+	ll_init_apr();
+
+	int result = 0;
+	for (std::vector<std::string>::iterator it = capture_files.begin(); it != capture_files.end(); ++it)
+	{
+		LLStallCaptureReader capture;
+		if (!capture.read(*it))
+		{
+			std::cerr << "Unable to read " << *it << "\n";
+			result = 1;
+			continue;
+		}
+
+		std::cout << "== " << *it << " (" << capture.mFrames.size() << " frames, "
+				  << capture.mTimers.size() << " timers)\n\n";
+		LLStallView view(capture);
+		view.printFrames(width);
+		for (size_t f = 0; f < capture.mFrames.size(); ++f)
+		{
+			if (capture.mFrames[f].mStalled)
+			{
+				view.printTree(f, min_ms);
+				view.printIncreases(f, top);
+			}
+		}
+		std::cout << "\n";
+	}
+
+	ll_cleanup_apr();
+	return result;
+}
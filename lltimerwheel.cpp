@@ -0,0 +1,256 @@
+/**
+ * @file lltimerwheel.cpp
+ * @brief Hierarchical timer wheel for retransmits and request timeouts.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "lltimerwheel.h"
+
+#include "lltimer.h"
+
+LLTimerWheel::LLTimerWheel()
+:	mTick(totalTime() / TICK_MICROSECONDS),
+	mPendingCount(0)
+{
+	for (S32 i = 0; i <= FREE_SLOT; ++i)
+	{
+		mHeads[i] = mTails[i] = -1;
+	}
+}
+
+void LLTimerWheel::link(S32 index, S32 slot)
+{
+	Timer& timer = mTimers[index];
+	timer.mSlot = slot;
+	timer.mNext = -1;
+	timer.mPrev = mTails[slot];
+	if (mTails[slot] >= 0)
+	{
+		mTimers[mTails[slot]].mNext = index;
+	}
+	else
+	{
+		mHeads[slot] = index;
+	}
+	mTails[slot] = index;
+}
+
+void LLTimerWheel::unlink(S32 index)
+{
+	Timer& timer = mTimers[index];
+	if (timer.mPrev >= 0)
+	{
+		mTimers[timer.mPrev].mNext = timer.mNext;
+	}
+	else
+	{
+		mHeads[timer.mSlot] = timer.mNext;
+	}
+	if (timer.mNext >= 0)
+	{
+		mTimers[timer.mNext].mPrev = timer.mPrev;
+	}
+	else
+	{
+		mTails[timer.mSlot] = timer.mPrev;
+	}
+	timer.mPrev = timer.mNext = -1;
+}
+
+void LLTimerWheel::insert(S32 index)
+{
+	U64 expires = mTimers[index].mExpires;
+	U64 delta = (expires > mTick) ? expires - mTick : 0;
+	S32 slot;
+	if (delta < LEVEL0_SLOTS)
+	{
+		// Already due goes in the slot about to run.
+		slot = (S32)(llmax(expires, mTick) & (LEVEL0_SLOTS - 1));
+	}
+	else
+	{
+		S32 level = 1;
+		S32 shift = LEVEL0_BITS;
+		while (level < LEVELS - 1 && delta >= ((U64)1 << (shift + LEVEL_BITS)))
+		{
+			++level;
+			shift += LEVEL_BITS;
+		}
+		if (delta >= ((U64)1 << (shift + LEVEL_BITS)))
+		{
+			// Out of range: the last slot of the last level, to be looked
+			// at again when it cascades.
+			expires = mTick + ((U64)1 << (shift + LEVEL_BITS)) - 1;
+		}
+		slot = LEVEL0_SLOTS + (level - 1) * LEVEL_SLOTS + (S32)((expires >> shift) & (LEVEL_SLOTS - 1));
+	}
+	link(index, slot);
+}
+
+S32 LLTimerWheel::cascade(S32 level)
+{
+	S32 shift = LEVEL0_BITS + (level - 1) * LEVEL_BITS;
+	S32 index = (S32)((mTick >> shift) & (LEVEL_SLOTS - 1));
+	S32 slot = LEVEL0_SLOTS + (level - 1) * LEVEL_SLOTS + index;
+	S32 timer = mHeads[slot];
+	mHeads[slot] = mTails[slot] = -1;
+	while (timer >= 0)
+	{
+		S32 next = mTimers[timer].mNext;
+		insert(timer);
+		timer = next;
+	}
+	return index;
+}
+
+U64 LLTimerWheel::getDeadline(F32 seconds) const
+{
+	U64 delay = (U64)(llmax(seconds, 0.f) * (F32)SEC_TO_MICROSEC);
+	// Rounded up, so a timer never fires early.
+	return (totalTime() + delay + TICK_MICROSECONDS - 1) / TICK_MICROSECONDS;
+}
+
+LLTimerWheel::handle_t LLTimerWheel::schedule(F32 seconds, callback_t callback, void* data)
+{
+	S32 index = mHeads[FREE_SLOT];
+	if (index >= 0)
+	{
+		unlink(index);
+	}
+	else
+	{
+		index = (S32)mTimers.size();
+		llassert_always(index < INDEX_MASK);
+		Timer timer;
+		timer.mGeneration = 0;
+		timer.mPrev = timer.mNext = -1;
+		mTimers.push_back(timer);
+	}
+
+	Timer& timer = mTimers[index];
+	timer.mExpires = getDeadline(seconds);
+	timer.mCallback = callback;
+	timer.mData = data;
+	insert(index);
+	mPendingCount++;
+	return ((handle_t)(index + 1)) | (timer.mGeneration << INDEX_BITS);
+}
+
+S32 LLTimerWheel::findTimer(handle_t timer) const
+{
+	S32 index = (S32)(timer & INDEX_MASK) - 1;
+	if (index < 0 || index >= (S32)mTimers.size()
+		|| mTimers[index].mSlot == FREE_SLOT
+		|| mTimers[index].mGeneration != (timer >> INDEX_BITS))
+	{
+		return -1;
+	}
+	return index;
+}
+
+bool LLTimerWheel::isPending(handle_t timer) const
+{
+	return findTimer(timer) >= 0;
+}
+
+bool LLTimerWheel::cancel(handle_t timer)
+{
+	S32 index = findTimer(timer);
+	if (index < 0)
+	{
+		return false;
+	}
+	unlink(index);
+	Timer& entry = mTimers[index];
+	entry.mCallback = NULL;
+	entry.mData = NULL;
+	entry.mGeneration = (entry.mGeneration + 1) & (0xFFFFFFFF >> INDEX_BITS);
+	link(index, FREE_SLOT);
+	mPendingCount--;
+	return true;
+}
+
+bool LLTimerWheel::reschedule(handle_t timer, F32 seconds)
+{
+	S32 index = findTimer(timer);
+	if (index < 0)
+	{
+		return false;
+	}
+	unlink(index);
+	mTimers[index].mExpires = getDeadline(seconds);
+	insert(index);
+	return true;
+}
+
+S32 LLTimerWheel::advance()
+{
+	U64 target = totalTime() / TICK_MICROSECONDS;
+	if (!mPendingCount)
+	{
+		mTick = llmax(mTick, target + 1);
+		return 0;
+	}
+
+	S32 fired = 0;
+	while (mTick <= target)
+	{
+		S32 index = (S32)(mTick & (LEVEL0_SLOTS - 1));
+		if (!index)
+		{
+			for (S32 level = 1; level < LEVELS && !cascade(level); ++level)
+			{
+			}
+		}
+
+		// Moved aside first, so callbacks can add to the slot they are
+		// being called from.
+		mHeads[EXPIRING_SLOT] = mHeads[index];
+		mTails[EXPIRING_SLOT] = mTails[index];
+		mHeads[index] = mTails[index] = -1;
+		for (S32 timer = mHeads[EXPIRING_SLOT]; timer >= 0; timer = mTimers[timer].mNext)
+		{
+			mTimers[timer].mSlot = EXPIRING_SLOT;
+		}
+		mTick++;
+
+		while (mHeads[EXPIRING_SLOT] >= 0)
+		{
+			S32 timer = mHeads[EXPIRING_SLOT];
+			callback_t callback = mTimers[timer].mCallback;
+			void* data = mTimers[timer].mData;
+			// Gone before the call, so it can schedule itself again.
+			cancel((handle_t)(timer + 1) | (mTimers[timer].mGeneration << INDEX_BITS));
+			callback(data);
+			fired++;
+		}
+
+		if (!mPendingCount)
+		{
+			mTick = llmax(mTick, target + 1);
+		}
+	}
+	return fired;
+}
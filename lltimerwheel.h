@@ -0,0 +1,131 @@
+/**
+ * @file lltimerwheel.h
+ * @brief Hierarchical timer wheel for retransmits and request timeouts.
+ *
+ * $LicenseInfo:firstyear=2013&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2013, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLTIMERWHEEL_H
+#define LL_LLTIMERWHEEL_H
+
+#include "llsingleton.h"
+
+#include <vector>
+
+// One-shot timers for things that wait on the network: xfer packet
+// retransmits, xfer and asset request timeouts. Scheduling, cancelling
+// and rescheduling are constant time, and advance() costs the number of
+// ticks since it last ran plus the timers that fire, however many are
+// pending, where scanning every outstanding request each frame costs the
+// number of requests.
+//
+// Timers are kept in four levels of slots. The first level has a slot per
+// tick for the next 256 ticks; each further level has 64 slots covering 64
+// times the span of the level below, and as the first level comes round
+// the next slot of the level above is spread back over the levels below.
+// A tick is TICK_MICROSECONDS, so the levels reach about 2.56 seconds, 2.7
+// minutes, 2.9 hours and 7.8 days. Timers further out wait in the last
+// level until they are in range.
+//
+// A timer fires at the first advance() at least its delay after it was
+// scheduled, rounded up to a tick. Timers due at the same tick fire in the
+// order they were scheduled.
+//
+// Main thread only. Callbacks may schedule, cancel or reschedule other
+// timers. A timer is gone by the time its callback runs, so cancel() and
+// reschedule() on its own handle return false; to fire again, a callback
+// must schedule() a new timer.
+class LL_COMMON_API LLTimerWheel : public LLSingleton<LLTimerWheel>
+{
+public:
+	typedef void (*callback_t)(void* data);
+	typedef U32 handle_t;
+
+	enum { NO_TIMER = 0 };
+	enum { TICK_MICROSECONDS = 10000 };
+
+	LLTimerWheel();
+
+	handle_t schedule(F32 seconds, callback_t callback, void* data);
+	// For void T::method(), e.g. scheduleMethod<LLXfer, &LLXfer::retransmit>(delay, xfer).
+	template <class T, void (T::*METHOD)()>
+	handle_t scheduleMethod(F32 seconds, T* object)	{ return schedule(seconds, &callMethod<T, METHOD>, object); }
+
+	// Both return false, and do nothing, if the timer already fired or was
+	// cancelled. Handles are not reused for a long while, so a stale one is
+	// safe to pass.
+	bool cancel(handle_t timer);
+	// Same handle, new deadline counted from now.
+	bool reschedule(handle_t timer, F32 seconds);
+	bool isPending(handle_t timer) const;
+
+	// Once per frame. Returns the number of timers that fired.
+	S32 advance();
+
+	S32 getPendingCount() const		{ return mPendingCount; }
+
+private:
+	enum
+	{
+		LEVEL0_BITS = 8,
+		LEVEL_BITS = 6,
+		LEVELS = 4,
+		LEVEL0_SLOTS = 1 << LEVEL0_BITS,
+		LEVEL_SLOTS = 1 << LEVEL_BITS,
+		SLOT_COUNT = LEVEL0_SLOTS + (LEVELS - 1) * LEVEL_SLOTS,
+		EXPIRING_SLOT = SLOT_COUNT,		// due this tick, being fired
+		FREE_SLOT = SLOT_COUNT + 1
+	};
+	enum { INDEX_BITS = 20, INDEX_MASK = (1 << INDEX_BITS) - 1 };
+
+	struct Timer
+	{
+		U64			mExpires;		// tick
+		callback_t	mCallback;
+		void*		mData;
+		S32			mPrev;
+		S32			mNext;
+		S32			mSlot;
+		U32			mGeneration;
+	};
+
+	template <class T, void (T::*METHOD)()>
+	static void callMethod(void* object)	{ (static_cast<T*>(object)->*METHOD)(); }
+
+	// -1 if the handle is not a pending timer.
+	S32 findTimer(handle_t timer) const;
+	U64 getDeadline(F32 seconds) const;
+	void insert(S32 index);
+	void link(S32 index, S32 slot);
+	void unlink(S32 index);
+	// Spreads the slot of 'level' the current tick points at over the
+	// levels below. Returns its index.
+	S32 cascade(S32 level);
+
+	std::vector<Timer>	mTimers;
+	S32					mHeads[FREE_SLOT + 1];
+	S32					mTails[FREE_SLOT + 1];
+	U64					mTick;			// next tick to run
+	S32					mPendingCount;
+};
+
+#endif
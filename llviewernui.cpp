@@ -38,8 +38,14 @@
 #include "llagentcamera.h"
 #include "llfocusmgr.h"
 #include "llwindow.h"
+#include "lldate.h"
 
 #include "llviewernui.h"
+#include "llinputqueue.h"
+#include "llnuioffline.h"
+
+#include "llwin32headerslean.h"
+#include <NuiApi.h>
 
 using namespace NuiLib;
 
@@ -80,173 +86,118 @@ LLViewerNui::LLViewerNui()
 	mResetFlag(false),
 	mCameraUpdated(true),
 	mOverrideCamera(false),
-	mNuiRun(0)
+	mNuiRun(0),
+	mJointMask(NUI_ALL_JOINTS),
+	mReplayOffset(0.0),
+	mHaveReplayFrame(false),
+	mColourStream(NULL)
 { }
 
 // -----------------------------------------------------------------------------
 LLViewerNui::~LLViewerNui()
 {
+	mHeadTracker.stop();
+	stopRecording();
+	stopReplay();
 	if (mDriverState == NUI_INITIALIZED)
 	{
 		terminate();
 	}
 }
 
-#ifndef M_PI
-#define M_PI 3.14159
-#endif
+// Feeds the live sensor into LLNuiGestureGraph, building NuiLib's graph.
+class LLNuiLiveSource
+{
+public:
+	typedef NuiLib::Vector		Vector;
+	typedef NuiLib::Scalar		Scalar;
+	typedef NuiLib::Condition	Condition;
+
+	LLNuiLiveSource(const LLNuiTrackerSet& trackers)
+	:	mTrackers(trackers)
+	{ }
+
+	Vector joint(S32 joint) const { return NuiLib::joint(joint); }
+	Scalar tracker(S32 tracker) const
+	{
+		const LLNuiTrackerDef& def = LLNuiTrackerSet::getDef(tracker);
+		return NuiLib::tracker(def.mName, def.mMax, def.mScale, def.mMin, mTrackers.getPosition(tracker));
+	}
+	Vector constant(const char* name, F32 x, F32 y, F32 z) const { return Vector(name, x, y, z); }
 
-const float R2DEG = (180 / (float) M_PI);
+private:
+	const LLNuiTrackerSet& mTrackers;
+};
 
 // -----------------------------------------------------------------------------
 void LLViewerNui::init(bool autoenable)
 {
+	// Use thresholds fitted by the calibration tool when the site has them,
+	// otherwise the hand-tuned defaults.
+	std::string tracker_file = gDirUtilp->getExpandedFilename(LL_PATH_USER_SETTINGS, gSavedSettings.getString("NuiTrackerFile"));
+	if (mTrackers.loadFromFile(tracker_file))
+	{
+		llinfos << "Loaded nui trackers from " << tracker_file << llendl;
+	}
+
+	// A replay does not need a sensor attached.
+	std::string replay_file = gSavedSettings.getString("NuiReplayFile");
+	if (!replay_file.empty())
+	{
+		if (!LLFile::isfile(replay_file))
+		{
+			replay_file = gDirUtilp->getExpandedFilename(LL_PATH_LOGS, replay_file);
+		}
+		startReplay(replay_file);
+	}
+
 	if (!  NuiFactory()->Init()) {
 		mDriverState = NUI_UNINITIALIZED;
 		return;
 	}
 	mDriverState = NUI_INITIALIZED;
 
+	LLNuiLiveSource source(mTrackers);
+	LLNuiGestureGraph<LLNuiLiveSource> graph;
+	graph.build(source);
+
+	mCanMove = graph.mCanMove;
+	mPush = graph.mPush;
+	mCanYaw = graph.mCanYaw;
+	mYaw = graph.mYaw;
+	mCanPitch = graph.mCanPitch;
+	mPitch = graph.mPitch;
+	mCanFly = graph.mCanFly;
+	mFly = graph.mFly;
+
+	// Unless NuiReducedJoints is off, only the joints the gestures read are
+	// captured and recorded, which skips the legs, feet and spine. The
+	// sensor still tracks and smooths the whole skeleton: neither NuiLib
+	// nor Kinect SDK 1.0 can be asked for less, so this only trims what
+	// recording adds, not the per-frame tracking cost.
+	mJointMask = NUI_ALL_JOINTS;
+	if (gSavedSettings.getBOOL("NuiReducedJoints"))
+	{
+		mJointMask = nui_gesture_joint_mask() | (1 << NUI_JOINT_HIP_CENTER);
+		llinfos << "Nui reduced joint profile, mask 0x" << std::hex << mJointMask << std::dec << llendl;
+	}
+	for (S32 i = 0; i < NUI_JOINT_COUNT; ++i)
+	{
+		if (mJointMask & (1 << i))
+		{
+			mJoints[i] = joint(i);
+		}
+	}
+	// The hip centre moves with every new skeleton, so it paces the capture.
+	mJoints[NUI_JOINT_HIP_CENTER].OnChange([this](IObservable *s) {
+		captureSkeleton();
+	});
 
-
-	//Get the primary vectors.
-	Vector shoulderR = joint(SHOULDER_RIGHT);
-	Vector shoulderL = joint(SHOULDER_LEFT);
-	Vector elbowR = joint(ELBOW_RIGHT);
-	Vector elbowL = joint(ELBOW_LEFT);
-	Vector wristR = joint(WRIST_RIGHT);
-	Vector wristL = joint(WRIST_LEFT);
-	Vector handR = joint(HAND_RIGHT);
-	Vector handL = joint(HAND_LEFT);
-	Vector hipC = joint(HIP_CENTER);
-	Vector head = joint(HEAD);
-
-	Vector yAxis = NuiLib::Vector("Y", 0.f, 1.f, 0.f);
-	// Normal is the direction the camera is facing.
-	Vector normal = Vector("Normal", 0, 0, 1);
-
-	//Camera - If the right elbow is raised to be in line with the shoulders the camera is active.
-	NuiLib::Vector upperArmCameraR = elbowR - shoulderR;
-	NuiLib::Vector lowerArmCameraR = elbowR - wristR;
-	Condition cameraActiveR = abs(x(upperArmCameraR)) > (abs(y(upperArmCameraR)) + abs(z(upperArmCameraR))) * 2.f;
-
-	//Camera - If the right elbow is raised to be in line with the shoulders the camera is active.
-	NuiLib::Vector upperArmCameraL = shoulderL - elbowL;
-	NuiLib::Vector lowerArmCameraL = elbowL - wristL;
-	Condition cameraActiveL = abs(x(upperArmCameraL)) > (abs(y(upperArmCameraL)) + abs(z(upperArmCameraL))) * 2.f;
-
-	Condition cameraActive = cameraActiveL || cameraActiveR;
-	//Condition cameraActive = cameraActiveR;
-	
-	// Normalize the distance between the shoulder and the right hand against the total length of the arm (armMax).
-	// Once normalized constrain the value between the input from tracker PushD (starting at .8) and 1. 
-	// So if the normalized value is .9 the constrained value is .5. Alternatively if the normalized value is .8 the constrained value is 0.
-	//Scalar push = constrain(normalize(magnitude(armR), armMax), tracker("PushD", 25, .04f, 0.f, 20), 1.f, 0.f, false);
-	// If the camera is inactive and the push value is > 0 and the forward component is significantly larger than the horizontal and vertical components combined.
-	//mPush = !cameraActive && push > 0 && z(armR) > ((abs(x(armR) + abs(y(armR)))) * tracker("PushActive", 9, .5f, .5f, 5));
-
-	//Pitch
-	Scalar pitchArmD = tracker("PitchArmD", 20, 1.f, 0.f, 10);
-	Scalar pitchArmR = tracker("PitchArmR", 40, 2.f, 10.f, 17);
-	Scalar pitchArmG = tracker("PitchArmG", 30, 1.f, 0.f, 15);
-	Scalar pitchAS = tracker("PitchAS", 29, 1.f, 1.f, 20);
-
-	Vector vPlaneCameraR = NuiLib::limit(lowerArmCameraR, false, true, true);
-	Vector vPlaneCameraL = NuiLib::limit(lowerArmCameraL, false, true, true);
-	// Pitch is the angle between normal and the vertical component of the vector between right shoulder and right hand.
-	Scalar pitchR = NuiLib::acos(dot(normalize(vPlaneCameraR), normal)) * invert(x(cross(normal, vPlaneCameraR)) >= 0);
-	Scalar pitchL = NuiLib::acos(dot(normalize(vPlaneCameraL), normal)) * invert(x(cross(normal, vPlaneCameraL)) >= 0);
-	// Constrain the pitch value by 3 values input by 3 trackers.
-	pitchR = constrain(pitchR * R2DEG, pitchArmD, pitchArmR, pitchArmG, true) / pitchAS;
-	pitchL = constrain(pitchL * R2DEG, pitchArmD, pitchArmR, pitchArmG, true) / pitchAS;
-	mPitch = ifScalar(cameraActiveR, pitchR, .0f) + ifScalar(cameraActiveL, pitchL, .0f);
-
-	mCanPitch = cameraActive && mPitch != 0.f;
-
-	//Yaw - Yaw has 3 components. The camera arm. The horizontal lean (head vs hip centre) and the twist of the shoulders.
-	Scalar yawArmD = tracker("YawArmD", 20, 1.f, 0.f, 10);
-	Scalar yawArmR = tracker("YawArmR", 40, 2.f, 10.f, 15);
-	Scalar yawArmG = tracker("YawArmG", 20, 1.f, 0.f, 10);
-	Scalar yawLeanD = tracker("YawLeanD", 20, .5f, 0.f, 10);
-	Scalar yawLeanR = tracker("YawLeanR", 20, 1.f, 0.f, 15);
-	Scalar yawLeanG = tracker("YawLeanG", 50, 1.f, 0.f, 30);
-	Scalar yawTwistD = tracker("YawTwistD", 10, .025f, 0.f, 6);
-	Scalar yawTwistR = tracker("YawTwistR", 20, .05f, 0.f, 9);
-	Scalar yawTwistG = tracker("YawTwistG", 20, 1.f, 0.f, 10);
-	
-	Vector hPlaneCameraR = NuiLib::limit(lowerArmCameraR, true, false, true);
-	Vector hPlaneCameraL = NuiLib::limit(lowerArmCameraL, true, false, true);
-	// Yaw component 1 is the angle between normal and the horizontal component of the vector between right shoulder and right hand.
-	Scalar yawCameraR = NuiLib::acos(dot(normalize(hPlaneCameraR), normal)) * invert(y(cross(normal, hPlaneCameraR)) >= 0);
-	Scalar yawCameraL = NuiLib::acos(dot(normalize(hPlaneCameraL), normal)) * invert(y(cross(normal, hPlaneCameraL)) >= 0);
-	// Constrain the component value by 3 values input by 3 trackers.
-	yawCameraR = constrain(yawCameraR * R2DEG, yawArmD, yawArmR, yawArmG, true) / tracker("YawAS", 29, 1.f, 1.f, 20);
-	yawCameraL = constrain(yawCameraL * R2DEG, yawArmD, yawArmR, yawArmG, true) / tracker("YawAS", 29, 1.f, 1.f, 20);
-	//Only take the value if camera is active
-	yawCameraR = ifScalar(cameraActiveR, yawCameraR, .0f);
-	yawCameraL = ifScalar(cameraActiveL, yawCameraL, .0f);
-
-	Vector yawCore = limit(head - hipC, true, true, false);
-	// Yaw component 2 is how far the user is leaning horizontally. This is calculated the angle between vertical and the vector between the hip centre and the head.
-	Scalar yawLean = NuiLib::acos(dot(normalize(yawCore), yAxis)) * invert(z(cross(yawCore, yAxis)) >= 0);
-	// Constrain the component value by 3 values input by 3 trackers.
-	yawLean = constrain(yawLean * R2DEG, yawLeanD, yawLeanR, yawLeanG, true) / tracker("YawLS", 29, 1.f, 1.f, 20);
-	
-	Vector shoulderDiff = shoulderR - shoulderL;
-	// Yaw component 3 is the twist of the shoulders. This is calculated as the difference between the two z values.
-	Scalar yawTwist = z(shoulderDiff) / magnitude(shoulderDiff);
-	// Constrain the component value by 3 values input by 3 trackers.
-	yawTwist = constrain(yawTwist, yawTwistD, yawTwistR, yawTwistG, true) / tracker("YawTS", 29, 1.f, 1.f, 20);
-
-	// Combine all 3 components into the final yaw value.
-	mYaw = yawCameraR + yawCameraL + yawLean + yawTwist;
-	mCanYaw = (cameraActive && (yawCameraR + yawCameraL) != 0.f) || yawLean != 0.f || yawTwist != 0.f;
-
-	Scalar flyUpD = tracker("FlyUpD", 120, 1.f, 0.f, 65);
-	Scalar flyUpR = tracker("FlyUpR", 120, 1.f, 0.f, 50);
-	Scalar flyDownD = tracker("FlyDownD", 120, 1.f, 0.f, 45);
-	Scalar flyDownR = tracker("FlyDownR", 120, 1.f, 0.f, 15);
-
-	//Fly
-	NuiLib::Vector armR = shoulderR - handR;
-	NuiLib::Vector vPlaneR = limit(armR, false, true, true);
-	// The angle between normal and the vector between the shoulder and the hand.
-	Scalar flyR = NuiLib::acos(NuiLib::dot(normalize(vPlaneR), normal));
-	// Constrain the positive angle to go up past vertical.
-	Scalar upR = constrain(flyR * R2DEG, flyUpD, flyUpR, 0.f, true); //Constraints if R is raised
-	// Constrain the negative angle to stop before vertical so that hands lying by the side doesn't trigger flying down.
-	Scalar downR = constrain(flyR * R2DEG, flyDownD, flyDownR, 0.f, true); //Constraints if R is lowered
-	// Whether the arm is raised or lowered.
-	Condition dirR = NuiLib::x(cross(normal, vPlaneR)) >= 0; 
-	// Whether R is in range to fly
-	Condition flyCondR = (magnitude(vPlaneR) > 0.f) && ((dirR && (upR > 0)) || ((!dirR) && (downR > 0))); 
-
-	NuiLib::Vector armL = shoulderL - handL;
-	NuiLib::Vector vPlaneL = limit(armL, false, true, true);
-	// The angle between normal and the vector between the shoulder and the hand.
-	Scalar flyL = NuiLib::acos(NuiLib::dot(normalize(vPlaneL), normal)) * R2DEG;
-	// Constrain the positive angle to go up past vertical.
-	Scalar upL = constrain(flyL, flyUpD, flyUpR, 0.f, true); //Constraints if L is raised
-	// Constrain the negative angle to stop before vertical so that hands lying by the side doesn't trigger flying down.
-	Scalar downL = constrain(flyL, flyDownD, flyDownR, 0.f, true); //Constraints if L is lowered
-	// Whether the arm is raised or lowered.
-	Condition dirL = NuiLib::x(cross(normal, vPlaneL)) >= 0; 
-	// Whether L is in range to fly
-	Condition flyCondL = magnitude(vPlaneL) > 0.f && (dirL && upL > 0.f) || (!dirL && downL > 0.f); 
-
-	//Up trumps down
-	mFly = (dirR && flyCondR) || (dirL && flyCondL);
-	// Fly if camera is inactive and flying with right or left arm
-	mCanFly = (flyCondR && !cameraActiveR) || (flyCondL && !cameraActiveL);
-
-	Scalar pushThresh = tracker("PushThreshold", 30, .05f, .0f, 9);
-	Condition pushR = z(shoulderR) - z(handR) > pushThresh; 
-	Condition pushL = z(shoulderL) - z(handL) > pushThresh; 
-	mPush = (pushR && !cameraActiveR) || (pushL && !cameraActiveL);
-
-	mCanMove = mPush || mCanYaw || mCanPitch || mCanFly;
-
-
+	if (gSavedSettings.getBOOL("NuiRecordSessions"))
+	{
+		std::string name = "nui_" + LLDate::now().toHTTPDateString("%Y%m%d_%H%M%S") + ".nrec";
+		startRecording(gDirUtilp->getExpandedFilename(LL_PATH_LOGS, name));
+	}
 
 	/*mLClick = fist(true);
 	mLClick.OnTrue([](IObservable *s) {
@@ -263,12 +214,30 @@ void LLViewerNui::init(bool autoenable)
 		//}
 	});*/
 
+	if (gSavedSettings.getBOOL("NuiHeadLook"))
+	{
+		// NuiLib only gives us the skeleton, so the colour frames come from
+		// the Kinect SDK's stream on the sensor NuiLib opened. This fails
+		// if the sensor was not initialised with colour.
+		HANDLE stream = NULL;
+		if (FAILED(NuiImageStreamOpen(NUI_IMAGE_TYPE_COLOR, NUI_IMAGE_RESOLUTION_640x480, 0, 2, NULL, &stream)))
+		{
+			llwarns << "No Kinect colour stream, head look is off" << llendl;
+		}
+		else
+		{
+			mColourStream = stream;
+			std::string cascade = gDirUtilp->getExpandedFilename(LL_PATH_APP_SETTINGS, gSavedSettings.getString("NuiHeadLookCascade"));
+			mHeadTracker.start(cascade);
+		}
+	}
+
 	NuiFactory()->SetAutoPoll(true);
 }
 
 void LLViewerNui::scanNui()
 {
-	if (mDriverState != NUI_INITIALIZED/* || !gSavedSettings.getBOOL("NuiEnabled")*/)
+	if (mDriverState != NUI_INITIALIZED && !isReplaying()/* || !gSavedSettings.getBOOL("NuiEnabled")*/)
 	{
 		return;
 	}
@@ -279,29 +248,196 @@ void LLViewerNui::scanNui()
 		return;
 	}
 
+	LLNuiGestureState gestures;
+	if (!sampleReplayGestures(gestures))
+	{
+		if (mDriverState != NUI_INITIALIZED)
+		{
+			return;
+		}
+
+		if (*mLClick) {
+			S32 x, y;
+			LLUI::getMousePositionScreen(&x, &y);
+			LLUI::setMousePositionScreen(x++, y++);
+			cout << "X: " << x << " - Y: " << y << '\n';
+		}
 
-	if (*mLClick) {
-		S32 x, y;
-		LLUI::getMousePositionScreen(&x, &y);
-		LLUI::setMousePositionScreen(x++, y++);
-		cout << "X: " << x << " - Y: " << y << '\n';
+		sampleLiveGestures(gestures);
+		applyHeadLook(gestures);
 	}
 
-	if (*mCanMove/* && LLSelectMgr::getInstance()->getSelection().isNull()*/) {
-		if (*mPush)
-			gAgent.moveAt(1, false);
-		if (*mCanYaw)
-			agentYaw(*mYaw);
-		//if (*mCanPitch)
-			agentPitch(*mPitch);
-		if (*mCanFly)
-			agentFly();
+	// LLInputQueue::apply() merges these with the other devices and moves
+	// the agent once all of them have been scanned.
+	LLInputQueue* input = LLInputQueue::getInstance();
+	if (gestures.mCanMove/* && LLSelectMgr::getInstance()->getSelection().isNull()*/) {
+		input->post(INPUT_DEVICE_NUI, INPUT_MOVE_AT, gestures.mPush ? 1.f : 0.f);
+		input->post(INPUT_DEVICE_NUI, INPUT_YAW, gestures.mCanYaw ? gestures.mYaw : 0.f);
+		//if (gestures.mCanPitch)
+		input->post(INPUT_DEVICE_NUI, INPUT_PITCH, gestures.mPitch);
+		input->post(INPUT_DEVICE_NUI, INPUT_FLY, (gestures.mCanFly && gestures.mFly) ? 1.f : 0.f);
+		input->post(INPUT_DEVICE_NUI, INPUT_MOVE_UP, gestures.mCanFly ? (gestures.mFly ? 1.f : -1.f) : 0.f);
 	} else {
-		agentYaw(0.f);
-		agentPitch(0.f);
-		gAgent.moveAt(0, false);
-		gAgent.moveUp(0.f);
+		input->release(INPUT_DEVICE_NUI);
+	}
+}
+
+// -----------------------------------------------------------------------------
+void LLViewerNui::sampleLiveGestures(LLNuiGestureState& state) const
+{
+	state.mCanMove = *mCanMove;
+	state.mPush = *mPush;
+	state.mCanYaw = *mCanYaw;
+	state.mYaw = *mYaw;
+	state.mCanPitch = *mCanPitch;
+	state.mPitch = *mPitch;
+	state.mCanFly = *mCanFly;
+	state.mFly = *mFly;
+}
+
+// -----------------------------------------------------------------------------
+void LLViewerNui::applyHeadLook(LLNuiGestureState& state)
+{
+	if (!mHeadTracker.isRunning())
+	{
+		return;
+	}
+
+	// Hand the worker the latest head window if it is idle. This is a small
+	// crop of the colour frame, never the whole image, so the frame is read
+	// in place and given straight back.
+	const NUI_IMAGE_FRAME* frame = NULL;
+	if (SUCCEEDED(NuiImageStreamGetNextFrame((HANDLE)mColourStream, 0, &frame)))
+	{
+		NUI_LOCKED_RECT rect;
+		frame->pFrameTexture->LockRect(0, &rect, NULL, 0);
+		if (rect.Pitch)
+		{
+			cv::Mat colour(480, 640, CV_8UC4, rect.pBits, rect.Pitch);	// BGRA
+			F32 head[3] = { mJoints[NUI_JOINT_HEAD]->GetX(), mJoints[NUI_JOINT_HEAD]->GetY(), mJoints[NUI_JOINT_HEAD]->GetZ() };
+			mHeadTracker.submitFrame(colour, head, LLTimer::getTotalSeconds());
+		}
+		frame->pFrameTexture->UnlockRect(0);
+		NuiImageStreamReleaseFrame((HANDLE)mColourStream, frame);
+	}
+
+	// Arm gestures take priority over head look.
+	F32 yaw, pitch;
+	if (!mHeadTracker.getLook(yaw, pitch))
+	{
+		return;
+	}
+	F32 dead_zone = gSavedSettings.getF32("NuiHeadLookDeadZone");
+	F32 gain = gSavedSettings.getF32("NuiHeadLookGain");
+	if (!state.mCanYaw && fabsf(yaw) > dead_zone)
+	{
+		state.mCanMove = state.mCanYaw = true;
+		state.mYaw = (yaw > 0.f ? yaw - dead_zone : yaw + dead_zone) * gain;
+	}
+	if (!state.mCanPitch && fabsf(pitch) > dead_zone)
+	{
+		state.mCanMove = state.mCanPitch = true;
+		state.mPitch = (pitch > 0.f ? pitch - dead_zone : pitch + dead_zone) * gain;
+	}
+}
+
+// -----------------------------------------------------------------------------
+bool LLViewerNui::sampleReplayGestures(LLNuiGestureState& state)
+{
+	if (!isReplaying())
+	{
+		return false;
+	}
+
+	// Use the first recorded frame at or after the replay clock.
+	F64 now = mReplay.getStartTime() + mReplayOffset + mReplayTimer.getElapsedTimeF64();
+	while (!mHaveReplayFrame || mReplayFrame.mTime < now)
+	{
+		if (!mReplay.readFrame(mReplayFrame))
+		{
+			llinfos << "Nui replay finished" << llendl;
+			stopReplay();
+			return false;
+		}
+		mHaveReplayFrame = true;
+	}
+
+	LLNuiOfflineSource source(mReplayFrame, mTrackers);
+	LLNuiOfflineGraph graph;
+	graph.build(source);
+	state.sample(graph);
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+void LLViewerNui::captureSkeleton()
+{
+	if (!mRecorder.isOpen())
+	{
+		return;
+	}
+
+	LLNuiSkeletonFrame frame;
+	frame.mTime = LLTimer::getTotalSeconds();
+	LLNuiGestureState state;
+	sampleLiveGestures(state);
+	frame.mIntents = state.getIntents();
+	for (S32 i = 0; i < NUI_JOINT_COUNT; ++i)
+	{
+		if (!(mJointMask & (1 << i)))
+		{
+			continue;
+		}
+		frame.mJoints[i][0] = mJoints[i]->GetX();
+		frame.mJoints[i][1] = mJoints[i]->GetY();
+		frame.mJoints[i][2] = mJoints[i]->GetZ();
 	}
+	mRecorder.addFrame(frame);
+}
+
+// -----------------------------------------------------------------------------
+bool LLViewerNui::startRecording(const std::string& filename)
+{
+	return mRecorder.open(filename, mJointMask, gSavedSettings.getF32("NuiRecordKeyframeInterval"));
+}
+
+// -----------------------------------------------------------------------------
+void LLViewerNui::stopRecording()
+{
+	mRecorder.close();
+}
+
+// -----------------------------------------------------------------------------
+bool LLViewerNui::startReplay(const std::string& filename)
+{
+	if (!mReplay.open(filename))
+	{
+		return false;
+	}
+	llinfos << "Replaying nui recording " << filename << ", "
+			<< (mReplay.getEndTime() - mReplay.getStartTime()) << " seconds" << llendl;
+	seekReplay(0.0);
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+void LLViewerNui::stopReplay()
+{
+	mReplay.close();
+	mHaveReplayFrame = false;
+}
+
+// -----------------------------------------------------------------------------
+void LLViewerNui::seekReplay(F64 offset)
+{
+	if (!isReplaying())
+	{
+		return;
+	}
+	mReplayOffset = llmax(offset, 0.0);
+	mReplayTimer.reset();
+	mReplay.seek(mReplay.getStartTime() + mReplayOffset);
+	mHaveReplayFrame = false;
 }
 
 // -----------------------------------------------------------------------------
@@ -341,57 +477,6 @@ void LLViewerNui::moveObjects(bool reset)
 	}
 }
 
-// -----------------------------------------------------------------------------
-void LLViewerNui::agentFly()
-{
-	if (*mFly && (!(gAgent.getFlying() ||
-		!gAgent.canFly() ||
-		gAgent.upGrabbed() ||
-		!gSavedSettings.getBOOL("AutomaticFly"))) )
-	{
-		gAgent.setFlying(true);
-	}
-	gAgent.moveUp(*mFly ? 1 : -1);
-}
-
-// -----------------------------------------------------------------------------
-void LLViewerNui::agentPitch(F32 pitch_inc)
-{
-	if (pitch_inc < 0)
-	{
-		gAgent.setControlFlags(AGENT_CONTROL_PITCH_POS);
-	}
-	else if (pitch_inc > 0)
-	{
-		gAgent.setControlFlags(AGENT_CONTROL_PITCH_NEG);
-	}
-	
-	gAgent.pitch(-pitch_inc);
-}
-
-// -----------------------------------------------------------------------------
-void LLViewerNui::agentYaw(F32 yaw_inc)
-{	
-	// Cannot steer some vehicles in mouselook if the script grabs the controls
-	if (gAgentCamera.cameraMouselook() && !gSavedSettings.getBOOL("NuiMouselookYaw"))
-	{
-		gAgent.rotate(-yaw_inc, gAgent.getReferenceUpVector());
-	}
-	else
-	{
-		if (yaw_inc < 0)
-		{
-			gAgent.setControlFlags(AGENT_CONTROL_YAW_POS);
-		}
-		else if (yaw_inc > 0)
-		{
-			gAgent.setControlFlags(AGENT_CONTROL_YAW_NEG);
-		}
-
-		gAgent.yaw(-yaw_inc);
-	}
-}
-
 // -----------------------------------------------------------------------------
 void LLViewerNui::terminate()
 {
@@ -38,6 +38,12 @@
 
 #include <NuiLib-API.h>
 
+#include "llnuigesturegraph.h"
+#include "llnuiheadtracker.h"
+#include "llnuirecording.h"
+#include "llnuitrackers.h"
+#include "llframetimer.h"
+
 
 typedef enum e_nui_driver_state
 {
@@ -68,14 +74,30 @@ public:
 	void setOverrideCamera(bool val);
 	bool toggleFlycam();
 	std::string getDescription();
+
+	// Records every skeleton the sensor delivers to 'filename'.
+	bool startRecording(const std::string& filename);
+	void stopRecording();
+	bool isRecording() const		{ return mRecorder.isOpen(); }
+
+	// Drives the avatar from a recording instead of the sensor.
+	bool startReplay(const std::string& filename);
+	void stopReplay();
+	bool isReplaying() const		{ return mReplay.isOpen(); }
+	// Seconds from the start of the recording.
+	void seekReplay(F64 offset);
 	
 protected:
 	void updateEnabled(bool autoenable);
 	void handleRun(F32 inc);
-	void agentFly();
-	void agentPitch(F32 pitch_inc);
-	void agentYaw(F32 yaw_inc);
 	void agentJump();
+
+	// Called on NuiLib's acquisition thread for every new skeleton.
+	void captureSkeleton();
+	void sampleLiveGestures(LLNuiGestureState& state) const;
+	bool sampleReplayGestures(LLNuiGestureState& state);
+	// Turns the camera towards where the user is looking when the arms are idle.
+	void applyHeadLook(LLNuiGestureState& state);
 	
 private:           
 	//--Move--
@@ -130,6 +152,9 @@ NuiLib::Scalar					mZRot;
 
 NuiLib::Condition				mLClick;
 
+//The joints in mJointMask, for recording.
+NuiLib::Vector					mJoints[NUI_JOINT_COUNT];
+
 
 ENuiDriverState	mDriverState;
 NDOF_Device				*mNdofDev;
@@ -138,6 +163,18 @@ F32						mPerfScale;
 bool					mCameraUpdated;
 bool 					mOverrideCamera;
 U32						mNuiRun;
+LLNuiTrackerSet			mTrackers;
+U32						mJointMask;
+
+LLNuiRecorder			mRecorder;
+LLNuiRecordingReader	mReplay;
+LLFrameTimer			mReplayTimer;
+F64						mReplayOffset;
+LLNuiSkeletonFrame		mReplayFrame;
+bool					mHaveReplayFrame;
+
+LLNuiHeadTracker		mHeadTracker;
+void*					mColourStream;	// Kinect SDK stream HANDLE, for head look
 };
 
 #endif